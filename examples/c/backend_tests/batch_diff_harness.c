@@ -0,0 +1,129 @@
+// Computes every test of a directory and writes the error flag and the outputs
+// of each test to a results file. Compiled with -DM_BATCH, the tests are
+// computed all at once by the code generated with --backend c_batch, and
+// otherwise one by one by the code generated with --backend c, so that the
+// two results files can be compared.
+//
+// Usage: batch_diff_harness.exe <tests directory> <results file>
+
+#ifdef M_BATCH
+#include "ir_batch_tests.h"
+#else
+#include "ir_tests.h"
+#endif
+#include "harness_utils.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PATH_SIZE 1024
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s <tests directory> <results file>\n", argv[0]);
+        return -1;
+    }
+
+    // Sorted so that both versions list the tests in the same order
+    struct dirent **entries;
+    int num_entries = scandir(argv[1], &entries, NULL, alphasort);
+    if (num_entries < 0)
+    {
+        printf("Could not read the tests directory %s!\n", argv[1]);
+        return -1;
+    }
+
+    char **names = malloc(num_entries * sizeof(char *));
+    m_input *inputs = malloc(num_entries * sizeof(m_input));
+    m_output *outputs = malloc(num_entries * sizeof(m_output));
+    m_value *input_array = malloc(m_num_inputs() * sizeof(m_value));
+    m_value *output_array = malloc(m_num_outputs() * sizeof(m_value));
+    char file_path[PATH_SIZE];
+    int num_cases = 0;
+    for (int i = 0; i < num_entries; i++)
+    {
+        char *test_file = entries[i]->d_name;
+        if (strcmp(test_file, ".") != 0 && strcmp(test_file, "..") != 0)
+        {
+            snprintf(file_path, sizeof file_path, "%s/%s", argv[1], test_file);
+            if (read_inputs(file_path, input_array, m_num_inputs(),
+                            m_get_input_index))
+            {
+                names[num_cases] = test_file;
+                m_input_from_array(inputs + num_cases, input_array);
+                num_cases++;
+            }
+        }
+    }
+
+#ifdef M_BATCH
+    m_batch_ctx *ctx = m_batch_ctx_new();
+    if (ctx == NULL)
+    {
+        printf("Could not allocate the context!\n");
+        return -1;
+    }
+    m_extracted_batch_ctx(ctx, num_cases, inputs, outputs);
+    m_batch_ctx_free(ctx);
+#else
+    m_ctx *ctx = m_ctx_new();
+    if (ctx == NULL)
+    {
+        printf("Could not allocate the context!\n");
+        return -1;
+    }
+    for (int i = 0; i < num_cases; i++)
+    {
+        m_ctx_reset(ctx);
+        m_extracted_ctx(ctx, outputs + i, inputs + i);
+    }
+    m_ctx_free(ctx);
+#endif
+
+    FILE *results = fopen(argv[2], "w");
+    if (results == NULL)
+    {
+        printf("Could not open the results file %s!\n", argv[2]);
+        return -1;
+    }
+    for (int i = 0; i < num_cases; i++)
+    {
+        fprintf(results, "%s: error %d\n", names[i], outputs[i].is_error);
+        if (outputs[i].is_error)
+        {
+            continue;
+        }
+        m_output_to_array(output_array, outputs + i);
+        for (int j = 0; j < m_num_outputs(); j++)
+        {
+            if (output_array[j].undefined)
+            {
+                fprintf(results, "%s: %s undefined\n", names[i],
+                        m_get_output_name_from_index(j));
+            }
+            else
+            {
+                // + 0. so that -0. and 0. are printed the same
+                fprintf(results, "%s: %s %.17g\n", names[i],
+                        m_get_output_name_from_index(j),
+                        output_array[j].value + 0.);
+            }
+        }
+    }
+    fclose(results);
+
+    for (int i = 0; i < num_entries; i++)
+    {
+        free(entries[i]);
+    }
+    free(entries);
+    free(names);
+    free(inputs);
+    free(outputs);
+    free(input_array);
+    free(output_array);
+    return 0;
+}
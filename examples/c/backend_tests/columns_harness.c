@@ -0,0 +1,144 @@
+// Computes all the households of a columnar file written by to_columns.py, and
+// reports the time spent loading their inputs and the time spent computing.
+// With an output file, the given outputs of every household are streamed to it
+// through an m_writer, as CSV if its name ends with .csv and as fixed-width
+// binary records otherwise.
+//
+// Usage: columns_harness.exe <columnar file> [<output file> <output>...]
+
+#include "ir_tests.h"
+#include "harness_utils.h"
+#include "m_columns.h"
+#include <stdio.h>
+#include <string.h>
+
+// m_get_input_index exits on an unknown name, the columns of variables that
+// are not inputs of the m_spec are ignored instead
+static int find_input(char *name)
+{
+    for (int i = 0; i < m_num_inputs(); i++)
+    {
+        if (strcmp(m_get_input_name_from_index(i), name) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc == 3)
+    {
+        printf("Usage: %s <columnar file> [<output file> <output>...]\n",
+               argv[0]);
+        return -1;
+    }
+    m_columns *cols = m_columns_open(argv[1]);
+    if (cols == NULL)
+    {
+        printf("Could not read the columnar file %s!\n", argv[1]);
+        return -1;
+    }
+    int num_ignored = m_columns_bind(cols, find_input);
+    if (num_ignored > 0)
+    {
+        printf("%d columns are not inputs and are ignored\n", num_ignored);
+    }
+
+    int num_cases = m_columns_num_cases(cols);
+    m_value *input_array_for_m = malloc(m_num_inputs() * sizeof(m_value));
+    m_input *input_for_m = malloc(sizeof(m_input));
+    m_output *output_for_m = malloc(sizeof(m_output));
+    m_ctx *ctx = m_ctx_new();
+    if (ctx == NULL)
+    {
+        printf("Could not allocate the context!\n");
+        return -1;
+    }
+    FILE *out = NULL;
+    m_writer *writer = NULL;
+    if (argc > 3)
+    {
+        int num_selected = argc - 3;
+        int *selected = malloc(num_selected * sizeof(int));
+        for (int i = 0; i < num_selected; i++)
+        {
+            selected[i] = m_get_output_index(argv[3 + i]);
+        }
+        size_t len = strlen(argv[2]);
+        m_writer_format format =
+            len >= 4 && strcmp(argv[2] + len - 4, ".csv") == 0
+                ? M_WRITER_CSV
+                : M_WRITER_BINARY;
+        out = fopen(argv[2], "wb");
+        if (out != NULL)
+        {
+            writer = m_writer_new(out, format, selected, num_selected, 0);
+        }
+        free(selected);
+        if (writer == NULL)
+        {
+            printf("Could not write the outputs to %s!\n", argv[2]);
+            return -1;
+        }
+    }
+    // Every household sets the same inputs, the other ones stay undefined
+    for (int i = 0; i < m_num_inputs(); i++)
+    {
+        input_array_for_m[i] = m_undefined;
+    }
+
+    double load_time = 0;
+    double compute_time = 0;
+    double write_time = 0;
+    int num_errors = 0;
+    for (int c = 0; c < num_cases; c++)
+    {
+        double start = now_seconds();
+        m_columns_load_case(cols, c, input_array_for_m);
+        m_input_from_array(input_for_m, input_array_for_m);
+        double loaded = now_seconds();
+        if (m_extracted_ctx(ctx, output_for_m, input_for_m) != 0)
+        {
+            num_errors++;
+        }
+        double computed = now_seconds();
+        if (writer != NULL && m_writer_append(writer, output_for_m) != 0)
+        {
+            printf("Could not write the outputs to %s!\n", argv[2]);
+            return -1;
+        }
+        write_time += now_seconds() - computed;
+        compute_time += computed - loaded;
+        load_time += loaded - start;
+    }
+    if (writer != NULL)
+    {
+        double start = now_seconds();
+        int res = m_writer_free(writer);
+        res |= fclose(out);
+        write_time += now_seconds() - start;
+        if (res != 0)
+        {
+            printf("Could not write the outputs to %s!\n", argv[2]);
+            return -1;
+        }
+    }
+
+    printf("%d households: %.3f s loading the inputs, %.3f s computing, "
+           "%.3f s writing the outputs (%.1f households/s)\n",
+           num_cases, load_time, compute_time, write_time,
+           num_cases / (load_time + compute_time + write_time));
+    if (num_errors > 0)
+    {
+        printf("%d computations stopped on an error\n", num_errors);
+    }
+
+    m_columns_close(cols);
+    m_ctx_free(ctx);
+    free(input_array_for_m);
+    free(input_for_m);
+    free(output_for_m);
+    return 0;
+}
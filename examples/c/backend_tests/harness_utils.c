@@ -0,0 +1,65 @@
+#include "harness_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+double now_seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int compare_doubles(const void *x, const void *y)
+{
+    double a = *(const double *)x;
+    double b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+
+double percentile(const double *sorted, int n, double p)
+{
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+int read_inputs(const char *file_path, m_value *input_array, int num_inputs,
+                int (*get_input_index)(char *))
+{
+    char line_buffer[1000];
+    char *separator = "/";
+    char *saveptr;
+    FILE *fp = fopen(file_path, "r");
+    if (fp == NULL)
+    {
+        return 0;
+    }
+    for (int i = 0; i < num_inputs; i++)
+    {
+        input_array[i] = m_undefined;
+    }
+    int in_inputs = 0;
+    while (EOF != fscanf(fp, "%[^\n]\n", line_buffer))
+    {
+        if (strcmp(line_buffer, "#ENTREES-PRIMITIF") == 0)
+        {
+            in_inputs = 1;
+        }
+        else if (line_buffer[0] == '#')
+        {
+            if (in_inputs)
+            {
+                break;
+            }
+        }
+        else if (in_inputs)
+        {
+            char *name = strtok_r(line_buffer, separator, &saveptr);
+            char *value_s = strtok_r(NULL, separator, &saveptr);
+            input_array[get_input_index(name)] = m_literal(atoi(value_s));
+        }
+    }
+    fclose(fp);
+    return 1;
+}
@@ -0,0 +1,30 @@
+// Helpers shared by the harnesses and benchmarks of this directory: timing,
+// latency percentiles and reading the inputs of a test file.
+
+#ifndef HARNESS_UTILS_H
+#define HARNESS_UTILS_H
+
+#ifdef M_VALUE_INLINE
+#include "m_value_inline.h"
+#else
+#include "m_value.h"
+#endif
+
+// Time in seconds on a monotonic clock
+double now_seconds(void);
+
+// Comparison of two doubles for qsort
+int compare_doubles(const void *x, const void *y);
+
+// p-th quantile (p between 0 and 1) of n values sorted by compare_doubles
+double percentile(const double *sorted, int n, double p);
+
+// Reads the primitive inputs of a test file, the lines between
+// #ENTREES-PRIMITIF and the next section, into input_array; the other inputs
+// are undefined. The generated m_num_inputs and m_get_input_index are passed
+// as arguments so that this file does not depend on a generated header.
+// Returns 0 if the file could not be opened.
+int read_inputs(const char *file_path, m_value *input_array, int num_inputs,
+                int (*get_input_index)(char *));
+
+#endif /* HARNESS_UTILS_H */
@@ -0,0 +1,80 @@
+// Measures the lookups of the variables by name (m_get_input_index and
+// m_get_output_index) and by index (m_get_*_name_from_index), which the
+// harnesses call for every line of a test file.
+//
+// Usage: lookup_bench.exe [rounds]
+
+#include "ir_tests.h"
+#include "harness_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ROUNDS 1000
+
+// Looks up every name, rounds times, and checks that the index found has the
+// same name (duplicate names are all found at their first index)
+static int bench(const char *kind, int num, char *(*name_of)(int),
+                 int (*index_of)(char *), int rounds)
+{
+    if (num == 0)
+    {
+        return 0;
+    }
+    char **names = malloc(num * sizeof(char *));
+    for (int i = 0; i < num; i++)
+    {
+        names[i] = name_of(i);
+    }
+    long checksum = 0;
+    double start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < num; i++)
+        {
+            checksum += index_of(names[i]);
+        }
+    }
+    double by_name = now_seconds() - start;
+    start = now_seconds();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < num; i++)
+        {
+            checksum += name_of(i)[0];
+        }
+    }
+    double by_index = now_seconds() - start;
+
+    int res = 0;
+    for (int i = 0; i < num; i++)
+    {
+        if (strcmp(name_of(index_of(names[i])), names[i]) != 0)
+        {
+            printf("%s %s found at the index of %s!\n", kind, names[i],
+                   name_of(index_of(names[i])));
+            res = -1;
+        }
+    }
+    long lookups = (long)rounds * num;
+    printf("%d %ss: %.1f ns per lookup by name, %.1f ns by index (checksum %ld)\n",
+           num, kind, by_name / lookups * 1e9, by_index / lookups * 1e9,
+           checksum);
+    free(names);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+    if (rounds < 1)
+    {
+        printf("Usage: %s [rounds]\n", argv[0]);
+        return -1;
+    }
+    int res = bench("input", m_num_inputs(), m_get_input_name_from_index,
+                    m_get_input_index, rounds);
+    res |= bench("output", m_num_outputs(), m_get_output_name_from_index,
+                 m_get_output_index, rounds);
+    return res;
+}
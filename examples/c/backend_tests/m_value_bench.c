@@ -0,0 +1,119 @@
+// Measures the m_value runtime on a synthetic chain of assignments written like
+// the code generated by the C backend: nested operator calls reading and
+// writing a table of variables. The chain is computed with the table stored as
+// an array of m_value (the layout of the generated code) and as separate
+// arrays of values and definedness flags.
+//
+// Compile it with and without -DM_VALUE_INLINE to compare the two runtimes.
+//
+// Usage: m_value_bench.exe [rounds]
+
+#ifdef M_VALUE_INLINE
+#include "m_value_inline.h"
+#else
+#include "m_value.h"
+#endif
+#include "harness_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ROUNDS 2000
+#define NUM_INPUTS 64
+#define NUM_VARS 4096
+
+static inline m_value step(m_value x, m_value y, m_value z)
+{
+    m_value t = m_cond(m_gt(x, y), m_add(m_mul(x, m_literal(0.3)), y),
+                       m_sub(z, m_div(x, y)));
+    return m_add(m_round(t), m_floor(z));
+}
+
+// One input out of four is undefined, the others change with the round
+static m_value input(int round, int i)
+{
+    return i % 4 == 0 ? m_undefined : m_literal((i * 37 + round) % 101 - 30);
+}
+
+static double checksum(double value, bool undefined)
+{
+    return undefined ? 1. : value;
+}
+
+static double run_struct(int rounds)
+{
+    m_value *tgv = malloc(NUM_VARS * sizeof(m_value));
+    double sum = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < NUM_INPUTS; i++)
+        {
+            tgv[i] = input(r, i);
+        }
+        for (int i = NUM_INPUTS; i < NUM_VARS; i++)
+        {
+            tgv[i] = step(tgv[i - 1], tgv[i % NUM_INPUTS],
+                          tgv[(i * 7) % NUM_INPUTS]);
+        }
+        sum += checksum(tgv[NUM_VARS - 1].value, tgv[NUM_VARS - 1].undefined);
+    }
+    free(tgv);
+    return sum;
+}
+
+static double run_split(int rounds)
+{
+    double *values = malloc(NUM_VARS * sizeof(double));
+    bool *undefined = malloc(NUM_VARS * sizeof(bool));
+    double sum = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < NUM_INPUTS; i++)
+        {
+            m_value v = input(r, i);
+            values[i] = v.value;
+            undefined[i] = v.undefined;
+        }
+        for (int i = NUM_INPUTS; i < NUM_VARS; i++)
+        {
+            int j = i % NUM_INPUTS;
+            int k = (i * 7) % NUM_INPUTS;
+            m_value x = {.value = values[i - 1], .undefined = undefined[i - 1]};
+            m_value y = {.value = values[j], .undefined = undefined[j]};
+            m_value z = {.value = values[k], .undefined = undefined[k]};
+            m_value v = step(x, y, z);
+            values[i] = v.value;
+            undefined[i] = v.undefined;
+        }
+        sum += checksum(values[NUM_VARS - 1], undefined[NUM_VARS - 1]);
+    }
+    free(values);
+    free(undefined);
+    return sum;
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+#ifdef M_VALUE_INLINE
+    printf("Runtime: m_value_inline.h\n");
+#else
+    printf("Runtime: m_value.c\n");
+#endif
+    double start = now_seconds();
+    double sum_struct = run_struct(rounds);
+    double time_struct = now_seconds() - start;
+    start = now_seconds();
+    double sum_split = run_split(rounds);
+    double time_split = now_seconds() - start;
+    double per_step = 1e9 / ((double)rounds * (NUM_VARS - NUM_INPUTS));
+    printf("Array of m_value: %.3fs (%.2f ns per assignment)\n", time_struct,
+           time_struct * per_step);
+    printf("Separate values and flags: %.3fs (%.2f ns per assignment)\n",
+           time_split, time_split * per_step);
+    if (sum_struct != sum_split)
+    {
+        printf("Different results: %f and %f!\n", sum_struct, sum_split);
+        return -1;
+    }
+    return 0;
+}
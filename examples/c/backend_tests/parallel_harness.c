@@ -0,0 +1,365 @@
+// Runs a test base on all the cores of the machine. Each worker thread owns
+// its computation context and a deque of cases; idle workers steal cases from
+// the others since the cost of a computation varies a lot between households.
+//
+// Usage: parallel_harness.exe [-j <threads>] <tests directory | ->
+// With "-", the paths of the test files are read from stdin, one per line.
+
+#include "ir_tests.h"
+#include "harness_utils.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PATH_SIZE 1024
+
+// Deque of case indexes: the owner pops from the bottom, thieves steal from
+// the top
+typedef struct deque
+{
+    pthread_mutex_t lock;
+    int *cases;
+    int top;
+    int bottom;
+} deque;
+
+typedef struct worker
+{
+    pthread_t thread;
+    int id;
+    int num_failures;
+    deque queue;
+} worker;
+
+static char **case_paths;
+// Negative for the cases that failed or were never computed
+static double *case_latencies;
+static int num_cases;
+static worker *workers;
+static int num_workers;
+
+static int deque_pop(deque *q)
+{
+    int res = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->top < q->bottom)
+    {
+        res = q->cases[--q->bottom];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
+
+static int deque_steal(deque *q)
+{
+    int res = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->top < q->bottom)
+    {
+        res = q->cases[q->top++];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return res;
+}
+
+static int next_case(worker *w)
+{
+    int res = deque_pop(&w->queue);
+    // Cases are never added once the workers are started, so a worker can stop
+    // as soon as every deque has been found empty
+    for (int i = 1; res < 0 && i < num_workers; i++)
+    {
+        res = deque_steal(&workers[(w->id + i) % num_workers].queue);
+    }
+    return res;
+}
+
+// Runs one test file, returns 0 if the computed outputs match the expected ones
+static int run_case(m_ctx *ctx, const char *test_file, m_input *input_for_m,
+                    m_value *input_array_for_m, m_output *output_for_m,
+                    m_value *outputs_array_for_m, double *latency)
+{
+    char line_buffer[1000];
+    char *separator = "/";
+    char *saveptr;
+    char *name;
+    char *value_s;
+    int name_index;
+    double expected_value;
+    m_value computed_value;
+    int num_inputs = m_num_inputs();
+    int num_outputs = m_num_outputs();
+    int state = 0;
+    int res = 0;
+
+    FILE *fp = fopen(test_file, "r");
+    if (fp == NULL)
+    {
+        printf("Test file %s not found!\n", test_file);
+        return -1;
+    }
+    for (int i = 0; i < num_inputs; i++)
+    {
+        input_array_for_m[i] = m_undefined;
+    }
+    for (int i = 0; i < num_outputs; i++)
+    {
+        outputs_array_for_m[i] = m_undefined;
+    }
+    // 0 - before #ENTREES-PRIMITIF
+    // 1 - between #ENTREES-PRIMITIF and #CONTROLES-PRIMITIF
+    // 2 - between #CONTROLES-PRIMITIF and #ENTREES-CORRECTIF
+    // 3 - after #ENTREES-CORRECTIF
+    while (res == 0 && EOF != fscanf(fp, "%[^\n]\n", line_buffer))
+    {
+        switch (state)
+        {
+        case 0:
+            if (strcmp(line_buffer, "#ENTREES-PRIMITIF") == 0)
+            {
+                state = 1;
+            }
+            break;
+
+        case 1:
+            if (strcmp(line_buffer, "#CONTROLES-PRIMITIF") == 0)
+            {
+                state = 2;
+                m_input_from_array(input_for_m, input_array_for_m);
+                double start = now_seconds();
+                m_extracted_ctx(ctx, output_for_m, input_for_m);
+                *latency = now_seconds() - start;
+                m_output_to_array(outputs_array_for_m, output_for_m);
+                break;
+            }
+            name = strtok_r(line_buffer, separator, &saveptr);
+            value_s = strtok_r(NULL, separator, &saveptr);
+            name_index = m_get_input_index(name);
+            input_array_for_m[name_index] = m_literal(atoi(value_s));
+            break;
+
+        case 2:
+            if (strcmp(line_buffer, "#ENTREES-CORRECTIF") == 0)
+            {
+                state = 3;
+                break;
+            }
+            if (strcmp(line_buffer, "#RESULTATS-PRIMITIF") == 0)
+            {
+                break;
+            }
+            name = strtok_r(line_buffer, separator, &saveptr);
+            value_s = strtok_r(NULL, separator, &saveptr);
+            expected_value = atof(value_s);
+            name_index = m_get_output_index(name);
+            computed_value = outputs_array_for_m[name_index];
+            if (computed_value.undefined)
+            {
+                // Undefined values returned are interpreted as 0
+                computed_value.value = 0;
+            }
+            if (computed_value.value != expected_value)
+            {
+                printf("Testing file: %s\nExpected value for %s : %.4f, computed %.4f!\n",
+                       test_file, name, expected_value, computed_value.value);
+                res = -1;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+    fclose(fp);
+    return res;
+}
+
+static void *worker_main(void *arg)
+{
+    worker *w = arg;
+    m_ctx *ctx = m_ctx_new();
+    m_input *input_for_m = malloc(sizeof(m_input));
+    m_value *input_array_for_m = malloc(m_num_inputs() * sizeof(m_value));
+    m_output *output_for_m = malloc(sizeof(m_output));
+    m_value *outputs_array_for_m = malloc(m_num_outputs() * sizeof(m_value));
+    if (ctx == NULL || input_for_m == NULL || input_array_for_m == NULL ||
+        output_for_m == NULL || outputs_array_for_m == NULL)
+    {
+        printf("Worker %d could not allocate its context!\n", w->id);
+        exit(-1);
+    }
+
+    int c;
+    while ((c = next_case(w)) >= 0)
+    {
+        m_ctx_reset(ctx);
+        if (run_case(ctx, case_paths[c], input_for_m, input_array_for_m,
+                     output_for_m, outputs_array_for_m, &case_latencies[c]))
+        {
+            w->num_failures++;
+            case_latencies[c] = -1;
+        }
+    }
+
+    free(input_for_m);
+    free(input_array_for_m);
+    free(output_for_m);
+    free(outputs_array_for_m);
+    m_ctx_free(ctx);
+    return NULL;
+}
+
+static void add_case(const char *path, int *capacity)
+{
+    if (num_cases == *capacity)
+    {
+        *capacity = *capacity == 0 ? 1024 : 2 * *capacity;
+        case_paths = realloc(case_paths, *capacity * sizeof(char *));
+        if (case_paths == NULL)
+        {
+            printf("Out of memory!\n");
+            exit(-1);
+        }
+    }
+    case_paths[num_cases++] = strdup(path);
+}
+
+static void read_cases(const char *source)
+{
+    char path[PATH_SIZE];
+    int capacity = 0;
+    if (strcmp(source, "-") == 0)
+    {
+        while (fgets(path, sizeof path, stdin) != NULL)
+        {
+            path[strcspn(path, "\r\n")] = '\0';
+            if (path[0] != '\0')
+            {
+                add_case(path, &capacity);
+            }
+        }
+        return;
+    }
+    DIR *d = opendir(source);
+    if (d == NULL)
+    {
+        printf("Tests directory %s not found!\n", source);
+        exit(-1);
+    }
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL)
+    {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0)
+        {
+            continue;
+        }
+        snprintf(path, sizeof path, "%s/%s", source, dir->d_name);
+        add_case(path, &capacity);
+    }
+    closedir(d);
+}
+
+int main(int argc, char *argv[])
+{
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+    while ((opt = getopt(argc, argv, "j:")) != -1)
+    {
+        if (opt == 'j')
+        {
+            num_workers = atoi(optarg);
+        }
+        else
+        {
+            printf("Usage: %s [-j <threads>] <tests directory | ->\n", argv[0]);
+            return -1;
+        }
+    }
+    if (optind != argc - 1 || num_workers < 1)
+    {
+        printf("Usage: %s [-j <threads>] <tests directory | ->\n", argv[0]);
+        return -1;
+    }
+
+    read_cases(argv[optind]);
+    if (num_cases == 0)
+    {
+        printf("No test case found!\n");
+        return -1;
+    }
+    case_latencies = malloc(num_cases * sizeof(double));
+    for (int c = 0; c < num_cases; c++)
+    {
+        case_latencies[c] = -1;
+    }
+    workers = calloc(num_workers, sizeof(worker));
+    // Cases are dealt round-robin, stealing balances the rest
+    for (int w = 0; w < num_workers; w++)
+    {
+        workers[w].id = w;
+        pthread_mutex_init(&workers[w].queue.lock, NULL);
+        workers[w].queue.cases = malloc((num_cases / num_workers + 1) * sizeof(int));
+    }
+    for (int c = 0; c < num_cases; c++)
+    {
+        deque *q = &workers[c % num_workers].queue;
+        q->cases[q->bottom++] = c;
+    }
+
+    double start = now_seconds();
+    for (int w = 0; w < num_workers; w++)
+    {
+        pthread_create(&workers[w].thread, NULL, worker_main, &workers[w]);
+    }
+    int num_failures = 0;
+    for (int w = 0; w < num_workers; w++)
+    {
+        pthread_join(workers[w].thread, NULL);
+        num_failures += workers[w].num_failures;
+    }
+    double elapsed = now_seconds() - start;
+
+    // Only the cases computed successfully are in the percentiles
+    int num_timed = 0;
+    for (int c = 0; c < num_cases; c++)
+    {
+        if (case_latencies[c] >= 0)
+        {
+            case_latencies[num_timed++] = case_latencies[c];
+        }
+    }
+    qsort(case_latencies, num_timed, sizeof(double), compare_doubles);
+    printf("%d cases on %d threads in %.3f s: %.1f cases/s\n", num_cases,
+           num_workers, elapsed, num_cases / elapsed);
+    if (num_timed > 0)
+    {
+        printf("Computation latency of %d cases: p50 %.1f us, p99 %.1f us\n",
+               num_timed, percentile(case_latencies, num_timed, 0.50) * 1e6,
+               percentile(case_latencies, num_timed, 0.99) * 1e6);
+    }
+    if (num_timed < num_cases)
+    {
+        printf("%d failed or never computed cases are not in the latencies\n",
+               num_cases - num_timed);
+    }
+    if (num_failures > 0)
+    {
+        printf("%d failed cases!\n", num_failures);
+    }
+
+    for (int w = 0; w < num_workers; w++)
+    {
+        pthread_mutex_destroy(&workers[w].queue.lock);
+        free(workers[w].queue.cases);
+    }
+    for (int c = 0; c < num_cases; c++)
+    {
+        free(case_paths[c]);
+    }
+    free(case_paths);
+    free(case_latencies);
+    free(workers);
+    return num_failures > 0 ? -1 : 0;
+}
@@ -1,7 +1,19 @@
+#ifdef M_INSTRUMENT
+#include "ir_tests_instrumented.h"
+#else
 #include "ir_tests.h"
+#endif
 #include <dirent.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+
+#define NUM_RUNS 1000
+
+static double elapsed_seconds(struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
 
 int main(int argc, char *argv[])
 {
@@ -22,6 +34,7 @@ int main(int argc, char *argv[])
     int num_outputs = m_num_inputs();
     m_value *outputs_array_for_m = malloc(num_outputs * sizeof(m_value));
     m_output *output_for_m = malloc(sizeof(m_output));
+    m_ctx *ctx = m_ctx_new();
 
     char *name;
     char *value_s;
@@ -29,6 +42,7 @@ int main(int argc, char *argv[])
     double expected_value;
     int name_index;
     m_value computed_value;
+    struct timespec start, end;
 
     FILE *fp = fopen(test_file, "r");
     if (fp == NULL)
@@ -71,10 +85,29 @@ int main(int argc, char *argv[])
                 // Here we move to controlling the outputs, so we
                 // have to run the computation!
                 m_input_from_array(input_for_m, input_array_for_m);
-                for (int i = 0; i < 1000; i++)
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (int i = 0; i < NUM_RUNS; i++)
+                {
+                    m_extracted_ctx(ctx, output_for_m, input_for_m);
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+#ifdef M_VALUE_INLINE
+                printf("Runtime: m_value_inline.h\n");
+#else
+                printf("Runtime: m_value.c\n");
+#endif
+                printf("%d runs in %.3f s (%.1f us per run)\n", NUM_RUNS,
+                       elapsed_seconds(&start, &end),
+                       elapsed_seconds(&start, &end) * 1e6 / NUM_RUNS);
+#ifdef M_INSTRUMENT
+                m_ctx_prof_report(ctx, stdout);
+                FILE *folded = fopen("profile.folded", "w");
+                if (folded != NULL)
                 {
-                    m_extracted(output_for_m, input_for_m);
+                    m_ctx_prof_folded(ctx, folded);
+                    fclose(folded);
                 }
+#endif
                 m_output_to_array(outputs_array_for_m, output_for_m);
                 break;
             }
@@ -124,5 +157,6 @@ int main(int argc, char *argv[])
     free(outputs_array_for_m);
     free(input_for_m);
     free(output_for_m);
+    m_ctx_free(ctx);
     return 0;
 }
\ No newline at end of file
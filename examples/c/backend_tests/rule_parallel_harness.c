@@ -0,0 +1,148 @@
+// Compares the latency of one computation on a single thread (m_extracted_ctx)
+// and on a pool of threads running the independent rules at the same time
+// (m_extracted_par, generated with --parallel_rules), and checks that both give
+// the same outputs, bit for bit.
+//
+// Usage: rule_parallel_harness.exe [-j <threads>] [-n <runs>] <test file>
+// The pool has all the cores by default.
+
+// The build of the code generated without optimizations includes its own
+// header
+#ifndef M_PAR_HEADER
+#define M_PAR_HEADER "ir_tests_par.h"
+#endif
+#include M_PAR_HEADER
+#include "harness_utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS 1000
+
+// Runs the computation runs times, stores the latency of each run and the
+// outputs of the last one
+static int run(int (*compute)(void *, m_ctx *, m_output *, const m_input *),
+               void *arg, m_ctx *ctx, const m_input *input, m_value *outputs,
+               double *latencies, int runs)
+{
+    m_output *output_for_m = malloc(sizeof(m_output));
+    int res = 0;
+    for (int r = 0; r < runs; r++)
+    {
+        m_ctx_reset(ctx);
+        double start = now_seconds();
+        res = compute(arg, ctx, output_for_m, input);
+        latencies[r] = now_seconds() - start;
+    }
+    m_output_to_array(outputs, output_for_m);
+    free(output_for_m);
+    return res;
+}
+
+static int compute_sequential(void *arg, m_ctx *ctx, m_output *output,
+                              const m_input *input)
+{
+    (void)arg;
+    return m_extracted_ctx(ctx, output, input);
+}
+
+static int compute_parallel(void *arg, m_ctx *ctx, m_output *output,
+                            const m_input *input)
+{
+    return m_extracted_par(arg, ctx, output, input);
+}
+
+static void print_latencies(const char *kind, double *latencies, int runs)
+{
+    qsort(latencies, runs, sizeof(double), compare_doubles);
+    printf("%s: p50 %.1f us, p99 %.1f us\n", kind,
+           percentile(latencies, runs, 0.50) * 1e6,
+           percentile(latencies, runs, 0.99) * 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int runs = DEFAULT_RUNS;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:n:")) != -1)
+    {
+        if (opt == 'j')
+        {
+            num_threads = atoi(optarg);
+        }
+        else if (opt == 'n')
+        {
+            runs = atoi(optarg);
+        }
+        else
+        {
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1 || num_threads < 1 || runs < 1)
+    {
+        printf("Usage: %s [-j <threads>] [-n <runs>] <test file>\n", argv[0]);
+        return -1;
+    }
+
+    int num_outputs = m_num_outputs();
+    m_value *input_array_for_m = malloc(m_num_inputs() * sizeof(m_value));
+    m_input *input_for_m = malloc(sizeof(m_input));
+    m_value *sequential_outputs = malloc(num_outputs * sizeof(m_value));
+    m_value *parallel_outputs = malloc(num_outputs * sizeof(m_value));
+    double *latencies = malloc(runs * sizeof(double));
+    m_ctx *ctx = m_ctx_new();
+    m_pool *pool = m_pool_new(num_threads);
+    if (ctx == NULL || pool == NULL)
+    {
+        printf("Could not allocate the context or the pool!\n");
+        return -1;
+    }
+    if (!read_inputs(argv[optind], input_array_for_m, m_num_inputs(),
+                     m_get_input_index))
+    {
+        printf("Test file %s not found!\n", argv[optind]);
+        return -1;
+    }
+    m_input_from_array(input_for_m, input_array_for_m);
+
+    int sequential_res = run(compute_sequential, NULL, ctx, input_for_m,
+                             sequential_outputs, latencies, runs);
+    print_latencies("1 thread", latencies, runs);
+    int parallel_res = run(compute_parallel, pool, ctx, input_for_m,
+                           parallel_outputs, latencies, runs);
+    char kind[64];
+    snprintf(kind, sizeof kind, "%d threads", num_threads);
+    print_latencies(kind, latencies, runs);
+
+    int res = 0;
+    if (sequential_res != parallel_res)
+    {
+        printf("The sequential computation returned %d, the parallel one %d!\n",
+               sequential_res, parallel_res);
+        res = -1;
+    }
+    for (int i = 0; i < num_outputs; i++)
+    {
+        m_value s = sequential_outputs[i];
+        m_value p = parallel_outputs[i];
+        if (s.undefined != p.undefined ||
+            (!s.undefined && memcmp(&s.value, &p.value, sizeof(double)) != 0))
+        {
+            printf("Output %s: %.17g sequentially, %.17g in parallel!\n",
+                   m_get_output_name_from_index(i), s.value, p.value);
+            res = -1;
+        }
+    }
+
+    m_pool_free(pool);
+    m_ctx_free(ctx);
+    free(input_array_for_m);
+    free(input_for_m);
+    free(sequential_outputs);
+    free(parallel_outputs);
+    free(latencies);
+    return res;
+}
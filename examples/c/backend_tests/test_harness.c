@@ -23,6 +23,8 @@ int main(int argc, char *argv[])
     int num_outputs = m_num_inputs();
     m_value *outputs_array_for_m = malloc(num_outputs * sizeof(m_value));
     m_output *output_for_m = malloc(sizeof(m_input));
+    // The same context is reused for every test file
+    m_ctx *ctx = m_ctx_new();
 
     char *name;
     char *value_s;
@@ -86,7 +88,8 @@ int main(int argc, char *argv[])
                         // Here we move to controlling the outputs, so we
                         // have to run the computation!
                         m_input_from_array(input_for_m, input_array_for_m);
-                        m_extracted(output_for_m, input_for_m);
+                        m_ctx_reset(ctx);
+                        m_extracted_ctx(ctx, output_for_m, input_for_m);
                         m_output_to_array(outputs_array_for_m, output_for_m);
                         break;
                     }
@@ -139,5 +142,6 @@ int main(int argc, char *argv[])
     free(input_array_for_m);
     free(outputs_array_for_m);
     free(output_for_m);
+    m_ctx_free(ctx);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# usage: to_columns.py OUTPUT SOURCE...
+#
+# Writes the primitive inputs of many households into the columnar file read
+# by m_columns.c (see m_columns.h for its layout). Each SOURCE is a test
+# directory, a test file or a CSV file whose first line holds the names of the
+# variables and every other line a household; an empty cell is an undefined
+# value. The households are stored in the order of the sources, the files of a
+# directory being sorted by name.
+
+import array
+import csv
+import os
+import struct
+import sys
+
+MAGIC = b"MCOLS01\0"
+
+
+def parse_test(f):
+    with open(f, 'r') as fi:
+        contents = fi.readlines()
+    i = 0
+    entrees = {}
+    while(contents[i] != "#ENTREES-PRIMITIF\n"):
+        i += 1
+    i += 1
+    while(contents[i] != "#CONTROLES-PRIMITIF\n"):
+        s = contents[i].split('/')
+        entrees[s[0]] = float(s[1].strip())
+        i += 1
+    return entrees
+
+
+def parse_csv(f):
+    with open(f, 'r', newline='') as fi:
+        reader = csv.reader(fi)
+        names = [name.strip() for name in next(reader)]
+        for row in reader:
+            if not row:
+                continue
+            yield {name: float(value) for (name, value) in zip(names, row)
+                   if value.strip() != ""}
+
+
+def read_cases(sources):
+    for source in sources:
+        if os.path.isdir(source):
+            for x in sorted(os.listdir(source)):
+                yield parse_test(f"{source}/{x}")
+        elif source.endswith(".csv"):
+            yield from parse_csv(source)
+        else:
+            yield parse_test(source)
+
+
+def pad(b):
+    return b + b"\0" * (-len(b) % 8)
+
+
+def write_columns(output, cases):
+    names = sorted({name for case in cases for name in case})
+    num_cases = len(cases)
+    names_section = pad(b"".join(name.encode() + b"\0" for name in names))
+    with open(output, 'wb') as fo:
+        fo.write(MAGIC)
+        fo.write(struct.pack("<QQQ", num_cases, len(names),
+                             len(names_section)))
+        fo.write(names_section)
+        for name in names:
+            values = array.array('d', (case.get(name, 0.0) for case in cases))
+            if sys.byteorder != "little":
+                values.byteswap()
+            fo.write(values.tobytes())
+        for name in names:
+            fo.write(bytes(1 if name in case else 0 for case in cases))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print(f"usage: {sys.argv[0]} OUTPUT SOURCE...")
+        sys.exit(1)
+    cases = list(read_cases(sys.argv[2:]))
+    write_columns(sys.argv[1], cases)
+    print(f"{len(cases)} households written to {sys.argv[1]}")
@@ -0,0 +1,160 @@
+// Checks m_update against full computations on every test of a directory.
+// Each test is computed in full, then one of its inputs is changed and the
+// computation is updated with m_update, twice: first to another value, then
+// to undefined. After each update, the error flag and the outputs, definedness
+// included, must be bit for bit the ones of a full computation of the changed
+// inputs in a fresh context.
+//
+// Usage: update_harness.exe <tests directory>
+
+#include "ir_tests.h"
+#include "harness_utils.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PATH_SIZE 1024
+
+// Returns the number of differences between the two outputs, and prints them
+static int compare_outputs(char *test_file, int changed, m_output *updated,
+                           m_output *full, m_value *updated_array,
+                           m_value *full_array)
+{
+    char *input_name = m_get_input_name_from_index(changed);
+    if (updated->is_error != full->is_error)
+    {
+        printf("%s, %s changed: error %d after m_update, %d in full\n",
+               test_file, input_name, updated->is_error, full->is_error);
+        return 1;
+    }
+    if (updated->is_error)
+    {
+        return 0;
+    }
+    m_output_to_array(updated_array, updated);
+    m_output_to_array(full_array, full);
+    int differences = 0;
+    for (int i = 0; i < m_num_outputs(); i++)
+    {
+        m_value u = updated_array[i];
+        m_value f = full_array[i];
+        // The value of an undefined variable is not meaningful
+        if (u.undefined != f.undefined ||
+            (!u.undefined && memcmp(&u.value, &f.value, sizeof(double)) != 0))
+        {
+            printf("%s, %s changed: %s is %s%.17g after m_update, %s%.17g in "
+                   "full\n",
+                   test_file, input_name, m_get_output_name_from_index(i),
+                   u.undefined ? "undefined " : "", u.value,
+                   f.undefined ? "undefined " : "", f.value);
+            differences++;
+        }
+    }
+    return differences;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <tests directory>\n", argv[0]);
+        return -1;
+    }
+
+    struct dirent **entries;
+    int num_entries = scandir(argv[1], &entries, NULL, alphasort);
+    if (num_entries < 0)
+    {
+        printf("Could not read the tests directory %s!\n", argv[1]);
+        return -1;
+    }
+
+    int num_inputs = m_num_inputs();
+    m_value *input_array = malloc(num_inputs * sizeof(m_value));
+    m_value *updated_array = malloc(m_num_outputs() * sizeof(m_value));
+    m_value *full_array = malloc(m_num_outputs() * sizeof(m_value));
+    m_input input;
+    m_output updated;
+    m_output full;
+    // ctx follows the updates, fresh_ctx is reset before each full computation
+    m_ctx *ctx = m_ctx_new();
+    m_ctx *fresh_ctx = m_ctx_new();
+    if (ctx == NULL || fresh_ctx == NULL)
+    {
+        printf("Could not allocate the contexts!\n");
+        return -1;
+    }
+    char file_path[PATH_SIZE];
+    int num_cases = 0;
+    int num_updates = 0;
+    int num_failures = 0;
+    for (int i = 0; i < num_entries; i++)
+    {
+        char *test_file = entries[i]->d_name;
+        if (strcmp(test_file, ".") == 0 || strcmp(test_file, "..") == 0)
+        {
+            continue;
+        }
+        snprintf(file_path, sizeof file_path, "%s/%s", argv[1], test_file);
+        if (!read_inputs(file_path, input_array, num_inputs, m_get_input_index))
+        {
+            continue;
+        }
+        // The input changed is one of the defined inputs of the test, a
+        // different one from a test to the next
+        int num_defined = 0;
+        for (int j = 0; j < num_inputs; j++)
+        {
+            num_defined += !input_array[j].undefined;
+        }
+        if (num_defined == 0)
+        {
+            continue;
+        }
+        int changed = -1;
+        for (int j = 0, k = num_cases % num_defined; changed < 0; j++)
+        {
+            if (!input_array[j].undefined && k-- == 0)
+            {
+                changed = j;
+            }
+        }
+        num_cases++;
+
+        m_ctx_reset(ctx);
+        m_input_from_array(&input, input_array);
+        m_extracted_ctx(ctx, &updated, &input);
+
+        m_value new_values[2] = {
+            m_literal(input_array[changed].value * 2 + 1), m_undefined};
+        for (int step = 0; step < 2; step++)
+        {
+            input_array[changed] = new_values[step];
+            m_input_from_array(&input, input_array);
+            m_update(ctx, &updated, &input, &changed, 1);
+            m_ctx_reset(fresh_ctx);
+            m_extracted_ctx(fresh_ctx, &full, &input);
+            num_updates++;
+            if (compare_outputs(test_file, changed, &updated, &full,
+                                updated_array, full_array) > 0)
+            {
+                num_failures++;
+            }
+        }
+    }
+
+    printf("%d updates of %d tests, %d different from a full computation\n",
+           num_updates, num_cases, num_failures);
+    m_ctx_free(ctx);
+    m_ctx_free(fresh_ctx);
+    for (int i = 0; i < num_entries; i++)
+    {
+        free(entries[i]);
+    }
+    free(entries);
+    free(input_array);
+    free(updated_array);
+    free(full_array);
+    return num_failures > 0 ? -1 : 0;
+}
@@ -0,0 +1,170 @@
+#include "m_columns.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define M_COLUMNS_MAGIC "MCOLS01"
+#define M_COLUMNS_HEADER_SIZE 32
+
+struct m_columns
+{
+    void *map;
+    size_t map_size;
+    int num_cases;
+    int num_columns;
+    const char **names;
+    const double *values;
+    const uint8_t *defined;
+    // Input index of each column, -1 for the ignored ones
+    int *inputs;
+};
+
+static uint64_t read_u64(const unsigned char *p)
+{
+    uint64_t res = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        res = (res << 8) | p[i];
+    }
+    return res;
+}
+
+m_columns *m_columns_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < M_COLUMNS_HEADER_SIZE)
+    {
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        return NULL;
+    }
+    const unsigned char *bytes = map;
+    uint64_t num_cases = read_u64(bytes + 8);
+    uint64_t num_columns = read_u64(bytes + 16);
+    uint64_t names_size = read_u64(bytes + 24);
+    // Checked one term at a time so that a corrupted header cannot overflow
+    size_t available = size - M_COLUMNS_HEADER_SIZE;
+    if (memcmp(bytes, M_COLUMNS_MAGIC, 8) != 0 || num_cases > INT32_MAX ||
+        num_columns > INT32_MAX || names_size % 8 != 0 ||
+        names_size > available ||
+        (num_cases > 0 && num_columns > (available - names_size) /
+                                            (num_cases * (sizeof(double) + 1))))
+    {
+        munmap(map, size);
+        return NULL;
+    }
+
+    m_columns *cols = calloc(1, sizeof(m_columns));
+    if (cols == NULL)
+    {
+        munmap(map, size);
+        return NULL;
+    }
+    cols->map = map;
+    cols->map_size = size;
+    cols->num_cases = num_cases;
+    cols->num_columns = num_columns;
+    cols->names = malloc((num_columns + 1) * sizeof(char *));
+    cols->inputs = malloc((num_columns + 1) * sizeof(int));
+    if (cols->names == NULL || cols->inputs == NULL)
+    {
+        m_columns_close(cols);
+        return NULL;
+    }
+    const char *names = (const char *)bytes + M_COLUMNS_HEADER_SIZE;
+    const char *names_end = names + names_size;
+    for (int j = 0; j < cols->num_columns; j++)
+    {
+        const char *end = memchr(names, '\0', names_end - names);
+        if (end == NULL)
+        {
+            m_columns_close(cols);
+            return NULL;
+        }
+        cols->names[j] = names;
+        cols->inputs[j] = -1;
+        names = end + 1;
+    }
+    cols->values = (const double *)names_end;
+    cols->defined = (const uint8_t *)(cols->values + num_cases * num_columns);
+    return cols;
+}
+
+void m_columns_close(m_columns *cols)
+{
+    if (cols == NULL)
+    {
+        return;
+    }
+    munmap(cols->map, cols->map_size);
+    free(cols->names);
+    free(cols->inputs);
+    free(cols);
+}
+
+int m_columns_num_cases(const m_columns *cols)
+{
+    return cols->num_cases;
+}
+
+int m_columns_num_columns(const m_columns *cols)
+{
+    return cols->num_columns;
+}
+
+const char *m_columns_name(const m_columns *cols, int column)
+{
+    return cols->names[column];
+}
+
+int m_columns_bind(m_columns *cols, int (*index_of)(char *))
+{
+    int num_ignored = 0;
+    for (int j = 0; j < cols->num_columns; j++)
+    {
+        cols->inputs[j] = index_of((char *)cols->names[j]);
+        if (cols->inputs[j] < 0)
+        {
+            num_ignored++;
+        }
+    }
+    return num_ignored;
+}
+
+void m_columns_load_case(const m_columns *cols, int case_index,
+                         m_value *input_array)
+{
+    size_t n = cols->num_cases;
+    const double *values = cols->values + case_index;
+    const uint8_t *defined = cols->defined + case_index;
+    for (int j = 0; j < cols->num_columns; j++)
+    {
+        int input = cols->inputs[j];
+        if (input < 0)
+        {
+            continue;
+        }
+        if (defined[j * n])
+        {
+            input_array[input] = m_literal(values[j * n]);
+        }
+        else
+        {
+            input_array[input] = m_undefined;
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef M_COLUMNS_
+#define M_COLUMNS_
+
+// Reader of the columnar files of inputs written by
+// backend_tests/to_columns.py, holding the primitive inputs of many households.
+// The file is mapped in memory and read in place: loading the inputs of a
+// household copies one value per column into an m_value array, with no
+// parsing nor name lookup.
+//
+// Layout of a file, in little endian, every section starting on 8 bytes:
+//   char magic[8]             "MCOLS01" followed by a NUL byte
+//   uint64_t num_cases
+//   uint64_t num_columns
+//   uint64_t names_size       size of the names section, padding included
+//   char names[names_size]    one NUL-terminated variable name per column
+//   double values[num_columns][num_cases]
+//   uint8_t defined[num_columns][num_cases]
+
+#include "m_value.h"
+#include <stdint.h>
+
+typedef struct m_columns m_columns;
+
+// Maps the file, returns NULL if it cannot be read or is not a columnar file
+m_columns *m_columns_open(const char *path);
+
+void m_columns_close(m_columns *cols);
+
+int m_columns_num_cases(const m_columns *cols);
+
+int m_columns_num_columns(const m_columns *cols);
+
+const char *m_columns_name(const m_columns *cols, int column);
+
+// Finds the index of the input of each column once, with index_of (for
+// instance m_get_input_index). Returns the number of columns whose variable
+// is not an input, which are then ignored.
+int m_columns_bind(m_columns *cols, int (*index_of)(char *));
+
+// Writes the inputs of a household into an array indexed like the inputs of
+// the generated code, ready for m_input_from_array. The inputs without a
+// column are left untouched, so the array has to start as all undefined.
+void m_columns_load_case(const m_columns *cols, int case_index,
+                         m_value *input_array);
+
+#endif /* M_COLUMNS_ */
@@ -0,0 +1,193 @@
+#ifndef M_VALUE_
+#define M_VALUE_
+
+// Header-only variant of m_value.h and m_value.c: every operator is static
+// inline so that the C compiler can optimize across whole rules, and the
+// definedness flags are combined with bitwise operations instead of branches.
+// Select it by compiling the generated C files with -DM_VALUE_INLINE.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct m_value
+{
+    double value;
+    bool undefined;
+} m_value;
+// type invariant : if undefined, then value == 0
+
+static const struct m_value m_undefined = {.value = 0, .undefined = true};
+static const struct m_value m_zero = {.value = 0, .undefined = false};
+static const struct m_value m_one = {.value = 1, .undefined = false};
+
+static inline m_value m_mk(double value, bool undefined)
+{
+    return (struct m_value){.value = value, .undefined = undefined};
+}
+
+static inline m_value m_add(m_value x, m_value y)
+{
+    return m_mk(x.value + y.value, x.undefined & y.undefined);
+}
+
+static inline m_value m_sub(m_value x, m_value y)
+{
+    return m_mk(x.value - y.value, x.undefined & y.undefined);
+}
+
+static inline m_value m_neg(m_value x)
+{
+    return m_mk(x.undefined ? 0 : -x.value, x.undefined);
+}
+
+static inline m_value m_mul(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(undefined ? 0 : x.value * y.value, undefined);
+}
+
+static inline m_value m_div(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk((undefined | (y.value == 0)) ? 0 : x.value / y.value,
+                undefined);
+}
+
+static inline m_value m_lt(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value < y.value), undefined);
+}
+
+static inline m_value m_lte(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value <= y.value), undefined);
+}
+
+static inline m_value m_gt(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value > y.value), undefined);
+}
+
+static inline m_value m_gte(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value >= y.value), undefined);
+}
+
+static inline m_value m_eq(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value == y.value), undefined);
+}
+
+static inline m_value m_neq(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value != y.value), undefined);
+}
+
+static inline m_value m_and(m_value x, m_value y)
+{
+    bool undefined = x.undefined | y.undefined;
+    return m_mk(!undefined & (x.value != 0) & (y.value != 0), undefined);
+}
+
+static inline m_value m_or(m_value x, m_value y)
+{
+    return m_mk((x.value != 0) | (y.value != 0), x.undefined & y.undefined);
+}
+
+static inline m_value m_not(m_value x)
+{
+    return m_mk(!x.undefined & (x.value == 0), x.undefined);
+}
+
+static inline m_value m_cond(m_value c, m_value t, m_value f)
+{
+    bool is_true = c.value != 0;
+    bool undefined = c.undefined | (is_true ? t.undefined : f.undefined);
+    return m_mk(c.undefined ? 0 : (is_true ? t.value : f.value), undefined);
+}
+
+static inline m_value m_max(m_value x, m_value y)
+{
+    return m_mk(fmax(x.value, y.value), false);
+}
+
+static inline m_value m_min(m_value x, m_value y)
+{
+    return m_mk(fmin(x.value, y.value), false);
+}
+
+static inline m_value m_present(m_value x)
+{
+    return m_mk(!x.undefined, false);
+}
+
+static inline m_value m_null(m_value x)
+{
+    return m_mk(!x.undefined & (x.value == 0), x.undefined);
+}
+
+static inline m_value m_round(m_value x)
+{
+    double tmp = x.value + (x.value < 0 ? -0.50005 : 0.50005);
+    return m_mk(x.undefined ? 0 : (double)(int64_t)tmp, x.undefined);
+}
+
+static inline m_value m_floor(m_value x)
+{
+    return m_mk(x.undefined ? 0 : floor(x.value + 0.000001), x.undefined);
+}
+
+static inline bool m_is_defined_true(m_value x)
+{
+    return !x.undefined & (x.value != 0);
+}
+
+static inline bool m_is_defined_false(m_value x)
+{
+    return !x.undefined & (x.value == 0);
+}
+
+static inline m_value m_literal(double v)
+{
+    return m_mk(v, false);
+}
+
+static inline m_value m_array_index(m_value *array, m_value index,
+                                    int array_size)
+{
+    // Out of range indexes read the first cell, whose value is discarded
+    bool negative = index.value < 0;
+    bool in_range =
+        !index.undefined & !negative & (index.value < array_size - 1);
+    m_value cell = array[in_range ? (int)index.value : 0];
+    bool undefined = index.undefined | (!negative & !in_range) |
+                     (in_range & cell.undefined);
+    return m_mk(in_range ? cell.value : 0, undefined);
+}
+
+static inline m_value m_multimax(m_value bound, m_value *array)
+{
+    if (bound.undefined)
+    {
+        printf("Multimax bound undefined!");
+        exit(-1);
+    }
+    int max_index = floor(bound.value);
+    double max = array[0].value;
+    for (int i = 0; i <= max_index; i++)
+    {
+        max = array[i].value > max ? array[i].value : max;
+    }
+    return m_mk(max, false);
+}
+
+#endif /* M_VALUE_ */
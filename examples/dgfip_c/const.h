@@ -6,6 +6,20 @@
 
 #include "conf.h"
 
+/* Pool of T_discord cells, allocated by blocks that are kept between
+   households: resetting the pool is O(1) and, once the largest number of
+   errors has been reached, no more allocation happens */
+struct S_pool_discord
+{
+  struct S_bloc_discord *blocs;
+  struct S_bloc_discord *courant;
+  int nb_utilises;      /* cells used in the current block */
+  long nb_allocations;  /* blocks allocated since the creation of the pool */
+  long nb_discords;     /* cells handed out since the creation of the pool */
+  long nb_echecs;       /* allocations that failed since the creation of the
+                           pool */
+};
+
 #ifdef FLG_COMPACT
 
 struct S_irdata
@@ -33,7 +47,7 @@ struct S_irdata
   char *def_base;
 #ifdef FLG_MULTITHREAD
   T_discord *discords;
-  T_discord *tas_discord;
+  T_pool_discord pool_discord;
   T_discord **p_discord;
   int nb_bloquantes;
   int max_bloquantes;
@@ -74,6 +88,19 @@ struct S_discord
 {
   struct S_discord *suivant;
   T_erreur *erreur;
+#ifdef FLG_MULTITHREAD
+  /* code of the variable raising the error, since the shared erreur can't be
+     modified */
+  const char *code;
+#endif /* FLG_MULTITHREAD */
+};
+
+#define TAILLE_BLOC_DISCORD 64
+
+struct S_bloc_discord
+{
+  struct S_bloc_discord *suivant;
+  T_discord discords[TAILLE_BLOC_DISCORD];
 };
 
 #ifdef FLG_MULTITHREAD
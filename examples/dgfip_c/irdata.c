@@ -1,6 +1,7 @@
 
 #include "conf.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
@@ -53,7 +54,7 @@ T_irdata * IRDATA_new_irdata(void)
   }
 #ifdef FLG_MULTITHREAD
   irdata->discords = NULL;
-  irdata->tas_discord = NULL;
+  memset(&irdata->pool_discord, 0, sizeof(T_pool_discord));
   irdata->p_discord = &irdata->discords;
   irdata->nb_bloquantes = 0;
   irdata->max_bloquantes = 0;
@@ -75,12 +76,7 @@ void IRDATA_delete_irdata(T_irdata *irdata)
     if (irdata->def_base != NULL) free(irdata->def_base);
 #endif /* FLG_COMPACT */
 #ifdef FLG_MULTITHREAD
-    IRDATA_reset_erreur(irdata);
-    while (irdata->tas_discord != NULL) {
-      *(irdata->p_discord) = irdata->tas_discord;
-      irdata->tas_discord = (irdata->tas_discord)->suivant;
-      free(*irdata->p_discord);
-    }
+    IRDATA_free_pool_discord(&irdata->pool_discord);
 #endif /* FLG_MULTITHREAD */
     free(irdata);
   }
@@ -109,14 +105,85 @@ void IRDATA_reset_irdata(T_irdata *irdata)
 void IRDATA_reset_erreur(T_irdata *irdata)
 {
 #ifdef FLG_MULTITHREAD
-  *irdata->p_discord = irdata->tas_discord;
-  irdata->tas_discord = irdata->discords;
+  IRDATA_reset_pool_discord(&irdata->pool_discord);
   irdata->discords = 0;
   irdata->p_discord = &irdata->discords;
   irdata->nb_bloquantes = 0;
 #endif /* FLG_MULTITHREAD */
 }
 
+#ifndef FLG_MULTITHREAD
+static T_pool_discord pool_discord;
+#endif /* !FLG_MULTITHREAD */
+
+T_pool_discord * IRDATA_pool_discord(T_irdata *irdata)
+{
+#ifdef FLG_MULTITHREAD
+  return &irdata->pool_discord;
+#else
+  return &pool_discord;
+#endif /* FLG_MULTITHREAD */
+}
+
+T_discord * IRDATA_alloc_discord(T_pool_discord *pool)
+{
+  if ((pool->courant == NULL) || (pool->nb_utilises == TAILLE_BLOC_DISCORD)) {
+    struct S_bloc_discord *bloc =
+      (pool->courant == NULL) ? pool->blocs : pool->courant->suivant;
+    if (bloc == NULL) {
+      bloc = (struct S_bloc_discord *)malloc(sizeof(struct S_bloc_discord));
+      if (bloc == NULL) {
+        pool->nb_echecs++;
+        return NULL;
+      }
+      bloc->suivant = NULL;
+      if (pool->courant == NULL) {
+        pool->blocs = bloc;
+      } else {
+        pool->courant->suivant = bloc;
+      }
+      pool->nb_allocations++;
+    }
+    pool->courant = bloc;
+    pool->nb_utilises = 0;
+  }
+  pool->nb_discords++;
+  return &pool->courant->discords[pool->nb_utilises++];
+}
+
+/* The cells handed out before are reused by the next allocations */
+void IRDATA_reset_pool_discord(T_pool_discord *pool)
+{
+  pool->courant = NULL;
+  pool->nb_utilises = 0;
+}
+
+void IRDATA_free_pool_discord(T_pool_discord *pool)
+{
+  while (pool->blocs != NULL) {
+    struct S_bloc_discord *bloc = pool->blocs;
+    pool->blocs = bloc->suivant;
+    free(bloc);
+  }
+  pool->courant = NULL;
+  pool->nb_utilises = 0;
+}
+
+/* Writes at most taille characters of the message of the error, followed by
+   the code of the variable raising it as " ((code))", in both modes: without
+   -M add_erreur has already appended the code to the message, with -M it is
+   kept in the T_discord. Returns the length of the full text, as snprintf. */
+int IRDATA_message_discord(T_discord *discord, char *message, size_t taille)
+{
+#ifdef FLG_MULTITHREAD
+  if (discord->code != NULL) {
+    return snprintf(message, taille, "%s ((%s))", discord->erreur->message,
+                    discord->code);
+  }
+#endif /* FLG_MULTITHREAD */
+  return snprintf(message, taille, "%s", discord->erreur->message);
+}
+
 T_discord * IRDATA_range(T_irdata *irdata, T_desc_var *desc, double valeur)
 {
   T_discord *discord = NULL;
@@ -251,37 +318,7 @@ double * IRDATA_extrait_tableau(T_irdata *irdata, T_desc_var *desc, int ind)
   return res;
 }
 
-static T_desc_var * cherche_desc_var(const char *nom, T_desc_var *table, int taille, int sup)
-{
-  T_desc_var *desc = NULL;
-  int res = -1, inf = 0, millieu;
-  while ((res != 0) && (inf < sup)) {
-    millieu = (inf + sup) / 2;
-    desc = (T_desc_var *)((void *)table + (taille * millieu));
-    res = strcmp(nom, desc->nom);
-    if (res < 0) sup = millieu;
-    else if (res > 0) inf = millieu + 1;
-  }
-  if (res == 0)
-    return desc;
-  else
-    return NULL;
-}
-
 T_desc_var * IRDATA_cherche_desc_var(const char *nom)
 {
-  static T_desc_var * desc[6] = {
-    (T_desc_var *)desc_contexte, (T_desc_var *)desc_famille, (T_desc_var *)desc_revenu,
-    (T_desc_var *)desc_revenu_correc, (T_desc_var *)desc_variation, (T_desc_var *)desc_restituee };
-  static const int size[6] = {
-    sizeof(T_desc_contexte), sizeof(T_desc_famille), sizeof(T_desc_revenu),
-    sizeof(T_desc_revenu_correc), sizeof(T_desc_variation), sizeof(T_desc_restituee) };
-  static const int nb[6] = {
-    NB_CONTEXTE, NB_FAMILLE, NB_REVENU,
-    NB_REVENU_CORREC, NB_VARIATION, NB_RESTITUEE };
-  for (int i = 0; i < 6; ++i) {
-    T_desc_var *res = cherche_desc_var(nom, desc[i], size[i], nb[i]);
-    if (res != NULL) return res;
-  }
-  return NULL;
+  return cherche_desc_var_hash(nom);
 }
@@ -2,6 +2,8 @@
 #ifndef _IRDATA_H_
 #define _IRDATA_H_
 
+#include <stddef.h>
+
 #include "conf.h"
 
 #define _PROTS(X) X
@@ -30,6 +32,7 @@ typedef struct S_desc_var T_desc_var;
 typedef struct S_irdata T_irdata;
 typedef struct S_discord T_discord;
 typedef struct S_erreur T_erreur;
+typedef struct S_pool_discord T_pool_discord;
 
 extern T_irdata * IRDATA_new_irdata(void);
 extern void IRDATA_delete_irdata(T_irdata *irdata);
@@ -37,6 +40,12 @@ extern void IRDATA_reset_irdata(T_irdata *irdata);
 
 extern void IRDATA_reset_erreur(T_irdata *irdata);
 
+extern T_pool_discord * IRDATA_pool_discord(T_irdata *irdata);
+extern T_discord * IRDATA_alloc_discord(T_pool_discord *pool);
+extern void IRDATA_reset_pool_discord(T_pool_discord *pool);
+extern void IRDATA_free_pool_discord(T_pool_discord *pool);
+extern int IRDATA_message_discord(T_discord *discord, char *message, size_t taille);
+
 extern T_discord * IRDATA_range(T_irdata *irdata, T_desc_var *desc, double valeur);
 extern void IRDATA_range_base(T_irdata *irdata, T_desc_var *desc, double valeur);
 struct S_discord *IRDATA_range_tableau(T_irdata *irdata, T_desc_var *desc, int ind, double valeur);
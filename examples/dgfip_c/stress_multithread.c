@@ -0,0 +1,106 @@
+// Runs the same computations as run_all_ins_selected_outs_2018.c on 1 to N
+// threads, each thread owning its T_irdata. The code has to be generated with
+// the -M DGFiP option. With N threads doing N times the work of one thread,
+// the time should stay flat if the computation scales linearly.
+//
+// Usage: stress_multithread.exe [max threads]
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ir_all_ins_selected_outs_2018.h"
+
+#include "irdata.h"
+#include "desc.h"
+
+#ifndef FLG_MULTITHREAD
+#error "the stress test needs code generated with the -M DGFiP option"
+#endif
+
+#define NB_CALCULS 1000
+
+static double now_seconds(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void *worker(void *arg)
+{
+    double *irnet = arg;
+    T_irdata *irdata = IRDATA_new_irdata();
+    if (irdata == NULL)
+    {
+        printf("Could not allocate irdata!\n");
+        exit(-1);
+    }
+    IRDATA_reset_irdata(irdata);
+    IRDATA_range(irdata, desc_0AM, 1.0);
+    IRDATA_range(irdata, desc_0CF, 1.0);
+    IRDATA_range(irdata, desc_1AX, 10000.0);
+    IRDATA_range(irdata, desc_4XD, 4000.0);
+    IRDATA_range(irdata, desc_1AO, 5000.0);
+    IRDATA_range(irdata, desc_1BS, 25000.0);
+    IRDATA_range(irdata, desc_4BE, 4000.0);
+    for (int i = 0; i < NB_CALCULS; i++)
+    {
+        IRDATA_range(irdata, desc_1AJ, (double)(39000 + i));
+        dgfip_calculation(irdata);
+    }
+    double *res = IRDATA_extrait_special(irdata, desc_IRNET);
+    *irnet = res == NULL ? 0.0 : *res;
+    IRDATA_delete_irdata(irdata);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1)
+    {
+        printf("Usage: %s [max threads]\n", argv[0]);
+        return -1;
+    }
+    pthread_t *threads = malloc(max_threads * sizeof(pthread_t));
+    double *irnets = malloc(max_threads * sizeof(double));
+    double reference = 0.0;
+    double time_one_thread = 0.0;
+
+    for (int n = 1; n <= max_threads; n++)
+    {
+        double start = now_seconds();
+        for (int t = 0; t < n; t++)
+        {
+            pthread_create(&threads[t], NULL, worker, &irnets[t]);
+        }
+        for (int t = 0; t < n; t++)
+        {
+            pthread_join(threads[t], NULL);
+        }
+        double elapsed = now_seconds() - start;
+        if (n == 1)
+        {
+            reference = irnets[0];
+            time_one_thread = elapsed;
+        }
+        for (int t = 0; t < n; t++)
+        {
+            if (irnets[t] != reference)
+            {
+                printf("Thread %d computed IRNET = %.2f instead of %.2f!\n",
+                       t, irnets[t], reference);
+                return -1;
+            }
+        }
+        printf("%2d threads: %d computations in %.3f s, speedup %.2f\n", n,
+               n * NB_CALCULS, elapsed, n * time_one_thread / elapsed);
+    }
+
+    free(threads);
+    free(irnets);
+    return 0;
+}
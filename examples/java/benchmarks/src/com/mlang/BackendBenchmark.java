@@ -0,0 +1,154 @@
+/* Copyright (C) 2021 Inria, contributor: James Barnes <bureau.si-part-ircalcul@dgfip.finances.gouv.fr>
+
+   This program is free software: you can redistribute it and/or modify it under the terms of the
+   GNU General Public License as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+   even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program. If
+   not, see <https://www.gnu.org/licenses/>. */
+
+package com.mlang;
+
+import java.io.IOException;
+import java.nio.file.DirectoryStream;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.ArrayList;
+import java.util.HashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.concurrent.TimeUnit;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Param;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.Warmup;
+import org.openjdk.jmh.infra.Blackhole;
+
+/**
+ * Compares the time taken to compute all the tests of a directory by the
+ * classes generated from tests_2020.m_spec with the java backend (MValue
+ * objects and maps) and with the java_primitive backend (primitive arrays).
+ * Before measuring, checks that both compute the same outputs.
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.MILLISECONDS)
+@Warmup(iterations = 5, time = 2)
+@Measurement(iterations = 5, time = 2)
+@Fork(value = 1, jvmArgsAppend = { "-Xss10m" })
+public class BackendBenchmark {
+
+  @Param({ "../../tests/2020/fuzzing" })
+  public String testsDir;
+
+  private final List<Map<String, MValue>> mapInputs = new ArrayList<>();
+  private final List<double[]> inputValues = new ArrayList<>();
+  private final List<boolean[]> inputDefined = new ArrayList<>();
+  private final double[] outputValues = new double[Ir_tests_2020_primitive.NUM_OUTPUTS];
+  private final boolean[] outputDefined = new boolean[Ir_tests_2020_primitive.NUM_OUTPUTS];
+  private MPrimitiveCalculation calc;
+
+  @Setup
+  public void setup() throws IOException {
+    calc = Ir_tests_2020_primitive.newCalculation(0);
+    try (DirectoryStream<Path> tests = Files.newDirectoryStream(Paths.get(testsDir))) {
+      for (Path test : tests) {
+        Map<String, MValue> inputs = parseInputs(test);
+        double[] values = new double[Ir_tests_2020_primitive.NUM_INPUTS];
+        boolean[] defined = new boolean[Ir_tests_2020_primitive.NUM_INPUTS];
+        for (Map.Entry<String, MValue> input : inputs.entrySet()) {
+          int index = Ir_tests_2020_primitive.getInputIndex(input.getKey());
+          if (index >= 0) {
+            values[index] = input.getValue().getValue();
+            defined[index] = true;
+          }
+        }
+        mapInputs.add(inputs);
+        inputValues.add(values);
+        inputDefined.add(defined);
+        checkSameOutputs(test, inputs, values, defined);
+      }
+    }
+  }
+
+  @Benchmark
+  public void mvalue(Blackhole bh) {
+    for (Map<String, MValue> inputs : mapInputs) {
+      try {
+        bh.consume(Ir_tests_2020.calculateTax(inputs));
+      } catch (MException e) {
+        bh.consume(e);
+      }
+    }
+  }
+
+  @Benchmark
+  public void primitive(Blackhole bh) {
+    for (int i = 0; i < inputValues.size(); i++) {
+      try {
+        bh.consume(Ir_tests_2020_primitive.calculateTax(calc, inputValues.get(i), inputDefined.get(i),
+            outputValues, outputDefined));
+      } catch (MException e) {
+        bh.consume(e);
+      }
+      bh.consume(outputValues);
+    }
+  }
+
+  private void checkSameOutputs(Path test, Map<String, MValue> inputs, double[] values, boolean[] defined) {
+    Map<String, MValue> expected = null;
+    try {
+      expected = Ir_tests_2020.calculateTax(inputs).getOutputValues();
+    } catch (MException e) {
+    }
+    boolean primitiveThrew = false;
+    try {
+      Ir_tests_2020_primitive.calculateTax(calc, values, defined, outputValues, outputDefined);
+    } catch (MException e) {
+      primitiveThrew = true;
+    }
+    if ((expected == null) != primitiveThrew) {
+      throw new IllegalStateException("Only one backend raised an MException on " + test);
+    }
+    if (expected == null) {
+      return;
+    }
+    for (int i = 0; i < Ir_tests_2020_primitive.NUM_OUTPUTS; i++) {
+      String name = Ir_tests_2020_primitive.getOutputName(i);
+      MValue computed = new MValue(outputValues[i], !outputDefined[i]);
+      if (!computed.equals(expected.get(name))) {
+        throw new IllegalStateException("Different outputs on " + test + " for " + name + ": " + expected.get(name)
+            + " with java, " + computed + " with java_primitive");
+      }
+    }
+  }
+
+  private static Map<String, MValue> parseInputs(Path test) throws IOException {
+    Map<String, MValue> inputs = new HashMap<>();
+    boolean inInputs = false;
+    for (String line : Files.readAllLines(test)) {
+      if (line.equals("#ENTREES-PRIMITIF")) {
+        inInputs = true;
+      } else if (line.startsWith("#")) {
+        inInputs = false;
+      } else if (inInputs) {
+        String[] variable = line.split("/");
+        inputs.put(variable[0], new MValue(Double.parseDouble(variable[1].trim())));
+      }
+    }
+    return inputs;
+  }
+}
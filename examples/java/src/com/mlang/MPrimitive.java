@@ -0,0 +1,77 @@
+/* Copyright (C) 2021 Inria, contributor: James Barnes <bureau.si-part-ircalcul@dgfip.finances.gouv.fr>
+
+   This program is free software: you can redistribute it and/or modify it under the terms of the
+   GNU General Public License as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+   even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program. If
+   not, see <https://www.gnu.org/licenses/>. */
+
+package com.mlang;
+
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * Operations used by the code generated with the java_primitive backend. The
+ * values of the variables are stored in a double[] and their definedness in a
+ * long[] bitset, the bit of the variable at position i being the bit i % 64 of
+ * the element i / 64. An undefined variable always has the value 0. The
+ * methods are small and static so that the JIT inlines them.
+ */
+final class MPrimitive {
+
+  private MPrimitive() {
+  }
+
+  static boolean isDefined(long[] def, int position) {
+    return (def[position >>> 6] & (1L << position)) != 0;
+  }
+
+  static void set(double[] tgv, long[] def, int position, double value, boolean defined) {
+    long bit = 1L << position;
+    int word = position >>> 6;
+    tgv[position] = defined ? value : 0.;
+    def[word] = defined ? def[word] | bit : def[word] & ~bit;
+  }
+
+  static double mDivide(double x, double y) {
+    return y == 0 ? 0. : x / y;
+  }
+
+  static double mRound(double x) {
+    return (double) (int) (x + (x < 0 ? -0.50005 : 0.50005));
+  }
+
+  static double mFloor(double x) {
+    return Math.floor(x + 0.000001);
+  }
+
+  static double mMultimax(boolean boundDefined, double bound, double[] tgv, int position) {
+    if (!boundDefined) {
+      throw new RuntimeException("Multimax bound undefined!");
+    }
+
+    int maxIndex = (int) Math.floor(bound);
+
+    double max = tgv[position];
+    for (int i = 0; i <= maxIndex; i++) {
+      if (tgv[position + i] > max) {
+        max = tgv[position + i];
+      }
+    }
+    return max;
+  }
+
+  static Map<String, Integer> indexNames(String[] names) {
+    Map<String, Integer> indexes = new HashMap<>(2 * names.length);
+    for (int i = 0; i < names.length; i++) {
+      indexes.put(names[i], i);
+    }
+    return indexes;
+  }
+}
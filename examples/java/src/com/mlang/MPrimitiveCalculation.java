@@ -0,0 +1,56 @@
+/* Copyright (C) 2021 Inria, contributor: James Barnes <bureau.si-part-ircalcul@dgfip.finances.gouv.fr>
+
+   This program is free software: you can redistribute it and/or modify it under the terms of the
+   GNU General Public License as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without
+   even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License along with this program. If
+   not, see <https://www.gnu.org/licenses/>. */
+
+package com.mlang;
+
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+
+/**
+ * State of the calculations of the code generated with the java_primitive
+ * backend, reused from one calculation to the next so that a calculation
+ * allocates nothing, unless it raises anomalies. Not thread safe: use one per
+ * thread.
+ */
+public final class MPrimitiveCalculation {
+
+  final double[] tgv;
+  final long[] def;
+  final List<MError> calculationErrors = new ArrayList<>();
+  final int maxAnomalies;
+  int currentAnomalies = 0;
+
+  MPrimitiveCalculation(int tgvSize, int maxAnomalies) {
+    this.tgv = new double[tgvSize];
+    this.def = new long[(tgvSize + 63) >>> 6];
+    this.maxAnomalies = maxAnomalies;
+  }
+
+  void reset() {
+    Arrays.fill(tgv, 0.);
+    Arrays.fill(def, 0L);
+    calculationErrors.clear();
+    currentAnomalies = 0;
+  }
+
+  /**
+   * Getter for the anomalies of the last calculation, cleared by the next one
+   *
+   * @return the list of the anomalies that occurred during the last calculation
+   */
+  public List<MError> getCalculationErrors() {
+    return calculationErrors;
+  }
+
+}
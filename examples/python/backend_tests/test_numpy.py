@@ -0,0 +1,40 @@
+#!/usr/bin/env python3
+# usage ./test_numpy.py TESTS_DIR
+#
+# Computes all the tests of TESTS_DIR at once with the file generated by the
+# python_numpy backend, and compares the outputs to the expected ones.
+
+import sys, os, time
+import numpy as np
+import tests_numpy # the generated file
+
+from common import parse_test
+
+if __name__ == "__main__":
+    tests_dir = sys.argv[1]
+    files = sorted(os.listdir(tests_dir))
+    cases = [parse_test(f"{tests_dir}/{f}") for f in files]
+    names = {x for (entrees, _) in cases for x in entrees}
+    inputs = {x: np.array([entrees.get(x, np.nan) for (entrees, _) in cases])
+              for x in names}
+    start = time.perf_counter()
+    resultats = tests_numpy.extracted(inputs)
+    elapsed = time.perf_counter() - start
+    print(f"{len(cases)} households computed in {elapsed:.3f} s")
+    errors = 0
+    for (i, (f, (_, sorties))) in enumerate(zip(files, cases)):
+        if resultats["is_error"][i]:
+            # the scalar backend raises on such a household, so an error is a
+            # failure whenever the test expects outputs
+            if sorties:
+                print(f"Error in {f}, the computation raised an error but "
+                      f"{len(sorties)} outputs were expected!")
+                errors += 1
+            continue
+        for (x, r) in resultats.items():
+            if x in sorties and not np.isnan(r[i]) and r[i] != sorties[x]:
+                print(f"Error in {f}, on variable {x} computed output = "
+                      f"{r[i]}, expected {sorties[x]}!")
+                errors += 1
+    if errors > 0:
+        sys.exit(-1)
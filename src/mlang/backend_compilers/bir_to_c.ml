@@ -193,6 +193,55 @@ let generate_var_cond (cond : condition_data) (oc : Format.formatter) =
 
 let fresh_cond_counter = ref 0
 
+(* Prefix of the rule, verification and mpp functions being generated, so that
+   the functions of the specialized variants do not clash with each other *)
+let function_prefix = ref ""
+
+(* Profiling of the calls (--instrument). The call sites are numbered as they
+   are generated, and the profiled functions when they are first called *)
+let instrument = ref false
+
+let prof_num_sites = ref 0
+
+let prof_entities : (string, int) Hashtbl.t = Hashtbl.create 1000
+
+(* Whether the statements being generated are the ones of a computation entry
+   point, which has to close its own profiling node when it stops on an
+   error *)
+let in_entry_point = ref false
+
+let prof_site_and_entity (name : string) : int * int =
+  let site = !prof_num_sites in
+  incr prof_num_sites;
+  match Hashtbl.find_opt prof_entities name with
+  | Some entity -> (site, entity)
+  | None ->
+      let entity = Hashtbl.length prof_entities in
+      Hashtbl.add prof_entities name entity;
+      (site, entity)
+
+let generate_prof_enter (oc : Format.formatter) (name : string) =
+  if !instrument then
+    let site, entity = prof_site_and_entity name in
+    Format.fprintf oc "m_prof_enter(PROF, %d, %d);@\n" site entity
+
+(* [generate_prof_exit oc call] prints [call], whose value is still returned
+   once the profiling node of the call is closed *)
+let generate_prof_exit (oc : Format.formatter)
+    (call : Format.formatter -> unit) =
+  if !instrument then Format.fprintf oc "m_prof_exit(PROF, %t)" call
+  else call oc
+
+let generate_error_return (oc : Format.formatter) () =
+  if !instrument && !in_entry_point then
+    Format.fprintf oc "return m_prof_exit(PROF, -1);"
+  else Format.fprintf oc "return -1;"
+
+let prof_rov_name (rov : rule_or_verif) : string =
+  match rov.rov_code with
+  | Rule _ -> "rule_" ^ Pos.unmark rov.rov_name
+  | Verif _ -> "verif_" ^ Pos.unmark rov.rov_name
+
 let rec generate_stmt (program : program) (oc : Format.formatter) (stmt : stmt)
     =
   match Pos.unmark stmt with
@@ -224,20 +273,24 @@ let rec generate_stmt (program : program) (oc : Format.formatter) (stmt : stmt)
   | SVerif v -> generate_var_cond v oc
   | SRovCall r -> (
       let rov = ROVMap.find r program.rules_and_verifs in
+      generate_prof_enter oc (prof_rov_name rov);
       match rov.rov_code with
       | Rule _ ->
           generate_rov_function_header ~definition:false oc rov;
-          Format.fprintf oc ";"
+          Format.fprintf oc ";";
+          if !instrument then Format.fprintf oc "@\nm_prof_exit(PROF, 0);"
       | Verif _ ->
-          Format.fprintf oc "if(%a){@[<v 2>"
-            (generate_rov_function_header ~definition:false)
-            rov;
+          Format.fprintf oc "if(%a){@[<v 2>" generate_prof_exit (fun fmt ->
+              generate_rov_function_header ~definition:false fmt rov);
           Format.fprintf oc "output->is_error = true;@;";
-          Format.fprintf oc "free(TGV);@;";
-          Format.fprintf oc "free(LOCAL);@;";
-          Format.fprintf oc "return -1;@]@;}")
+          Format.fprintf oc "%a@]@;}" generate_error_return ())
   | SFunctionCall (f, _) ->
-      Format.fprintf oc "if(%s(output, TGV, LOCAL)) {return -1;};\n" f
+      generate_prof_enter oc f;
+      Format.fprintf oc "if(%a) {%a};\n" generate_prof_exit
+        (fun fmt ->
+          Format.fprintf fmt "%s%s(output, TGV, LOCAL%s)" !function_prefix f
+            (if !instrument then ", PROF" else ""))
+        generate_error_return ()
 
 and generate_stmts (program : program) (oc : Format.formatter)
     (stmts : stmt list) =
@@ -252,8 +305,8 @@ and generate_rov_function_header ~(definition : bool) (oc : Format.formatter)
     | Verif _ -> ("verif", "int ")
   in
   let ret_type = if definition then ret_type else "" in
-  Format.fprintf oc "%sm_%s_%s(%sTGV, %sLOCAL)@\n" ret_type tname
-    (Pos.unmark rov.rov_name) arg_type arg_type
+  Format.fprintf oc "%sm_%s%s_%s(%sTGV, %sLOCAL)@\n" ret_type !function_prefix
+    tname (Pos.unmark rov.rov_name) arg_type arg_type
 
 let generate_rov_function (program : program) (oc : Format.formatter)
     (rov : rule_or_verif) =
@@ -282,11 +335,13 @@ let generate_mpp_function (program : program) (oc : Format.formatter)
     (f : function_name) =
   let { mppf_stmts; _ } = FunctionMap.find f program.mpp_functions in
   Format.fprintf oc
-    "@[<hv 4>int %s(m_output*output, m_value* TGV, m_value* LOCAL) {@,\
+    "@[<hv 4>int %s%s(m_output*output, m_value* TGV, m_value* LOCAL%s) {@,\
      m_value cond;@,\
      %a@,\
      return 0;@]}@,"
-    f (generate_stmts program) mppf_stmts
+    !function_prefix f
+    (if !instrument then ", m_prof *PROF" else "")
+    (generate_stmts program) mppf_stmts
 
 let generate_mpp_functions (oc : Format.formatter) (program : Bir.program) =
   Bir.FunctionMap.iter
@@ -296,26 +351,448 @@ let generate_mpp_functions (oc : Format.formatter) (program : Bir.program) =
 let generate_main_function_signature (oc : Format.formatter)
     (add_semicolon : bool) =
   Format.fprintf oc "int m_extracted(m_output *output, const m_input *input)%s"
-    (if add_semicolon then ";" else "")
+    (if add_semicolon then ";\n\n" else "")
+
+let generate_main_ctx_function_signature (oc : Format.formatter)
+    (add_semicolon : bool) =
+  Format.fprintf oc
+    "int m_extracted_ctx(m_ctx *ctx, m_output *output, const m_input *input)%s"
+    (if add_semicolon then ";\n\n" else "")
+
+let generate_ctx_prototypes (oc : Format.formatter) () =
+  Format.fprintf oc
+    "// Computation context holding the TGV and LOCAL tables, to be reused \
+     across@\n\
+     // calls to m_extracted_ctx (one per thread)@\n\
+     typedef struct m_ctx m_ctx;@\n\
+     @\n\
+     m_ctx *m_ctx_new(void);@\n\
+     @\n\
+     // Sets the inputs and every variable assigned in the program back to@\n\
+     // undefined, to be called between two computations with the same@\n\
+     // context: otherwise a variable read before being assigned holds the@\n\
+     // value of the previous computation@\n\
+     void m_ctx_reset(m_ctx *ctx);@\n\
+     @\n\
+     void m_ctx_free(m_ctx *ctx);@\n\
+     @\n"
+
+let generate_prof_prototypes (oc : Format.formatter) () =
+  if !instrument then
+    Format.fprintf oc
+      "// Profiling (generated with --instrument): the calls of the@\n\
+       // rules, verifications and mpp functions made with a context are@\n\
+       // counted and timed, in processor cycles on x86 and nanoseconds@\n\
+       // elsewhere@\n\
+       void m_ctx_prof_reset(m_ctx *ctx);@\n\
+       @\n\
+       // Functions by decreasing time spent in themselves, callees excluded@\n\
+       void m_ctx_prof_report(const m_ctx *ctx, FILE *out);@\n\
+       @\n\
+       // Time spent in each stack of calls, in the folded format read by@\n\
+       // flamegraph.pl@\n\
+       void m_ctx_prof_folded(const m_ctx *ctx, FILE *out);@\n\
+       @\n"
+
+(* The calls are stored as a tree in the context: each node is a call of a
+   function from the function of its parent node. The node entered from a call
+   site is cached, so that finding it does not depend on the number of calls
+   made by the caller *)
+let generate_prof_runtime (oc : Format.formatter) () =
+  if !instrument then
+    Format.pp_print_string oc
+      {|#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define m_prof_clock() __rdtsc()
+#else
+#include <time.h>
+static inline uint64_t m_prof_clock(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+#endif
+
+typedef struct m_prof_node {
+    int entity;
+    int parent;
+    int first_child;
+    int next_sibling;
+    uint64_t count;
+    uint64_t ticks;
+    uint64_t start;
+} m_prof_node;
+
+// Node 0 is the root of the tree of the calls
+typedef struct m_prof {
+    m_prof_node *nodes;
+    int num_nodes;
+    int capacity;
+    int current;
+    // Node entered from each call site the last time, and its parent then
+    int *site_parent;
+    int *site_node;
+} m_prof;
+
+static m_prof *m_prof_new(void);
+
+static void m_prof_free(m_prof *prof) {
+    if (prof == NULL) {
+        return;
+    }
+    free(prof->nodes);
+    free(prof->site_parent);
+    free(prof->site_node);
+    free(prof);
+}
+
+static int m_prof_child(m_prof *prof, int parent, int entity) {
+    for (int c = prof->nodes[parent].first_child; c >= 0;
+         c = prof->nodes[c].next_sibling) {
+        if (prof->nodes[c].entity == entity) {
+            return c;
+        }
+    }
+    if (prof->num_nodes == prof->capacity) {
+        m_prof_node *nodes =
+            realloc(prof->nodes, 2 * prof->capacity * sizeof(m_prof_node));
+        if (nodes == NULL) {
+            printf("Unable to allocate the profiling tree\n");
+            exit(-1);
+        }
+        prof->nodes = nodes;
+        prof->capacity *= 2;
+    }
+    int c = prof->num_nodes++;
+    prof->nodes[c] = (m_prof_node){entity, parent, -1,
+                                   prof->nodes[parent].first_child, 0, 0, 0};
+    prof->nodes[parent].first_child = c;
+    return c;
+}
+
+static inline void m_prof_enter(m_prof *prof, int site, int entity) {
+    int node = prof->site_node[site];
+    if (prof->site_parent[site] != prof->current) {
+        node = m_prof_child(prof, prof->current, entity);
+        prof->site_parent[site] = prof->current;
+        prof->site_node[site] = node;
+    }
+    prof->nodes[node].count++;
+    prof->current = node;
+    prof->nodes[node].start = m_prof_clock();
+}
 
-let generate_main_function_signature_and_var_decls (p : program)
-    (var_table_size : int) (oc : Format.formatter)
+// Returns res, so that the call of the function can be its argument
+static inline int m_prof_exit(m_prof *prof, int res) {
+    m_prof_node *node = &prof->nodes[prof->current];
+    node->ticks += m_prof_clock() - node->start;
+    prof->current = node->parent;
+    return res;
+}
+
+// Entry of a computation, from the root since the previous one may have
+// stopped on an error
+static inline void m_prof_start(m_prof *prof, int site, int entity) {
+    prof->current = 0;
+    m_prof_enter(prof, site, entity);
+}
+
+|}
+
+(* Needs the numbers of call sites and profiled functions, hence generated
+   after all the computations *)
+let generate_prof_funcs (oc : Format.formatter) () =
+  if !instrument then begin
+    let names = Array.make (Hashtbl.length prof_entities) "" in
+    Hashtbl.iter (fun name entity -> names.(entity) <- name) prof_entities;
+    Format.fprintf oc
+      "#define M_PROF_NUM_SITES %d@\n\
+       #define M_PROF_NUM_ENTITIES %d@\n\
+       static const char *const m_prof_names[M_PROF_NUM_ENTITIES] = {%a};@\n\
+       @\n"
+      (max 1 !prof_num_sites) (max 1 (Array.length names))
+      (Format.pp_print_list
+         ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+         (fun fmt name -> Format.fprintf fmt "\"%s\"" name))
+      (if names = [||] then [ "" ] else Array.to_list names);
+    Format.pp_print_string oc
+      {|static m_prof *m_prof_new(void) {
+    m_prof *prof = calloc(1, sizeof(m_prof));
+    if (prof == NULL) {
+        return NULL;
+    }
+    prof->capacity = 1024;
+    prof->nodes = malloc(prof->capacity * sizeof(m_prof_node));
+    prof->site_parent = malloc(M_PROF_NUM_SITES * sizeof(int));
+    prof->site_node = malloc(M_PROF_NUM_SITES * sizeof(int));
+    if (prof->nodes == NULL || prof->site_parent == NULL ||
+        prof->site_node == NULL) {
+        m_prof_free(prof);
+        return NULL;
+    }
+    for (int i = 0; i < M_PROF_NUM_SITES; i++) {
+        prof->site_parent[i] = -1;
+    }
+    prof->nodes[0] = (m_prof_node){-1, -1, -1, -1, 0, 0, 0};
+    prof->num_nodes = 1;
+    prof->current = 0;
+    return prof;
+}
+
+void m_ctx_prof_reset(m_ctx *ctx) {
+    for (int i = 0; i < ctx->PROF->num_nodes; i++) {
+        ctx->PROF->nodes[i].count = 0;
+        ctx->PROF->nodes[i].ticks = 0;
+    }
+}
+
+static uint64_t m_prof_self_ticks(const m_prof *prof, int node) {
+    uint64_t ticks = prof->nodes[node].ticks;
+    for (int c = prof->nodes[node].first_child; c >= 0;
+         c = prof->nodes[c].next_sibling) {
+        ticks = prof->nodes[c].ticks < ticks ? ticks - prof->nodes[c].ticks : 0;
+    }
+    return ticks;
+}
+
+typedef struct m_prof_line {
+    int entity;
+    uint64_t count;
+    uint64_t self_ticks;
+    uint64_t total_ticks;
+} m_prof_line;
+
+static int m_prof_compare_lines(const void *a, const void *b) {
+    uint64_t ta = ((const m_prof_line *)a)->self_ticks;
+    uint64_t tb = ((const m_prof_line *)b)->self_ticks;
+    return (ta < tb) - (ta > tb);
+}
+
+void m_ctx_prof_report(const m_ctx *ctx, FILE *out) {
+    const m_prof *prof = ctx->PROF;
+    m_prof_line *lines = calloc(M_PROF_NUM_ENTITIES, sizeof(m_prof_line));
+    if (lines == NULL) {
+        return;
+    }
+    for (int e = 0; e < M_PROF_NUM_ENTITIES; e++) {
+        lines[e].entity = e;
+    }
+    uint64_t all_ticks = 0;
+    for (int n = 1; n < prof->num_nodes; n++) {
+        m_prof_line *line = &lines[prof->nodes[n].entity];
+        uint64_t self_ticks = m_prof_self_ticks(prof, n);
+        line->count += prof->nodes[n].count;
+        line->self_ticks += self_ticks;
+        all_ticks += self_ticks;
+        // The time of a recursive call is already in the one of its caller
+        int p = prof->nodes[n].parent;
+        while (p > 0 && prof->nodes[p].entity != prof->nodes[n].entity) {
+            p = prof->nodes[p].parent;
+        }
+        if (p <= 0) {
+            line->total_ticks += prof->nodes[n].ticks;
+        }
+    }
+    qsort(lines, M_PROF_NUM_ENTITIES, sizeof(m_prof_line),
+          m_prof_compare_lines);
+    fprintf(out, "%6s %16s %16s %12s  %s\n", "self%", "self ticks",
+            "total ticks", "calls", "function");
+    for (int i = 0; i < M_PROF_NUM_ENTITIES; i++) {
+        if (lines[i].count == 0) {
+            continue;
+        }
+        fprintf(out, "%5.1f%% %16llu %16llu %12llu  %s\n",
+                all_ticks == 0 ? 0. : 100. * lines[i].self_ticks / all_ticks,
+                (unsigned long long)lines[i].self_ticks,
+                (unsigned long long)lines[i].total_ticks,
+                (unsigned long long)lines[i].count,
+                m_prof_names[lines[i].entity]);
+    }
+    free(lines);
+}
+
+static void m_prof_print_stack(const m_prof *prof, int node, FILE *out) {
+    if (prof->nodes[node].parent > 0) {
+        m_prof_print_stack(prof, prof->nodes[node].parent, out);
+        fputc(';', out);
+    }
+    fputs(m_prof_names[prof->nodes[node].entity], out);
+}
+
+void m_ctx_prof_folded(const m_ctx *ctx, FILE *out) {
+    const m_prof *prof = ctx->PROF;
+    for (int n = 1; n < prof->num_nodes; n++) {
+        uint64_t self_ticks = m_prof_self_ticks(prof, n);
+        if (self_ticks > 0) {
+            m_prof_print_stack(prof, n, out);
+            fprintf(out, " %llu\n", (unsigned long long)self_ticks);
+        }
+    }
+}
+
+|}
+  end
+
+(* Offsets of the TGV that can be written during a computation, i.e. the
+   inputs and the assigned variables, table cells included *)
+let get_written_slots (p : program)
+    (function_spec : Bir_interface.bir_function) : int list =
+  let module IntSet = Set.Make (Int) in
+  let add_var var acc =
+    match (var_to_mir var).Mir.Variable.is_table with
+    | None -> IntSet.add var.offset acc
+    | Some size ->
+        List.fold_left
+          (fun acc i -> IntSet.add (var.offset + i) acc)
+          acc
+          (List.init size (fun i -> i))
+  in
+  let slots =
+    VariableMap.fold
+      (fun var () acc -> add_var var acc)
+      function_spec.func_variable_inputs IntSet.empty
+  in
+  let slots = VariableSet.fold add_var (get_assigned_variables p) slots in
+  IntSet.elements slots
+
+(* Prints a static array of integers, C arrays cannot be empty *)
+let generate_int_array (oc : Format.formatter)
+    ((name, values) : string * int list) =
+  Format.fprintf oc "static const int %s[%d] = {%a};@\n" name
+    (max 1 (List.length values))
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt ", ")
+       Format.pp_print_int)
+    (if values = [] then [ 0 ] else values)
+
+let generate_ctx_funcs (programs : program list) (var_table_size : int)
+    (num_update_nodes : int) (oc : Format.formatter)
     (function_spec : Bir_interface.bir_function) =
+  (* here, we need to generate a table that can host all the local vars. the
+     index inside the table will be the id of the local var so we generate a
+     table big enough so that the highest id is always in bounds. The context
+     is shared by the generic computation and its specialized variants. *)
+  let size_locals =
+    List.fold_left (fun acc p -> max acc (get_locals_size p)) 0 programs + 1
+  in
+  let written_slots =
+    List.sort_uniq compare
+      (List.concat_map (fun p -> get_written_slots p function_spec) programs)
+  in
+  (* Code only generated with --instrument *)
+  let prof_code (print : Format.formatter -> unit) (fmt : Format.formatter) =
+    if !instrument then print fmt
+  in
+  Format.fprintf oc
+    "struct m_ctx {@\n\
+     @[<h 4>    m_value *TGV;@\n\
+     m_value *LOCAL;@\n\
+     // Whether TGV holds a computation m_update can start from@\n\
+     bool valid;@\n\
+     // The nodes reached by an update are marked with its number@\n\
+     unsigned int epoch;@\n\
+     unsigned int *marks;@\n\
+     int *reached;%t@]@\n\
+     };@\n\
+     @\n\
+     // TGV slots that a computation can write, reset by m_ctx_reset: a@\n\
+     // static over-approximation made of the inputs and of every variable@\n\
+     // assigned somewhere in the program, even in branches that the last@\n\
+     // computation did not take@\n\
+     %a\
+     @\n\
+     // Tables are aligned on cache lines@\n\
+     static m_value *m_alloc_slots(size_t size) {@\n\
+     @[<h 4>    size_t bytes = ((size * sizeof(m_value) + 63) / 64) * 64;@\n\
+     m_value *slots = aligned_alloc(64, bytes);@\n\
+     if (slots != NULL) {@\n\
+    \    for (size_t i = 0; i < size; i++) {@\n\
+    \        slots[i] = m_undefined;@\n\
+    \    }@\n\
+     }@\n\
+     return slots;@]@\n\
+     }@\n\
+     @\n\
+     m_ctx *m_ctx_new(void) {@\n\
+     @[<h 4>    m_ctx *ctx = malloc(sizeof(m_ctx));@\n\
+     if (ctx == NULL) {@\n\
+    \    return NULL;@\n\
+     }@\n\
+     ctx->TGV = m_alloc_slots(%d);@\n\
+     ctx->LOCAL = m_alloc_slots(%d);@\n\
+     ctx->valid = false;@\n\
+     ctx->epoch = 0;@\n\
+     ctx->marks = calloc(%d, sizeof(unsigned int));@\n\
+     ctx->reached = malloc(%d * sizeof(int));@\n\
+     %tif (ctx->TGV == NULL || ctx->LOCAL == NULL || ctx->marks == NULL ||@\n\
+    \    ctx->reached == NULL%s) {@\n\
+    \    m_ctx_free(ctx);@\n\
+    \    return NULL;@\n\
+     }@\n\
+     return ctx;@]@\n\
+     }@\n\
+     @\n\
+     // LOCAL is not reset: a local variable is always assigned right before@\n\
+     // the expression using it@\n\
+     void m_ctx_reset(m_ctx *ctx) {@\n\
+     @[<h 4>    ctx->valid = false;@\n\
+     for (int i = 0; i < %d; i++) {@\n\
+    \    ctx->TGV[m_written_slots[i]] = m_undefined;@\n\
+     }@]@\n\
+     }@\n\
+     @\n\
+     void m_ctx_free(m_ctx *ctx) {@\n\
+     @[<h 4>    if (ctx == NULL) {@\n\
+    \    return;@\n\
+     }@\n\
+     free(ctx->TGV);@\n\
+     free(ctx->LOCAL);@\n\
+     free(ctx->marks);@\n\
+     free(ctx->reached);@\n\
+     %tfree(ctx);@]@\n\
+     }@\n\
+     @\n"
+    (prof_code (fun fmt ->
+         Format.fprintf fmt "@\n// Profiling of the calls@\nm_prof *PROF;"))
+    generate_int_array ("m_written_slots", written_slots)
+    var_table_size size_locals (max 1 num_update_nodes)
+    (max 1 num_update_nodes)
+    (prof_code (fun fmt -> Format.fprintf fmt "ctx->PROF = m_prof_new();@\n"))
+    (if !instrument then " || ctx->PROF == NULL" else "")
+    (List.length written_slots)
+    (prof_code (fun fmt -> Format.fprintf fmt "m_prof_free(ctx->PROF);@\n"))
+
+(* Name of the computation of a specialized variant *)
+let variant_function_name (variant : string) : string =
+  "m_extracted_ctx_" ^ variant
+
+let generate_variant_function_signature (variant : string)
+    (oc : Format.formatter) (add_semicolon : bool) =
+  Format.fprintf oc
+    "int %s(m_ctx *ctx, m_output *output, const m_input *input)%s"
+    (variant_function_name variant)
+    (if add_semicolon then ";\n\n" else "")
+
+(* Beginning of a function computing the outputs from a context, named [name] *)
+let generate_entry_point_signature_and_var_decls
+    (signature : Format.formatter -> bool -> unit) (name : string)
+    (oc : Format.formatter) (function_spec : Bir_interface.bir_function) =
   let input_vars =
     List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
   in
-  Format.fprintf oc "%a {@\n@[<h 4>    @\n" generate_main_function_signature
-    false;
+  Format.fprintf oc "%a {@\n@[<h 4>    @\n" signature false;
   Format.fprintf oc
-    "// First we initialize the table of all the variables used in the program@\n";
-  (* here, we need to generate a table that can host all the local vars. the
-     index inside the table will be the id of the local var so we generate a
-     table big enough so that the highest id is always in bounds *)
-  let size_locals = get_locals_size p + 1 in
-  Format.fprintf oc "m_value *LOCAL = malloc(%d * sizeof(m_value));@\n@\n"
-    size_locals;
-  Format.fprintf oc "m_value *TGV = malloc(%d * sizeof(m_value));@\n@\n"
-    var_table_size;
+    "// The tables of all the variables used in the program live in the \
+     context@\n";
+  Format.fprintf oc "m_value *LOCAL = ctx->LOCAL;@\n@\n";
+  Format.fprintf oc "m_value *TGV = ctx->TGV;@\n@\n";
+  if !instrument then begin
+    let site, entity = prof_site_and_entity name in
+    Format.fprintf oc
+      "m_prof *PROF = ctx->PROF;@\nm_prof_start(PROF, %d, %d);@\n@\n" site
+      entity
+  end;
+  Format.fprintf oc "ctx->valid = false;@\n@\n";
   Format.fprintf oc
     "// Then we extract the input variables from the dictionnary:@\n%a@\n@\n"
     (Format.pp_print_list
@@ -327,7 +804,20 @@ let generate_main_function_signature_and_var_decls (p : program)
 
   Format.fprintf oc "m_value cond;@\n@\n"
 
-let generate_return (oc : Format.formatter)
+let generate_main_function_signature_and_var_decls (variant : string option)
+    (oc : Format.formatter) (function_spec : Bir_interface.bir_function) =
+  match variant with
+  | None ->
+      generate_entry_point_signature_and_var_decls
+        generate_main_ctx_function_signature "m_extracted_ctx" oc function_spec
+  | Some variant ->
+      generate_entry_point_signature_and_var_decls
+        (generate_variant_function_signature variant)
+        (variant_function_name variant)
+        oc function_spec
+
+(* [valid] tells whether the context can be used by m_update afterwards *)
+let generate_return (valid : bool) (oc : Format.formatter)
     (function_spec : Bir_interface.bir_function) =
   let returned_variables =
     List.map fst (VariableMap.bindings function_spec.func_outputs)
@@ -335,24 +825,45 @@ let generate_return (oc : Format.formatter)
   Format.fprintf oc
     "%a@\n\
      @\n\
-     free(TGV);@\n\
-     free(LOCAL);@\n\
+     %actx->valid = %b;@\n\
      output->is_error = false;@\n\
      return 0;@]@\n\
-     }"
+     }@\n\
+     @\n"
     (Format.pp_print_list
        ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
        (fun fmt var ->
          Format.fprintf fmt "output->%s = %a;" (generate_name var)
            (generate_variable None) var))
     returned_variables
+    (fun fmt () ->
+      if !instrument then Format.fprintf fmt "m_prof_exit(PROF, 0);@\n")
+    () valid
+
+let generate_main_function_wrapper (oc : Format.formatter) () =
+  Format.fprintf oc
+    "%a {@\n\
+     @[<h 4>    m_ctx *ctx = m_ctx_new();@\n\
+     if (ctx == NULL) {@\n\
+    \    output->is_error = true;@\n\
+    \    return -1;@\n\
+     }@\n\
+     int res = m_extracted_ctx(ctx, output, input);@\n\
+     m_ctx_free(ctx);@\n\
+     return res;@]@\n\
+     }"
+    generate_main_function_signature false
 
 let generate_header (oc : Format.formatter) () : unit =
   Format.fprintf oc "// %s\n\n" Prelude.message;
   Format.fprintf oc "#ifndef IR_HEADER_ \n";
   Format.fprintf oc "#define IR_HEADER_ \n";
   Format.fprintf oc "#include <stdio.h>\n";
-  Format.fprintf oc "#include \"m_value.h\"\n\n"
+  Format.fprintf oc "#ifdef M_VALUE_INLINE\n";
+  Format.fprintf oc "#include \"m_value_inline.h\"\n";
+  Format.fprintf oc "#else\n";
+  Format.fprintf oc "#include \"m_value.h\"\n";
+  Format.fprintf oc "#endif\n\n"
 
 let generate_footer (oc : Format.formatter) () : unit =
   Format.fprintf oc "\n#endif /* IR_HEADER_ */"
@@ -398,25 +909,56 @@ let generate_get_input_index_prototype (oc : Format.formatter)
   Format.fprintf oc "int m_get_input_index(char *name)%s"
     (if add_semicolon then ";\n\n" else "")
 
+let input_names (function_spec : Bir_interface.bir_function) : string list =
+  List.map
+    (fun (var, ()) -> generate_raw_name var)
+    (VariableMap.bindings function_spec.func_variable_inputs)
+
+let output_names (function_spec : Bir_interface.bir_function) : string list =
+  List.map
+    (fun (var, ()) -> Pos.unmark (var_to_mir var).Mir.Variable.name)
+    (VariableMap.bindings function_spec.func_outputs)
+
+(* Names of the inputs or outputs by index, and their perfect hash *)
+let generate_name_tables (oc : Format.formatter)
+    ((kind, names) : string * string list) =
+  let hash = Perfect_hash.create names in
+  Format.fprintf oc
+    "static const char *const m_%s_names[%d] = {%a};@\n%a%a@\n" kind
+    (max 1 (List.length names))
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+       (fun fmt name -> Format.fprintf fmt "\"%s\"" name))
+    (if names = [] then [ "" ] else names)
+    generate_int_array
+    ("m_" ^ kind ^ "_hash_seeds", Array.to_list hash.seeds)
+    generate_int_array
+    ("m_" ^ kind ^ "_hash_slots", Array.to_list hash.slots)
+
+(* Finds the index of [name] with the tables of [generate_name_tables] *)
+let generate_name_lookup (oc : Format.formatter)
+    ((kind, names) : string * string list) =
+  if names <> [] then
+    Format.fprintf oc
+      "uint32_t seed =@\n\
+      \    m_%s_hash_seeds[m_hash(0, name) %% M_NB(m_%s_hash_seeds)];@\n\
+       int index =@\n\
+      \    m_%s_hash_slots[m_hash(seed, name) %% M_NB(m_%s_hash_slots)];@\n\
+       if (strcmp(m_%s_names[index], name) == 0) {@\n\
+      \    return index;@\n\
+       }@\n"
+      kind kind kind kind kind
+
 let generate_get_input_index_func (oc : Format.formatter)
     (function_spec : Bir_interface.bir_function) =
-  let input_vars =
-    List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
-  in
   Format.fprintf oc
     "%a {@\n\
-     @[<h 4>    %a@\n\
-     printf(\"Input var %%s not found!\\n\", name);@\n\
+     @[<h 4>    %aprintf(\"Input var %%s not found!\\n\", name);@\n\
      exit(-1);@]@\n\
      };@\n\
      @\n"
-    generate_get_input_index_prototype false
-    (Format.pp_print_list
-       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
-       (fun fmt (var, i) ->
-         Format.fprintf fmt "if (strcmp(\"%s\", name) == 0) { return %d; }"
-           (generate_raw_name var) i))
-    (List.mapi (fun i x -> (x, i)) input_vars)
+    generate_get_input_index_prototype false generate_name_lookup
+    ("input", input_names function_spec)
 
 let generate_get_input_name_from_index_prototype (oc : Format.formatter)
     (add_semicolon : bool) =
@@ -425,23 +967,17 @@ let generate_get_input_name_from_index_prototype (oc : Format.formatter)
 
 let generate_get_input_name_from_index_func (oc : Format.formatter)
     (function_spec : Bir_interface.bir_function) =
-  let input_vars =
-    List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
-  in
   Format.fprintf oc
     "%a {@\n\
-     @[<h 4>    %a@\n\
+     @[<h 4>    if (index >= 0 && index < %d) {@\n\
+    \    return (char *)m_input_names[index];@\n\
+     }@\n\
      printf(\"Input int %%d not found!\\n\", index);@\n\
      exit(-1);@]@\n\
      };@\n\
      @\n"
     generate_get_input_name_from_index_prototype false
-    (Format.pp_print_list
-       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
-       (fun fmt (var, i) ->
-         Format.fprintf fmt "if (%d == index) { return \"%s\"; }" i
-           (generate_raw_name var)))
-    (List.mapi (fun i x -> (x, i)) input_vars)
+    (List.length (input_names function_spec))
 
 let generate_get_input_num_prototype (oc : Format.formatter)
     (add_semicolon : bool) =
@@ -513,24 +1049,14 @@ let generate_get_output_index_prototype (oc : Format.formatter)
 
 let generate_get_output_index_func (oc : Format.formatter)
     (function_spec : Bir_interface.bir_function) =
-  let output_vars =
-    List.map fst (VariableMap.bindings function_spec.func_outputs)
-  in
   Format.fprintf oc
     "%a {@\n\
-     @[<h 4>    %a@\n\
-     printf(\"Output var %%s not found!\\n\", name);@\n\
+     @[<h 4>    %aprintf(\"Output var %%s not found!\\n\", name);@\n\
      exit(-1);@]@\n\
      };@\n\
      @\n"
-    generate_get_output_index_prototype false
-    (Format.pp_print_list
-       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
-       (fun fmt (var, i) ->
-         Format.fprintf fmt "if (strcmp(\"%s\", name) == 0) { return %d; }"
-           (Pos.unmark (var_to_mir var).Mir.Variable.name)
-           i))
-    (List.mapi (fun i x -> (x, i)) output_vars)
+    generate_get_output_index_prototype false generate_name_lookup
+    ("output", output_names function_spec)
 
 let generate_get_output_name_from_index_prototype (oc : Format.formatter)
     (add_semicolon : bool) =
@@ -539,23 +1065,17 @@ let generate_get_output_name_from_index_prototype (oc : Format.formatter)
 
 let generate_get_output_name_from_index_func (oc : Format.formatter)
     (function_spec : Bir_interface.bir_function) =
-  let output_vars =
-    List.map fst (VariableMap.bindings function_spec.func_outputs)
-  in
   Format.fprintf oc
     "%a {@\n\
-     @[<h 4>    %a@\n\
+     @[<h 4>    if (index >= 0 && index < %d) {@\n\
+    \    return (char *)m_output_names[index];@\n\
+     }@\n\
      printf(\"Output index %%d not found!\\n\", index);@\n\
      exit(-1);@]@\n\
      };@\n\
      @\n"
     generate_get_output_name_from_index_prototype false
-    (Format.pp_print_list
-       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
-       (fun fmt (var, i) ->
-         Format.fprintf fmt "if (index == %d) { return \"%s\"; }" i
-           (Pos.unmark (var_to_mir var).Mir.Variable.name)))
-    (List.mapi (fun i x -> (x, i)) output_vars)
+    (List.length (output_names function_spec))
 
 let generate_get_output_num_prototype (oc : Format.formatter)
     (add_semicolon : bool) =
@@ -588,22 +1108,249 @@ let generate_output_type (oc : Format.formatter)
            (Pos.unmark (var_to_mir var).Mir.Variable.descr)))
     output_vars
 
+let generate_writer_prototypes (oc : Format.formatter) () =
+  Format.fprintf oc
+    "// Streaming of selected outputs, for computations of many households.@\n\
+     // The records are gathered in a buffer written by large fwrite calls.@\n\
+     typedef enum m_writer_format {@\n\
+    \    // Fixed-width records: the values of the outputs as doubles, then@\n\
+    \    // one byte per output telling whether it is defined, padded to 8@\n\
+    \    // bytes. The file starts with the magic \"MROWS01\", the number of@\n\
+    \    // outputs, the size of a record and the size of the names as@\n\
+    \    // uint64_t, then the NUL-terminated names padded to 8 bytes.@\n\
+    \    // Numbers are in the byte order of the machine.@\n\
+    \    M_WRITER_BINARY,@\n\
+    \    // A line of names, then one line per record, undefined values@\n\
+    \    // being empty cells@\n\
+    \    M_WRITER_CSV@\n\
+     } m_writer_format;@\n\
+     @\n\
+     typedef struct m_writer m_writer;@\n\
+     @\n\
+     // Writer of the outputs whose indexes (see m_get_output_index) are in@\n\
+     // outputs, in this order, to out. buffer_size is in bytes, 0 for the@\n\
+     // default. Returns NULL if an index is invalid or the header cannot be@\n\
+     // written.@\n\
+     m_writer *m_writer_new(FILE *out, m_writer_format format,@\n\
+    \                       const int *outputs, int num_outputs,@\n\
+    \                       size_t buffer_size);@\n\
+     @\n\
+     // Appends a record, the caller decides what to do with the households@\n\
+     // whose computation stopped on an error. Returns -1 once a write has@\n\
+     // failed.@\n\
+     int m_writer_append(m_writer *writer, const m_output *output);@\n\
+     @\n\
+     // Writes the records still in the buffer, returns -1 if a write failed@\n\
+     int m_writer_flush(m_writer *writer);@\n\
+     @\n\
+     // Flushes and frees the writer, out is left open@\n\
+     int m_writer_free(m_writer *writer);@\n\
+     @\n"
+
+(* Most outputs are amounts in euros, printed without going through printf *)
+let writer_runtime =
+  {|#define M_WRITER_MAGIC "MROWS01"
+#define M_WRITER_DEFAULT_BUFFER_SIZE (1 << 20)
+// Longest value printed by m_writer_print_value, with its separator
+#define M_WRITER_CSV_CELL_SIZE 32
+
+struct m_writer {
+    FILE *out;
+    m_writer_format format;
+    int num_outputs;
+    size_t *offsets;
+    // Largest size of a record
+    size_t record_size;
+    char *buffer;
+    size_t size;
+    size_t capacity;
+    int error;
+};
+
+static size_t m_writer_print_value(char *p, double value) {
+    if (value > -1e15 && value < 1e15 && value == (double)(long long)value) {
+        char digits[20];
+        long long n = (long long)value;
+        unsigned long long u =
+            n < 0 ? 0ULL - (unsigned long long)n : (unsigned long long)n;
+        size_t len = 0;
+        size_t i = 0;
+        do {
+            digits[i++] = '0' + u % 10;
+            u /= 10;
+        } while (u != 0);
+        if (n < 0) {
+            p[len++] = '-';
+        }
+        while (i > 0) {
+            p[len++] = digits[--i];
+        }
+        return len;
+    }
+    return snprintf(p, M_WRITER_CSV_CELL_SIZE, "%.17g", value);
+}
+
+static int m_writer_write(m_writer *writer, const void *data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, writer->out) != size) {
+        writer->error = -1;
+    }
+    return writer->error;
+}
+
+static int m_writer_write_header(m_writer *writer, const int *outputs) {
+    if (writer->format == M_WRITER_CSV) {
+        for (int i = 0; i < writer->num_outputs; i++) {
+            const char *name = m_output_names[outputs[i]];
+            m_writer_write(writer, ",", i > 0);
+            m_writer_write(writer, name, strlen(name));
+        }
+        return m_writer_write(writer, "\n", 1);
+    }
+    uint64_t names_size = 0;
+    for (int i = 0; i < writer->num_outputs; i++) {
+        names_size += strlen(m_output_names[outputs[i]]) + 1;
+    }
+    uint64_t padding = (8 - names_size % 8) % 8;
+    uint64_t header[3] = {writer->num_outputs, writer->record_size,
+                          names_size + padding};
+    m_writer_write(writer, M_WRITER_MAGIC, 8);
+    m_writer_write(writer, header, sizeof(header));
+    for (int i = 0; i < writer->num_outputs; i++) {
+        const char *name = m_output_names[outputs[i]];
+        m_writer_write(writer, name, strlen(name) + 1);
+    }
+    return m_writer_write(writer, "\0\0\0\0\0\0\0", padding);
+}
+
+int m_writer_free(m_writer *writer) {
+    if (writer == NULL) {
+        return 0;
+    }
+    int res = m_writer_flush(writer);
+    free(writer->offsets);
+    free(writer->buffer);
+    free(writer);
+    return res;
+}
+
+m_writer *m_writer_new(FILE *out, m_writer_format format,
+                       const int *outputs, int num_outputs,
+                       size_t buffer_size) {
+    for (int i = 0; i < num_outputs; i++) {
+        if (outputs[i] < 0 || outputs[i] >= m_num_outputs()) {
+            return NULL;
+        }
+    }
+    m_writer *writer = calloc(1, sizeof(m_writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    writer->out = out;
+    writer->format = format;
+    writer->num_outputs = num_outputs;
+    if (format == M_WRITER_BINARY) {
+        writer->record_size =
+            ((num_outputs * (sizeof(double) + 1) + 7) / 8) * 8;
+    } else {
+        writer->record_size = num_outputs * M_WRITER_CSV_CELL_SIZE + 1;
+    }
+    writer->capacity =
+        buffer_size == 0 ? M_WRITER_DEFAULT_BUFFER_SIZE : buffer_size;
+    if (writer->capacity < writer->record_size) {
+        writer->capacity = writer->record_size;
+    }
+    writer->offsets = malloc((num_outputs + 1) * sizeof(size_t));
+    writer->buffer = malloc(writer->capacity);
+    if (writer->offsets == NULL || writer->buffer == NULL) {
+        m_writer_free(writer);
+        return NULL;
+    }
+    for (int i = 0; i < num_outputs; i++) {
+        writer->offsets[i] = m_output_offsets[outputs[i]];
+    }
+    if (m_writer_write_header(writer, outputs) != 0) {
+        m_writer_free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+int m_writer_append(m_writer *writer, const m_output *output) {
+    if (writer->capacity - writer->size < writer->record_size &&
+        m_writer_flush(writer) != 0) {
+        return -1;
+    }
+    const char *fields = (const char *)output;
+    char *record = writer->buffer + writer->size;
+    int n = writer->num_outputs;
+    if (writer->format == M_WRITER_BINARY) {
+        char *defined = record + n * sizeof(double);
+        for (int i = 0; i < n; i++) {
+            const m_value *v = (const m_value *)(fields + writer->offsets[i]);
+            memcpy(record + i * sizeof(double), &v->value, sizeof(double));
+            defined[i] = !v->undefined;
+        }
+        memset(defined + n, 0, writer->record_size - n * (sizeof(double) + 1));
+        writer->size += writer->record_size;
+        return writer->error;
+    }
+    char *p = record;
+    for (int i = 0; i < n; i++) {
+        const m_value *v = (const m_value *)(fields + writer->offsets[i]);
+        if (i > 0) {
+            *p++ = ',';
+        }
+        if (!v->undefined) {
+            p += m_writer_print_value(p, v->value);
+        }
+    }
+    *p++ = '\n';
+    writer->size = p - writer->buffer;
+    return writer->error;
+}
+
+int m_writer_flush(m_writer *writer) {
+    m_writer_write(writer, writer->buffer, writer->size);
+    writer->size = 0;
+    return writer->error;
+}
+
+|}
+
+let generate_writer_funcs (oc : Format.formatter)
+    (function_spec : Bir_interface.bir_function) =
+  let output_vars =
+    List.map fst (VariableMap.bindings function_spec.func_outputs)
+  in
+  Format.fprintf oc
+    "// Position of each output in m_output, for the writers@\n\
+     static const size_t m_output_offsets[%d] = {%a};@\n\
+     @\n\
+     %s"
+    (max 1 (List.length output_vars))
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+       Format.pp_print_string)
+    (if output_vars = [] then [ "0" ]
+     else
+       List.map
+         (fun var ->
+           Printf.sprintf "offsetof(m_output, %s)" (generate_name var))
+         output_vars)
+    writer_runtime
+
 let generate_implem_header oc header_filename =
   Format.fprintf oc "// File generated by the Mlang compiler\n\n";
+  Format.fprintf oc "#include <stddef.h>\n";
+  Format.fprintf oc "#include <stdint.h>\n";
   Format.fprintf oc "#include <string.h>\n";
   Format.fprintf oc "#include \"%s\"\n\n" header_filename
 
-let generate_c_program (program : program)
-    (function_spec : Bir_interface.bir_function) (filename : string) : unit =
-  if Filename.extension filename <> ".c" then
-    Errors.raise_error
-      (Format.asprintf "Output file should have a .c extension (currently %s)"
-         filename);
-  let header_filename = Filename.remove_extension filename ^ ".h" in
-  let _oc = open_out header_filename in
-  let var_table_size = Bir.size_of_tgv () in
-  let oc = Format.formatter_of_out_channel _oc in
-  Format.fprintf oc "%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a" generate_header ()
+(* Types of the inputs and outputs and prototypes of the helpers handling
+   them, shared with the batched C backend *)
+let generate_io_prototypes (oc : Format.formatter)
+    (function_spec : Bir_interface.bir_function) =
+  Format.fprintf oc "%a%a%a%a%a%a%a%a%a%a%a%a%a"
     generate_input_type function_spec generate_empty_input_prototype true
     generate_input_from_array_prototype true generate_get_input_index_prototype
     true generate_get_input_num_prototype true
@@ -612,12 +1359,17 @@ let generate_c_program (program : program)
     generate_get_output_index_prototype true
     generate_get_output_name_from_index_prototype true
     generate_get_output_num_prototype true generate_empty_output_prototype true
-    generate_main_function_signature true generate_footer ();
-  close_out _oc;
-  let _oc = open_out filename in
-  let oc = Format.formatter_of_out_channel _oc in
-  Format.fprintf oc "%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a"
-    generate_implem_header header_filename
+    generate_writer_prototypes ()
+  [@@ocamlformat "disable"]
+
+let generate_io_funcs (oc : Format.formatter)
+    (function_spec : Bir_interface.bir_function) =
+  Format.fprintf oc "%a%a%a%a%a%a%a%a%a%a%a%a%a%a%a"
+    (Perfect_hash.generate_c_hash_function "m_hash") ()
+    (fun fmt () -> Format.fprintf fmt
+       "#define M_NB(array) (sizeof(array) / sizeof((array)[0]))@\n@\n") ()
+    generate_name_tables ("input", input_names function_spec)
+    generate_name_tables ("output", output_names function_spec)
     generate_empty_input_func function_spec
     generate_input_from_array_func function_spec
     generate_get_input_index_func function_spec
@@ -628,10 +1380,578 @@ let generate_c_program (program : program)
     generate_get_output_name_from_index_func function_spec
     generate_get_output_num_func function_spec
     generate_empty_output_func function_spec
+    generate_writer_funcs function_spec
+  [@@ocamlformat "disable"]
+
+let generate_update_prototype (oc : Format.formatter) (add_semicolon : bool) =
+  Format.fprintf oc
+    "int m_update(m_ctx *ctx, m_output *output, const m_input *input,@\n\
+    \             const int *changed_inputs, int num_changed)%s"
+    (if add_semicolon then ";\n\n" else "")
+
+let generate_update_doc (oc : Format.formatter) () =
+  Format.fprintf oc
+    "// Computes again the outputs of the last computation made with ctx,@\n\
+     // after a change of the inputs whose indexes (see m_get_input_index)@\n\
+     // are listed in changed_inputs: only the rules depending on them are@\n\
+     // executed again. input holds all the inputs of the new computation,@\n\
+     // as for a full one: the changed inputs, and the inputs assigned by@\n\
+     // the rules executed again, are read from it. If ctx does not hold a@\n\
+     // complete computation, a full one is made with input.@\n"
+
+(* Tables of the dependency graph of [Bir_incremental] and the function
+   propagating a change of inputs along it *)
+let generate_update_func (program : program)
+    (function_spec : Bir_interface.bir_function) (full_computation : string)
+    (oc : Format.formatter) (g : Bir_incremental.t) =
+  let input_vars =
+    List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
+  in
+  let { Bir_incremental.units; vars; succs } = g in
+  let num_units = Array.length units in
+  let var_sizes =
+    Array.map
+      (fun v -> Option.value ~default:1 (var_to_mir v).Mir.Variable.is_table)
+      vars
+  in
+  let input_nodes =
+    List.map
+      (fun var -> Option.value ~default:(-1) (Bir_incremental.var_node g var))
+      input_vars
+  in
+  let input_indexes =
+    let module IntMap = Map.Make (Int) in
+    let indexes =
+      List.fold_left
+        (fun (acc, i) var -> (IntMap.add var.offset i acc, i + 1))
+        (IntMap.empty, 0) input_vars
+      |> fst
+    in
+    fun var -> Option.value ~default:(-1) (IntMap.find_opt var.offset indexes)
+  in
+  let succs_start =
+    Array.fold_left
+      (fun (starts, next) succs -> (next :: starts, next + Array.length succs))
+      ([], 0) succs
+    |> fun (starts, next) -> List.rev (next :: starts)
+  in
+  Format.fprintf oc
+    "// Units of the computation and TGV variables they access, as nodes of \
+     the@\n\
+     // graph followed by m_update@\n\
+     #define M_UPDATE_NUM_UNITS %d@\n\
+     #define M_UPDATE_NUM_NODES %d@\n\
+     %a%a%a%a%a%a@\n"
+    num_units (Bir_incremental.num_nodes g)
+    generate_int_array ("m_update_succs_start", succs_start)
+    generate_int_array
+      ("m_update_succs", List.concat_map Array.to_list (Array.to_list succs))
+    generate_int_array ("m_update_input_nodes", input_nodes)
+    generate_int_array
+      ( "m_update_var_offsets",
+        List.map (fun v -> v.offset) (Array.to_list vars) )
+    generate_int_array ("m_update_var_sizes", Array.to_list var_sizes)
+    generate_int_array
+      ("m_update_var_inputs", Array.to_list (Array.map input_indexes vars));
+  Format.fprintf oc
+    "static void m_load_input(m_value *TGV, const m_input *input,@\n\
+    \                         int index) {@\n\
+     @[<h 4>    switch (index) {@\n\
+     %a@\n\
+     default:@\n\
+    \    break;@\n\
+     }@]@\n\
+     }@\n\
+     @\n"
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
+       (fun fmt (i, var) ->
+         Format.fprintf fmt "case %d:@\n    %a = input->%s;@\n    break;" i
+           (generate_variable None) var (generate_name var)))
+    (List.mapi (fun i var -> (i, var)) input_vars);
+  in_entry_point := true;
+  Format.fprintf oc
+    "%a {@\n\
+     @[<h 4>    if (!ctx->valid) {@\n\
+    \    return %s(ctx, output, input);@\n\
+     }@\n\
+     ctx->valid = false;@\n\
+     m_value *LOCAL = ctx->LOCAL;@\n\
+     m_value *TGV = ctx->TGV;@\n\
+     unsigned int *marks = ctx->marks;@\n\
+     int *reached = ctx->reached;@\n\
+     unsigned int epoch = ++ctx->epoch;@\n\
+     if (epoch == 0) {@\n\
+    \    // The counter wrapped around, old marks could pass for new ones@\n\
+    \    memset(marks, 0, M_UPDATE_NUM_NODES * sizeof(unsigned int));@\n\
+    \    epoch = ctx->epoch = 1;@\n\
+     }@\n\
+     int num_reached = 0;@\n\
+     for (int i = 0; i < num_changed; i++) {@\n\
+    \    if (changed_inputs[i] < 0 || changed_inputs[i] >= %d) {@\n\
+    \        output->is_error = true;@\n\
+    \        return -1;@\n\
+    \    }@\n\
+    \    m_load_input(TGV, input, changed_inputs[i]);@\n\
+    \    int node = m_update_input_nodes[changed_inputs[i]];@\n\
+    \    if (node >= 0 && marks[node] != epoch) {@\n\
+    \        marks[node] = epoch;@\n\
+    \        reached[num_reached++] = node;@\n\
+    \    }@\n\
+     }@\n\
+     // Breadth-first traversal, reached doubles as the queue@\n\
+     for (int i = 0; i < num_reached; i++) {@\n\
+    \    int node = reached[i];@\n\
+    \    for (int j = m_update_succs_start[node];@\n\
+    \         j < m_update_succs_start[node + 1]; j++) {@\n\
+    \        int succ = m_update_succs[j];@\n\
+    \        if (marks[succ] != epoch) {@\n\
+    \            marks[succ] = epoch;@\n\
+    \            reached[num_reached++] = succ;@\n\
+    \        }@\n\
+    \    }@\n\
+     }@\n\
+     // The variables reached are computed again from their initial value@\n\
+     for (int i = 0; i < num_reached; i++) {@\n\
+    \    int var = reached[i] - M_UPDATE_NUM_UNITS;@\n\
+    \    if (var < 0) {@\n\
+    \        continue;@\n\
+    \    }@\n\
+    \    if (m_update_var_inputs[var] >= 0) {@\n\
+    \        m_load_input(TGV, input, m_update_var_inputs[var]);@\n\
+    \        continue;@\n\
+    \    }@\n\
+    \    for (int j = 0; j < m_update_var_sizes[var]; j++) {@\n\
+    \        TGV[m_update_var_offsets[var] + j] = m_undefined;@\n\
+    \    }@\n\
+     }@\n\
+     @\n\
+     %tm_value cond;@\n\
+     @\n\
+     %a@\n\
+     @\n"
+    generate_update_prototype false full_computation
+    (List.length input_vars)
+    (fun fmt ->
+      if !instrument then
+        let site, entity = prof_site_and_entity "m_update" in
+        Format.fprintf fmt
+          "m_prof *PROF = ctx->PROF;@\nm_prof_start(PROF, %d, %d);@\n@\n" site
+          entity)
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
+       (fun fmt (u, stmt) ->
+         Format.fprintf fmt "if (marks[%d] == epoch) {@\n@[<h 4>    %a@]@\n}" u
+           (generate_stmt program) stmt))
+    (List.mapi (fun u stmt -> (u, stmt)) (Array.to_list units));
+  generate_return true oc function_spec;
+  in_entry_point := false
+  [@@ocamlformat "disable"]
+
+let generate_par_function_signature (oc : Format.formatter)
+    (add_semicolon : bool) =
+  Format.fprintf oc
+    "int m_extracted_par(m_pool *pool, m_ctx *ctx, m_output *output,@\n\
+    \                    const m_input *input)%s"
+    (if add_semicolon then ";\n\n" else "")
+
+let generate_par_prototypes (oc : Format.formatter) () =
+  Format.fprintf oc
+    "// Computation on several threads (--parallel_rules): the rules that do@\n\
+     // not depend on each other run at the same time on the threads of a@\n\
+     // pool, with the same results as m_extracted_ctx. A pool serves one@\n\
+     // computation at a time.@\n\
+     typedef struct m_pool m_pool;@\n\
+     @\n\
+     // Pool of num_threads threads, counting the caller of m_extracted_par@\n\
+     m_pool *m_pool_new(int num_threads);@\n\
+     @\n\
+     void m_pool_free(m_pool *pool);@\n\
+     @\n\
+     %a"
+    generate_par_function_signature true
+
+(* The threads claim the chunks of a level from a single atomic word holding
+   the level and the next chunk to run, along with a sequence number so that a
+   thread late for a level cannot claim a chunk of the next one *)
+let par_pool_runtime =
+  {|#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+// Spins of an idle thread waiting for a level before it goes to sleep
+#ifndef M_POOL_SPINS
+#define M_POOL_SPINS 100000
+#endif
+
+#define M_WORK_CHUNK(work) ((int)((work)&0xFFFFF))
+#define M_WORK_LEVEL(work) ((int)(((work) >> 20) & 0xFFFFF))
+#define M_WORK_SEQ ((uint64_t)1 << 40)
+
+typedef struct m_pool_worker {
+    m_pool *pool;
+    m_value *LOCAL;
+    pthread_t thread;
+} m_pool_worker;
+
+struct m_pool {
+    int num_workers;
+    m_pool_worker *workers;
+    m_value *TGV;
+    _Atomic uint64_t work;
+    atomic_int done;
+    atomic_int sleeping;
+    atomic_bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+// Runs chunks of the current level until there is none left to claim, and
+// returns the value of pool->work then
+static uint64_t m_pool_help(m_pool *pool, m_value *LOCAL) {
+    uint64_t work = atomic_load_explicit(&pool->work, memory_order_acquire);
+    while (M_WORK_CHUNK(work) < m_par_level_sizes[M_WORK_LEVEL(work)]) {
+        if (atomic_compare_exchange_weak_explicit(&pool->work, &work, work + 1,
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            m_par_levels[M_WORK_LEVEL(work)][M_WORK_CHUNK(work)](pool->TGV,
+                                                                LOCAL);
+            atomic_fetch_add_explicit(&pool->done, 1, memory_order_release);
+            work = atomic_load_explicit(&pool->work, memory_order_acquire);
+        }
+    }
+    return work;
+}
+
+static void *m_pool_worker_main(void *arg) {
+    m_pool_worker *worker = arg;
+    m_pool *pool = worker->pool;
+    for (;;) {
+        uint64_t seen = m_pool_help(pool, worker->LOCAL);
+        int spins = 0;
+        while (atomic_load_explicit(&pool->work, memory_order_acquire) ==
+               seen) {
+            if (atomic_load_explicit(&pool->stop, memory_order_acquire)) {
+                return NULL;
+            }
+            if (++spins < M_POOL_SPINS) {
+                continue;
+            }
+            pthread_mutex_lock(&pool->lock);
+            atomic_fetch_add(&pool->sleeping, 1);
+            while (atomic_load(&pool->work) == seen &&
+                   !atomic_load(&pool->stop)) {
+                pthread_cond_wait(&pool->wake, &pool->lock);
+            }
+            atomic_fetch_sub(&pool->sleeping, 1);
+            pthread_mutex_unlock(&pool->lock);
+            spins = 0;
+        }
+    }
+}
+
+void m_pool_free(m_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->stop, true);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        free(pool->workers[i].LOCAL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->workers);
+    free(pool);
+}
+
+m_pool *m_pool_new(int num_threads) {
+    m_pool *pool = calloc(1, sizeof(m_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    int num_workers = num_threads > 1 ? num_threads - 1 : 0;
+    pool->workers = calloc(num_workers + 1, sizeof(m_pool_worker));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    // No chunk to claim until the first level
+    atomic_init(&pool->work, 0xFFFFF);
+    atomic_init(&pool->done, 0);
+    atomic_init(&pool->sleeping, 0);
+    atomic_init(&pool->stop, false);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    for (int i = 0; i < num_workers; i++) {
+        m_pool_worker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->LOCAL = m_alloc_slots(M_PAR_LOCALS_SIZE);
+        if (worker->LOCAL == NULL ||
+            pthread_create(&worker->thread, NULL, m_pool_worker_main,
+                           worker) != 0) {
+            free(worker->LOCAL);
+            m_pool_free(pool);
+            return NULL;
+        }
+        pool->num_workers = i + 1;
+    }
+    return pool;
+}
+
+// Returns once all the chunks of the level have run
+static void m_pool_run_level(m_pool *pool, int level, m_value *TGV,
+                             m_value *LOCAL) {
+    if (pool == NULL || pool->num_workers == 0) {
+        for (int i = 0; i < m_par_level_sizes[level]; i++) {
+            m_par_levels[level][i](TGV, LOCAL);
+        }
+        return;
+    }
+    pool->TGV = TGV;
+    atomic_store_explicit(&pool->done, 0, memory_order_relaxed);
+    uint64_t seq =
+        atomic_load_explicit(&pool->work, memory_order_relaxed) / M_WORK_SEQ;
+    atomic_store(&pool->work, (seq + 1) * M_WORK_SEQ | (uint64_t)level << 20);
+    if (atomic_load(&pool->sleeping) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    m_pool_help(pool, LOCAL);
+    // The chunks still running can belong to threads without a processor
+    for (int spins = 0;
+         atomic_load_explicit(&pool->done, memory_order_acquire) <
+         m_par_level_sizes[level];
+         spins++) {
+        if (spins >= M_POOL_SPINS) {
+            sched_yield();
+        }
+    }
+}
+
+|}
+
+(* The levels of [Bir_parallel] run by m_extracted_par, each of its chunks being
+   a function *)
+let generate_par_func (program : program)
+    (function_spec : Bir_interface.bir_function) (locals_size : int)
+    (oc : Format.formatter) (steps : Bir_parallel.step list) =
+  let levels =
+    List.filter_map
+      (function
+        | Bir_parallel.Parallel chunks -> Some chunks
+        | Bir_parallel.Sequential _ -> None)
+      steps
+  in
+  Format.fprintf oc
+    "typedef void (*m_par_chunk)(m_value *TGV, m_value *LOCAL);@\n@\n";
+  let _ =
+    List.fold_left
+      (fun (level, first_chunk) chunks ->
+        List.iteri
+          (fun i chunk ->
+            Format.fprintf oc
+              "static void m_par_chunk_%d(m_value *TGV, m_value *LOCAL) {@\n\
+               @[<h 4>    %a@]@\n\
+               }@\n\
+               @\n"
+              (first_chunk + i) (generate_stmts program) chunk)
+          chunks;
+        Format.fprintf oc
+          "static const m_par_chunk m_par_level_%d[%d] = {%a};@\n@\n" level
+          (List.length chunks)
+          (Format.pp_print_list
+             ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+             (fun fmt i -> Format.fprintf fmt "m_par_chunk_%d" i))
+          (List.init (List.length chunks) (fun i -> first_chunk + i));
+        (level + 1, first_chunk + List.length chunks))
+      (0, 0) levels
+  in
+  let num_levels = List.length levels in
+  Format.fprintf oc
+    "static const m_par_chunk *const m_par_levels[%d] = {%a};@\n\
+     %a\
+     #define M_PAR_LOCALS_SIZE %d@\n\
+     @\n\
+     %s"
+    (max 1 num_levels)
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+       Format.pp_print_string)
+    (if num_levels = 0 then [ "NULL" ]
+     else List.init num_levels (Printf.sprintf "m_par_level_%d"))
+    generate_int_array ("m_par_level_sizes", List.map List.length levels)
+    locals_size par_pool_runtime;
+  generate_entry_point_signature_and_var_decls generate_par_function_signature
+    "m_extracted_par" oc function_spec;
+  let _ =
+    List.fold_left
+      (fun level step ->
+        match step with
+        | Bir_parallel.Sequential stmts ->
+            Format.fprintf oc "%a@\n" (generate_stmts program) stmts;
+            level
+        | Bir_parallel.Parallel _ ->
+            Format.fprintf oc "m_pool_run_level(pool, %d, TGV, LOCAL);@\n"
+              level;
+            level + 1)
+      0 steps
+  in
+  generate_return true oc function_spec
+
+type specialization = {
+  spec_name : string;
+  spec_consts : expression Pos.marked VariableMap.t;
+  spec_program : program;
+}
+
+let generic_variant = "generic"
+
+(* The names of the profiles end up in C identifiers *)
+let get_variant_names (specializations : specialization list) : string list =
+  List.fold_left
+    (fun names s ->
+      let name =
+        String.map
+          (fun c ->
+            match c with 'a' .. 'z' | 'A' .. 'Z' | '0' .. '9' -> c | _ -> '_')
+          s.spec_name
+      in
+      if List.mem name (generic_variant :: names) then
+        Errors.raise_error
+          (Format.asprintf
+             "Cannot name a specialized variant %s: the name is already taken"
+             name);
+      name :: names)
+    [] specializations
+  |> List.rev
+
+let generate_computation (variant : string option) (oc : Format.formatter)
+    ((program, function_spec) : program * Bir_interface.bir_function) =
+  function_prefix :=
+    (match variant with None -> "" | Some variant -> variant ^ "_");
+  Format.fprintf oc "%a%a%a"
     (generate_rov_functions program) program.rules_and_verifs
     generate_mpp_functions program
-    (generate_main_function_signature_and_var_decls program
-       var_table_size) function_spec
+    (generate_main_function_signature_and_var_decls variant) function_spec;
+  in_entry_point := true;
+  Format.fprintf oc "%a%a"
     (generate_stmts program) (Bir.main_statements program)
-    generate_return function_spec;
+    (generate_return
+       (variant = None || variant = Some generic_variant)) function_spec;
+  in_entry_point := false;
+  function_prefix := ""
+  [@@ocamlformat "disable"]
+
+let generate_profile_test (oc : Format.formatter)
+    (consts : expression Pos.marked VariableMap.t) =
+  if VariableMap.is_empty consts then Format.fprintf oc "1"
+  else
+    Format.pp_print_list
+      ~pp_sep:(fun fmt () -> Format.fprintf fmt " &&@ ")
+      (fun fmt (var, e) ->
+        match Pos.unmark e with
+        | Literal (Float f) ->
+            Format.fprintf fmt
+              "!input->%s.undefined && input->%s.value == %.17g"
+              (generate_name var) (generate_name var) f
+        | Literal Undefined ->
+            Format.fprintf fmt "input->%s.undefined" (generate_name var)
+        | _ -> assert false (* constant inputs are checked to be literals *))
+      oc
+      (VariableMap.bindings consts)
+
+(* Calls the first variant whose fixed inputs have the values of the profile *)
+let generate_dispatcher (oc : Format.formatter)
+    (variants : (string * specialization) list) =
+  Format.fprintf oc
+    "%a {@\n\
+     @[<h 4>    %a@\n\
+     return %s(ctx, output, input);@]@\n\
+     }@\n\
+     @\n"
+    generate_main_ctx_function_signature false
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
+       (fun fmt (variant, s) ->
+         Format.fprintf fmt
+           "@[<hov 4>if (%a)@] {@\n    return %s(ctx, output, input);@\n}"
+           generate_profile_test s.spec_consts
+           (variant_function_name variant)))
+    variants
+    (variant_function_name generic_variant)
+  [@@ocamlformat "disable"]
+
+let generate_c_program ?(specializations : specialization list = [])
+    ?instrument:(instrument_calls : bool = false)
+    ?parallel:(parallel_rules : bool = false) (program : program)
+    (function_spec : Bir_interface.bir_function) (filename : string) : unit =
+  if Filename.extension filename <> ".c" then
+    Errors.raise_error
+      (Format.asprintf "Output file should have a .c extension (currently %s)"
+         filename);
+  instrument := instrument_calls;
+  prof_num_sites := 0;
+  Hashtbl.reset prof_entities;
+  let variants =
+    List.combine (get_variant_names specializations) specializations
+  in
+  let update_graph = Bir_incremental.create program in
+  let header_filename = Filename.remove_extension filename ^ ".h" in
+  let _oc = open_out header_filename in
+  let var_table_size = Bir.size_of_tgv () in
+  let oc = Format.formatter_of_out_channel _oc in
+  Format.fprintf oc "%a%a%a%a%a%a%a%a%a%a%a" generate_header ()
+    generate_io_prototypes function_spec
+    generate_ctx_prototypes () generate_prof_prototypes ()
+    generate_main_ctx_function_signature true
+    (Format.pp_print_list (fun fmt variant ->
+         generate_variant_function_signature variant fmt true))
+    (if variants = [] then [] else generic_variant :: List.map fst variants)
+    generate_update_doc () generate_update_prototype true
+    generate_main_function_signature true
+    (fun fmt () -> if parallel_rules then generate_par_prototypes fmt ()) ()
+    generate_footer ();
+  close_out _oc;
+  let _oc = open_out filename in
+  let oc = Format.formatter_of_out_channel _oc in
+  Format.fprintf oc "%a%a%a%a"
+    generate_implem_header header_filename
+    generate_io_funcs function_spec
+    generate_prof_runtime ()
+    (generate_ctx_funcs
+       (program :: List.map (fun s -> s.spec_program) specializations)
+       var_table_size (Bir_incremental.num_nodes update_graph)) function_spec;
+  if variants = [] then
+    generate_computation None oc (program, function_spec)
+  else begin
+    generate_computation (Some generic_variant) oc (program, function_spec);
+    List.iter
+      (fun (variant, s) ->
+        generate_computation (Some variant) oc (s.spec_program, function_spec))
+      variants;
+    generate_dispatcher oc variants
+  end;
+  (* m_update starts from a computation of the generic variant *)
+  let full_computation =
+    if variants = [] then None else Some generic_variant
+  in
+  function_prefix :=
+    (match full_computation with None -> "" | Some v -> v ^ "_");
+  generate_update_func program function_spec
+    (match full_computation with
+     | None -> "m_extracted_ctx"
+     | Some v -> variant_function_name v)
+    oc update_graph;
+  if parallel_rules then
+    generate_par_func program function_spec (get_locals_size program + 1) oc
+      (Bir_parallel.create program);
+  function_prefix := "";
+  Format.fprintf oc "%a%a@?" generate_prof_funcs ()
+    generate_main_function_wrapper ();
+  instrument := false;
   close_out _oc[@@ocamlformat "disable"]
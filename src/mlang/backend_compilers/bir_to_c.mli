@@ -14,5 +14,48 @@
    You should have received a copy of the GNU General Public License along with
    this program. If not, see <https://www.gnu.org/licenses/>. *)
 
+type specialization = {
+  spec_name : string;  (** Name of the profile, used in the C identifiers *)
+  spec_consts : Bir.expression Pos.marked Bir.VariableMap.t;
+      (** Values of the inputs fixed by the profile *)
+  spec_program : Bir.program;
+      (** The program optimized with these inputs replaced by their values *)
+}
+(** Variant of the computation specialized for a profile of inputs *)
+
 val generate_c_program :
-  Bir.program -> Bir_interface.bir_function -> (* filename *) string -> unit
+  ?specializations:specialization list ->
+  ?instrument:bool ->
+  ?parallel:bool ->
+  Bir.program ->
+  Bir_interface.bir_function ->
+  (* filename *) string ->
+  unit
+(** With [specializations], each variant gets its own
+    [m_extracted_ctx_<name>] function and [m_extracted_ctx] calls the first
+    one matching its inputs, falling back to [m_extracted_ctx_generic]. With
+    [instrument], the calls of the rules, verifications and mpp functions are
+    counted and timed in each context. With [parallel], [m_extracted_par] runs
+    the computation on a thread pool, following {!Bir_parallel.create}. *)
+
+(** {2 Helpers shared with the batched C backend} *)
+
+val generate_name : Bir.variable -> string
+(** Name of the field of [m_input] or [m_output] holding a variable *)
+
+val get_written_slots : Bir.program -> Bir_interface.bir_function -> int list
+(** Offsets of the TGV that a computation can write *)
+
+val generate_header : Format.formatter -> unit -> unit
+
+val generate_footer : Format.formatter -> unit -> unit
+
+val generate_implem_header : Format.formatter -> string -> unit
+
+val generate_io_prototypes :
+  Format.formatter -> Bir_interface.bir_function -> unit
+(** Declares [m_input], [m_output] and the helpers handling them, including
+    the [m_writer] streaming selected outputs to a file *)
+
+val generate_io_funcs : Format.formatter -> Bir_interface.bir_function -> unit
+(** Defines the helpers declared by {!generate_io_prototypes} *)
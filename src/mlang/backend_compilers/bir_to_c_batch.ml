@@ -0,0 +1,591 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(* The batched C backend computes [M_BATCH_SIZE] households at once. The TGV
+   is laid out as a structure of arrays: each variable owns a row of
+   [M_BATCH_SIZE] doubles in [TGV] and a row of definedness flags in [DEF],
+   undefined lanes holding [0.]. Each statement becomes a loop over the lanes
+   whose body is straight-line code, that the C compiler can vectorize.
+   Conditionals become masks: a statement only updates the lanes of its
+   mask. *)
+
+open Bir
+
+(* Value and definedness of an expression for the current lane [k] *)
+type lane_expr = { value : string; defined : string }
+
+let fresh_temp_counter = ref 0
+
+let fresh_temp () : int =
+  let n = !fresh_temp_counter in
+  fresh_temp_counter := n + 1;
+  n
+
+let generate_comp_op (op : Mast.comp_op) : string =
+  match op with
+  | Mast.Gt -> ">"
+  | Mast.Gte -> ">="
+  | Mast.Lt -> "<"
+  | Mast.Lte -> "<="
+  | Mast.Eq -> "=="
+  | Mast.Neq -> "!="
+
+let generate_lane (table : string) (var : variable) (index : string) : string =
+  Format.asprintf "%s[(%d/*%s*/%s) * M_BATCH_SIZE + k]" table var.offset
+    (Pos.unmark (var_to_mir var).Mir.Variable.name)
+    index
+
+let lane_of_var ?(index = "") (var : variable) : lane_expr =
+  {
+    value = generate_lane "TGV" var index;
+    defined = generate_lane "DEF" var index;
+  }
+
+(* The code computing the lanes of [e] is accumulated in [decls], in reverse
+   order, the definedness of a temporary being computed before its value *)
+let rec generate_lane_expr (mask : string)
+    (env : lane_expr Mir.LocalVariableMap.t) (decls : string list ref)
+    (e : expression Pos.marked) : lane_expr =
+  let bind ~(defined : string) (value : string -> string) : lane_expr =
+    let n = fresh_temp () in
+    let d = Format.asprintf "d%d" n in
+    let v = Format.asprintf "v%d" n in
+    decls :=
+      Format.asprintf "double %s = %s;" v (value d)
+      :: Format.asprintf "unsigned char %s = %s;" d defined
+      :: !decls;
+    { value = v; defined = d }
+  in
+  let gen = generate_lane_expr mask env decls in
+  match Pos.unmark e with
+  | Comparison (op, e1, e2) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" l1.defined l2.defined)
+        (fun d ->
+          Format.asprintf "(double)(%s & (%s %s %s))" d l1.value
+            (generate_comp_op (Pos.unmark op))
+            l2.value)
+  | Binop ((((Mast.Add | Mast.Sub) as op), _), e1, e2) ->
+      (* undefined lanes hold [0.] so that they can be added directly *)
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s | %s" l1.defined l2.defined)
+        (fun _ ->
+          Format.asprintf "%s %s %s" l1.value
+            (if op = Mast.Add then "+" else "-")
+            l2.value)
+  | Binop ((Mast.Mul, _), e1, e2) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" l1.defined l2.defined)
+        (fun d -> Format.asprintf "%s ? %s * %s : 0." d l1.value l2.value)
+  | Binop ((Mast.Div, _), e1, e2) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" l1.defined l2.defined)
+        (fun d ->
+          Format.asprintf "(%s & (%s != 0.)) ? %s / %s : 0." d l2.value
+            l1.value l2.value)
+  | Binop ((Mast.And, _), e1, e2) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" l1.defined l2.defined)
+        (fun d ->
+          Format.asprintf "(double)(%s & (%s != 0.) & (%s != 0.))" d l1.value
+            l2.value)
+  | Binop ((Mast.Or, _), e1, e2) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s | %s" l1.defined l2.defined)
+        (fun _ ->
+          Format.asprintf "(double)((%s != 0.) | (%s != 0.))" l1.value l2.value)
+  | Unop (Mast.Not, e) ->
+      let l = gen e in
+      bind ~defined:l.defined (fun d ->
+          Format.asprintf "(double)(%s & (%s == 0.))" d l.value)
+  | Unop (Mast.Minus, e) ->
+      let l = gen e in
+      bind ~defined:l.defined (fun d ->
+          Format.asprintf "%s ? -%s : 0." d l.value)
+  | Index (var, e) ->
+      let l = gen e in
+      let size =
+        Option.get (var_to_mir (Pos.unmark var)).Mir.Variable.is_table
+      in
+      let n = fresh_temp () in
+      decls :=
+        Format.asprintf "int i%d = in%d ? (int)%s : 0;" n n l.value
+        :: Format.asprintf
+             "unsigned char in%d = %s & (%s >= 0.) & (%s < %d.);" n l.defined
+             l.value l.value (size - 1)
+        :: !decls;
+      let cell =
+        lane_of_var ~index:(Format.asprintf " + i%d" n) (Pos.unmark var)
+      in
+      bind
+        ~defined:
+          (Format.asprintf "%s & ((%s < 0.) | (in%d & %s))" l.defined l.value n
+             cell.defined)
+        (fun _ -> Format.asprintf "in%d ? %s : 0." n cell.value)
+  | Conditional (e1, e2, e3) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      let l3 = gen e3 in
+      bind
+        ~defined:
+          (Format.asprintf "%s & ((%s != 0.) ? %s : %s)" l1.defined l1.value
+             l2.defined l3.defined)
+        (fun d ->
+          Format.asprintf "%s ? ((%s != 0.) ? %s : %s) : 0." d l1.value
+            l2.value l3.value)
+  | FunctionCall (PresentFunc, [ arg ]) ->
+      let l = gen arg in
+      bind ~defined:"1" (fun _ -> Format.asprintf "(double)%s" l.defined)
+  | FunctionCall (NullFunc, [ arg ]) ->
+      let l = gen arg in
+      bind ~defined:l.defined (fun d ->
+          Format.asprintf "(double)(%s & (%s == 0.))" d l.value)
+  | FunctionCall (ArrFunc, [ arg ]) ->
+      let l = gen arg in
+      bind ~defined:l.defined (fun d ->
+          Format.asprintf
+            "%s ? (double)(int64_t)(%s + (%s < 0. ? -0.50005 : 0.50005)) : 0." d
+            l.value l.value)
+  | FunctionCall (InfFunc, [ arg ]) ->
+      let l = gen arg in
+      bind ~defined:l.defined (fun d ->
+          Format.asprintf "%s ? floor(%s + 0.000001) : 0." d l.value)
+  | FunctionCall (MaxFunc, [ e1; e2 ]) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind ~defined:"1" (fun _ ->
+          Format.asprintf "fmax(%s, %s)" l1.value l2.value)
+  | FunctionCall (MinFunc, [ e1; e2 ]) ->
+      let l1 = gen e1 in
+      let l2 = gen e2 in
+      bind ~defined:"1" (fun _ ->
+          Format.asprintf "fmin(%s, %s)" l1.value l2.value)
+  | FunctionCall (Multimax, [ e1; (Var v2, _) ]) ->
+      let l1 = gen e1 in
+      bind ~defined:"1" (fun _ ->
+          Format.asprintf
+            "m_batch_multimax(%s[k] & !ctx->err[k], %s, %s, TGV + %d * \
+             M_BATCH_SIZE, k)"
+            mask l1.value l1.defined v2.offset)
+  | FunctionCall _ -> assert false (* should not happen *)
+  | Literal (Float f) -> { value = string_of_float f; defined = "1" }
+  | Literal Undefined -> { value = "0."; defined = "0" }
+  | Var var -> lane_of_var var
+  | LocalVar lvar -> Mir.LocalVariableMap.find lvar env
+  | Error -> assert false (* should not happen *)
+  | LocalLet (lvar, e1, e2) ->
+      let l1 = gen e1 in
+      generate_lane_expr mask (Mir.LocalVariableMap.add lvar l1 env) decls e2
+
+(* Loop over the lanes computing [e] before running [body] *)
+let generate_lane_loop (mask : string) (oc : Format.formatter)
+    (e : expression Pos.marked) (body : Format.formatter -> lane_expr -> unit)
+    =
+  let decls = ref [] in
+  let l = generate_lane_expr mask Mir.LocalVariableMap.empty decls e in
+  Format.fprintf oc
+    "for (int k = 0; k < M_BATCH_SIZE; k++) {@\n@[<h 4>    %a%a@]@\n}@\n"
+    (fun fmt decls ->
+      List.iter (fun decl -> Format.fprintf fmt "%s@\n" decl) (List.rev decls))
+    !decls body l
+
+let generate_masked_store (mask : string) (cell : lane_expr)
+    (oc : Format.formatter) (l : lane_expr) =
+  Format.fprintf oc "%s = %s[k] ? %s : %s;@\n%s = %s[k] ? %s : %s;" cell.value
+    mask l.value cell.value cell.defined mask l.defined cell.defined
+
+let generate_var_def (mask : string) (var : variable) (data : variable_data)
+    (oc : Format.formatter) : unit =
+  match data.var_definition with
+  | SimpleVar e ->
+      generate_lane_loop mask oc e
+        (generate_masked_store mask (lane_of_var var))
+  | TableVar (_, IndexTable es) ->
+      Mir.IndexMap.iter
+        (fun i e ->
+          generate_lane_loop mask oc e
+            (generate_masked_store mask
+               (lane_of_var ~index:(Format.asprintf " + %d" i) var)))
+        es
+  | TableVar (_size, IndexGeneric (v, e)) ->
+      let index = lane_of_var v in
+      generate_lane_loop mask oc e (fun fmt l ->
+          let cell = lane_of_var ~index:(" + (int)" ^ index.value) var in
+          Format.fprintf fmt
+            "if (%s[k] & %s & (%s != 0.)) {@\n\
+             @[<h 4>    %s = %s;@\n\
+             %s = %s;@]@\n\
+             }"
+            mask index.defined index.value cell.value l.value cell.defined
+            l.defined)
+  | InputVar -> assert false
+
+let generate_var_cond (mask : string) (cond : condition_data)
+    (oc : Format.formatter) =
+  if (fst cond.cond_error).typ = Mast.Anomaly then
+    let percent = Re.Pcre.regexp "%" in
+    generate_lane_loop mask oc cond.cond_expr (fun fmt l ->
+        Format.fprintf fmt
+          "if (%s[k] & !ctx->err[k] & %s & (%s != 0.)) {@\n\
+          \    printf(\"Error triggered: %a\\n\");@\n\
+          \    ctx->err[k] = 1;@\n\
+           }"
+          mask l.defined l.value
+          (fun fmt err ->
+            let error_descr = Mir.Error.err_descr_string err |> Pos.unmark in
+            let error_descr =
+              Re.Pcre.substitute ~rex:percent ~subst:(fun _ -> "%%") error_descr
+            in
+            Format.fprintf fmt "%s: %s" (Pos.unmark err.Mir.Error.name)
+              error_descr)
+          (fst cond.cond_error))
+
+let fresh_mask_counter = ref 0
+
+let rec generate_stmt (program : program) (mask : string)
+    (oc : Format.formatter) (stmt : stmt) =
+  match Pos.unmark stmt with
+  | SAssign (var, vdata) -> generate_var_def mask var vdata oc
+  | SConditional (cond, tt, ff) ->
+      let n = !fresh_mask_counter in
+      fresh_mask_counter := n + 1;
+      let mask_tt = Format.asprintf "mask_%d_true" n in
+      let mask_ff = Format.asprintf "mask_%d_false" n in
+      Format.fprintf oc
+        "{@\n\
+         @[<h 4>    unsigned char %s[M_BATCH_SIZE];@\n\
+         unsigned char %s[M_BATCH_SIZE];@\n\
+         %aif (m_batch_any(%s)) {@\n\
+         @[<h 4>    %a@]@\n\
+         }@\n\
+         if (m_batch_any(%s)) {@\n\
+         @[<h 4>    %a@]@\n\
+         }@]@\n\
+         }@\n"
+        mask_tt mask_ff
+        (fun fmt () ->
+          generate_lane_loop mask fmt (Pos.same_pos_as cond stmt) (fun fmt l ->
+              Format.fprintf fmt
+                "%s[k] = %s[k] & %s & (%s != 0.);@\n\
+                 %s[k] = %s[k] & %s & (%s == 0.);"
+                mask_tt mask l.defined l.value mask_ff mask l.defined l.value))
+        () mask_tt
+        (generate_stmts program mask_tt)
+        tt mask_ff
+        (generate_stmts program mask_ff)
+        ff
+  | SVerif v -> generate_var_cond mask v oc
+  | SRovCall r ->
+      let rov = ROVMap.find r program.rules_and_verifs in
+      Format.fprintf oc "%a(ctx, %s);@\n" generate_rov_function_name rov mask
+  | SFunctionCall (f, _) -> Format.fprintf oc "m_batch_%s(ctx, %s);@\n" f mask
+
+and generate_stmts (program : program) (mask : string) (oc : Format.formatter)
+    (stmts : stmt list) =
+  List.iter (generate_stmt program mask oc) stmts
+
+and generate_rov_function_name (oc : Format.formatter) (rov : rule_or_verif) =
+  Format.fprintf oc "m_batch_%s_%s"
+    (match rov.rov_code with Rule _ -> "rule" | Verif _ -> "verif")
+    (Pos.unmark rov.rov_name)
+
+let generate_function_header (oc : Format.formatter) (name : string) =
+  Format.fprintf oc
+    "static void %s(m_batch_ctx *ctx, const unsigned char *restrict mask)" name
+
+let generate_function (oc : Format.formatter) ((name : string), stmts) =
+  Format.fprintf oc
+    "%a {@\n\
+     @[<h 4>    double *restrict TGV = ctx->TGV;@\n\
+     unsigned char *restrict DEF = ctx->DEF;@\n\
+     (void)TGV;@\n\
+     (void)DEF;@\n\
+     %a@]@\n\
+     }@\n\
+     @\n"
+    generate_function_header name stmts ()
+
+let generate_functions (program : program) (oc : Format.formatter) () =
+  let functions =
+    (ROVMap.bindings program.rules_and_verifs
+    |> List.map (fun (_, rov) ->
+           ( Format.asprintf "%a" generate_rov_function_name rov,
+             Bir.rule_or_verif_as_statements rov )))
+    @ (Bir.FunctionMap.bindings
+         (Bir_interface.context_agnostic_mpp_functions program)
+      |> List.map (fun (f, { mppf_stmts; _ }) ->
+             (Format.asprintf "m_batch_%s" f, mppf_stmts)))
+    @ [ ("m_batch_main", Bir.main_statements program) ]
+  in
+  (* prototypes first, since functions call each other in any order *)
+  List.iter
+    (fun (name, _) -> Format.fprintf oc "%a;@\n" generate_function_header name)
+    functions;
+  Format.fprintf oc "@\n";
+  List.iter
+    (fun (name, stmts) ->
+      generate_function oc
+        (name, fun fmt () -> generate_stmts program "mask" fmt stmts))
+    functions
+
+let generate_batch_ctx_function_signature (oc : Format.formatter)
+    (add_semicolon : bool) =
+  Format.fprintf oc
+    "int m_extracted_batch_ctx(m_batch_ctx *ctx, int n, const m_input \
+     *inputs,@\n\
+    \                          m_output *outputs)%s"
+    (if add_semicolon then ";\n\n" else "")
+
+let generate_batch_function_signature (oc : Format.formatter)
+    (add_semicolon : bool) =
+  Format.fprintf oc
+    "int m_extracted_batch(int n, const m_input *inputs, m_output *outputs)%s"
+    (if add_semicolon then ";\n\n" else "")
+
+let generate_batch_prototypes (oc : Format.formatter) () =
+  Format.fprintf oc
+    "// Computation context holding the tables of a group of households, to@\n\
+     // be reused across calls to m_extracted_batch_ctx (one per thread).@\n\
+     // m_extracted_batch_ctx resets it before each group@\n\
+     typedef struct m_batch_ctx m_batch_ctx;@\n\
+     @\n\
+     m_batch_ctx *m_batch_ctx_new(void);@\n\
+     @\n\
+     void m_batch_ctx_reset(m_batch_ctx *ctx);@\n\
+     @\n\
+     void m_batch_ctx_free(m_batch_ctx *ctx);@\n\
+     @\n\
+     // Computes the n households of inputs at once with the tables of ctx,@\n\
+     // and returns the number of households whose computation raised an@\n\
+     // error@\n\
+     %a\
+     // Same as m_extracted_batch_ctx with a context allocated for the call,@\n\
+     // returns -1 if the memory needed could not be allocated@\n\
+     %a"
+    generate_batch_ctx_function_signature true
+    generate_batch_function_signature true
+
+let generate_batch_runtime (p : program) (var_table_size : int)
+    (oc : Format.formatter) (function_spec : Bir_interface.bir_function) =
+  let written_slots = Bir_to_c.get_written_slots p function_spec in
+  Format.fprintf oc
+    "#ifndef M_BATCH_SIZE@\n\
+     #define M_BATCH_SIZE 64@\n\
+     #endif@\n\
+     @\n\
+     struct m_batch_ctx {@\n\
+     @[<h 4>    double *TGV;@\n\
+     unsigned char *DEF;@\n\
+     unsigned char mask[M_BATCH_SIZE];@\n\
+     unsigned char err[M_BATCH_SIZE];@]@\n\
+     };@\n\
+     @\n\
+     // TGV rows that a computation can write, reset by m_batch_ctx_reset@\n\
+     static const int m_written_slots[%d] = {%a};@\n\
+     @\n\
+     static void *m_batch_alloc(size_t bytes) {@\n\
+     @[<h 4>    bytes = ((bytes + 63) / 64) * 64;@\n\
+     void *rows = aligned_alloc(64, bytes);@\n\
+     if (rows != NULL) {@\n\
+    \    memset(rows, 0, bytes);@\n\
+     }@\n\
+     return rows;@]@\n\
+     }@\n\
+     @\n\
+     void m_batch_ctx_free(m_batch_ctx *ctx) {@\n\
+     @[<h 4>    if (ctx == NULL) {@\n\
+    \    return;@\n\
+     }@\n\
+     free(ctx->TGV);@\n\
+     free(ctx->DEF);@\n\
+     free(ctx);@]@\n\
+     }@\n\
+     @\n\
+     m_batch_ctx *m_batch_ctx_new(void) {@\n\
+     @[<h 4>    m_batch_ctx *ctx = calloc(1, sizeof(m_batch_ctx));@\n\
+     if (ctx == NULL) {@\n\
+    \    return NULL;@\n\
+     }@\n\
+     ctx->TGV = m_batch_alloc(%d * M_BATCH_SIZE * sizeof(double));@\n\
+     ctx->DEF = m_batch_alloc(%d * M_BATCH_SIZE);@\n\
+     if (ctx->TGV == NULL || ctx->DEF == NULL) {@\n\
+    \    m_batch_ctx_free(ctx);@\n\
+    \    return NULL;@\n\
+     }@\n\
+     return ctx;@]@\n\
+     }@\n\
+     @\n\
+     void m_batch_ctx_reset(m_batch_ctx *ctx) {@\n\
+     @[<h 4>    for (int i = 0; i < %d; i++) {@\n\
+    \    int row = m_written_slots[i] * M_BATCH_SIZE;@\n\
+    \    memset(ctx->TGV + row, 0, M_BATCH_SIZE * sizeof(double));@\n\
+    \    memset(ctx->DEF + row, 0, M_BATCH_SIZE);@\n\
+     }@\n\
+     memset(ctx->err, 0, M_BATCH_SIZE);@]@\n\
+     }@\n\
+     @\n\
+     static inline int m_batch_any(const unsigned char *mask) {@\n\
+     @[<h 4>    unsigned char any = 0;@\n\
+     for (int k = 0; k < M_BATCH_SIZE; k++) {@\n\
+    \    any |= mask[k];@\n\
+     }@\n\
+     return any;@]@\n\
+     }@\n\
+     @\n\
+     static inline void m_batch_set(m_batch_ctx *ctx, int offset, int k, \
+     m_value v) {@\n\
+     @[<h 4>    ctx->TGV[offset * M_BATCH_SIZE + k] = v.undefined ? 0. : \
+     v.value;@\n\
+     ctx->DEF[offset * M_BATCH_SIZE + k] = !v.undefined;@]@\n\
+     }@\n\
+     @\n\
+     static inline m_value m_batch_get(const m_batch_ctx *ctx, int offset, int \
+     k) {@\n\
+     @[<h 4>    if (ctx->DEF[offset * M_BATCH_SIZE + k]) {@\n\
+    \    return m_literal(ctx->TGV[offset * M_BATCH_SIZE + k]);@\n\
+     }@\n\
+     return m_undefined;@]@\n\
+     }@\n\
+     @\n\
+     // Same as m_multimax, for the lane k of the rows starting at array@\n\
+     static double m_batch_multimax(int active, double bound, unsigned char \
+     bound_def, const double *array, int k) {@\n\
+     @[<h 4>    if (!active) {@\n\
+    \    return 0.;@\n\
+     }@\n\
+     if (!bound_def) {@\n\
+    \    printf(\"Multimax bound undefined!\");@\n\
+    \    exit(-1);@\n\
+     }@\n\
+     int max_index = floor(bound);@\n\
+     double max = array[k];@\n\
+     for (int i = 0; i <= max_index; i++) {@\n\
+    \    if (array[i * M_BATCH_SIZE + k] > max) {@\n\
+    \        max = array[i * M_BATCH_SIZE + k];@\n\
+    \    }@\n\
+     }@\n\
+     return max;@]@\n\
+     }@\n\
+     @\n"
+    (max 1 (List.length written_slots))
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt ", ")
+       Format.pp_print_int)
+    (if written_slots = [] then [ 0 ] else written_slots)
+    var_table_size var_table_size (List.length written_slots)
+
+let generate_batch_function (oc : Format.formatter)
+    (function_spec : Bir_interface.bir_function) =
+  let input_vars =
+    List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
+  in
+  let output_vars =
+    List.map fst (VariableMap.bindings function_spec.func_outputs)
+  in
+  Format.fprintf oc
+    "%a {@\n\
+     @[<h 4>    int errors = 0;@\n\
+     for (int start = 0; start < n; start += M_BATCH_SIZE) {@\n\
+     @[<h 4>    int count = n - start < M_BATCH_SIZE ? n - start : \
+     M_BATCH_SIZE;@\n\
+     m_batch_ctx_reset(ctx);@\n\
+     for (int k = 0; k < M_BATCH_SIZE; k++) {@\n\
+    \    ctx->mask[k] = k < count;@\n\
+     }@\n\
+     for (int k = 0; k < count; k++) {@\n\
+     @[<h 4>    const m_input *input = inputs + start + k;@\n\
+     %a@]@\n\
+     }@\n\
+     m_batch_main(ctx, ctx->mask);@\n\
+     for (int k = 0; k < count; k++) {@\n\
+     @[<h 4>    m_output *output = outputs + start + k;@\n\
+     output->is_error = ctx->err[k];@\n\
+     if (ctx->err[k]) {@\n\
+    \    errors++;@\n\
+    \    continue;@\n\
+     }@\n\
+     %a@]@\n\
+     }@]@\n\
+     }@\n\
+     return errors;@]@\n\
+     }@\n\
+     @\n\
+     %a {@\n\
+     @[<h 4>    m_batch_ctx *ctx = m_batch_ctx_new();@\n\
+     if (ctx == NULL) {@\n\
+    \    return -1;@\n\
+     }@\n\
+     int errors = m_extracted_batch_ctx(ctx, n, inputs, outputs);@\n\
+     m_batch_ctx_free(ctx);@\n\
+     return errors;@]@\n\
+     }@\n"
+    generate_batch_ctx_function_signature false
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
+       (fun fmt var ->
+         Format.fprintf fmt "m_batch_set(ctx, %d, k, input->%s);" var.offset
+           (Bir_to_c.generate_name var)))
+    input_vars
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt "@\n")
+       (fun fmt var ->
+         Format.fprintf fmt "output->%s = m_batch_get(ctx, %d, k);"
+           (Bir_to_c.generate_name var)
+           var.offset))
+    output_vars generate_batch_function_signature false
+
+let generate_implem_header (oc : Format.formatter) (header_filename : string) =
+  Bir_to_c.generate_implem_header oc header_filename;
+  Format.fprintf oc "#include <math.h>\n";
+  Format.fprintf oc "#include <stdint.h>\n";
+  Format.fprintf oc "#include <stdlib.h>\n\n"
+
+let generate_c_batch_program (program : program)
+    (function_spec : Bir_interface.bir_function) (filename : string) : unit =
+  if Filename.extension filename <> ".c" then
+    Errors.raise_error
+      (Format.asprintf "Output file should have a .c extension (currently %s)"
+         filename);
+  let header_filename = Filename.remove_extension filename ^ ".h" in
+  let _oc = open_out header_filename in
+  let var_table_size = Bir.size_of_tgv () in
+  let oc = Format.formatter_of_out_channel _oc in
+  Format.fprintf oc "%a%a%a%a" Bir_to_c.generate_header ()
+    Bir_to_c.generate_io_prototypes function_spec
+    generate_batch_prototypes ()
+    Bir_to_c.generate_footer ();
+  close_out _oc;
+  let _oc = open_out filename in
+  let oc = Format.formatter_of_out_channel _oc in
+  Format.fprintf oc "%a%a%a%a%a@."
+    generate_implem_header header_filename
+    Bir_to_c.generate_io_funcs function_spec
+    (generate_batch_runtime program var_table_size) function_spec
+    (generate_functions program) ()
+    generate_batch_function function_spec;
+  close_out _oc[@@ocamlformat "disable"]
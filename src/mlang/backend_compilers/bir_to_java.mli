@@ -16,3 +16,13 @@
 
 val generate_java_program :
   Bir.program -> Bir_interface.bir_function -> string -> unit
+
+val generate_var_name : Bir.variable -> string
+(** Upper case name of a variable, the key of the outputs *)
+
+val generate_name : Bir.variable -> string
+(** Alias of a variable, or its name if it has none, the key of the inputs *)
+
+val get_var_pos : Bir.variable -> int
+
+val print_double_cut : Format.formatter -> unit -> unit
@@ -0,0 +1,535 @@
+(* Copyright (C) 2021 Inria, contributor: James Barnes
+   <bureau.si-part-ircalcul@dgfip.finances.gouv.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(* Same semantics as {!Bir_to_java}, without any [MValue]: the values of the
+   variables are held in a [double[] tgv] and their definedness in a
+   [long[] def] bitset (see [MPrimitive.java]), and each operation is computed
+   into a pair of local variables, its value and its definedness, so that a
+   calculation allocates nothing. The helper classes are nested in the main
+   class, so that the files of both Java backends can live in the same
+   package. *)
+
+open Bir
+
+let java_imports : string =
+  {|
+package com.mlang;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.Map;
+
+import static com.mlang.MPrimitive.*;
+|}
+
+(* Value and definedness of an expression, either local variables or simple
+   Java expressions *)
+type primitive_expr = { value : string; defined : string }
+
+(* The temporaries are numbered across a whole method, since Java forbids a
+   block to redeclare a local variable of an enclosing block *)
+let fresh_temp_counter = ref 0
+
+let fresh_temp () : int =
+  let n = !fresh_temp_counter in
+  fresh_temp_counter := n + 1;
+  n
+
+let generate_comp_op (op : Mast.comp_op) : string =
+  match op with
+  | Mast.Gt -> ">"
+  | Mast.Gte -> ">="
+  | Mast.Lt -> "<"
+  | Mast.Lte -> "<="
+  | Mast.Eq -> "=="
+  | Mast.Neq -> "!="
+
+let get_tgv_position ?(index = 0) (var : variable) : string =
+  Format.asprintf "%d /* %s */"
+    (Bir_to_java.get_var_pos var + index)
+    (Bir_to_java.generate_var_name var)
+
+let primitive_of_var ?(index = 0) (var : variable) : primitive_expr =
+  {
+    value = Format.asprintf "tgv[%s]" (get_tgv_position ~index var);
+    defined =
+      Format.asprintf "isDefined(def, %s)" (get_tgv_position ~index var);
+  }
+
+(* The declarations computing [e] are accumulated in [decls], in reverse order,
+   the definedness of a temporary being declared before its value *)
+let rec generate_primitive_expr (env : primitive_expr Mir.LocalVariableMap.t)
+    (decls : string list ref) (e : expression Pos.marked) : primitive_expr =
+  let bind ~(defined : string) (value : string -> string) : primitive_expr =
+    let n = fresh_temp () in
+    let d = Format.asprintf "d%d" n in
+    let v = Format.asprintf "v%d" n in
+    decls :=
+      Format.asprintf "double %s = %s;" v (value d)
+      :: Format.asprintf "boolean %s = %s;" d defined
+      :: !decls;
+    { value = v; defined = d }
+  in
+  let gen = generate_primitive_expr env decls in
+  match Pos.unmark e with
+  | Comparison (op, e1, e2) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s && %s" p1.defined p2.defined)
+        (fun d ->
+          Format.asprintf "%s && %s %s %s ? 1. : 0." d p1.value
+            (generate_comp_op (Pos.unmark op))
+            p2.value)
+  | Binop ((((Mast.Add | Mast.Sub) as op), _), e1, e2) ->
+      (* undefined values are [0.] so that they can be added directly *)
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s || %s" p1.defined p2.defined)
+        (fun _ ->
+          Format.asprintf "%s %s %s" p1.value
+            (if op = Mast.Add then "+" else "-")
+            p2.value)
+  | Binop ((Mast.Mul, _), e1, e2) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s && %s" p1.defined p2.defined)
+        (fun d -> Format.asprintf "%s ? %s * %s : 0." d p1.value p2.value)
+  | Binop ((Mast.Div, _), e1, e2) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s && %s" p1.defined p2.defined)
+        (fun d ->
+          Format.asprintf "%s ? mDivide(%s, %s) : 0." d p1.value p2.value)
+  | Binop ((Mast.And, _), e1, e2) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s && %s" p1.defined p2.defined)
+        (fun d ->
+          Format.asprintf "%s && %s != 0. && %s != 0. ? 1. : 0." d p1.value
+            p2.value)
+  | Binop ((Mast.Or, _), e1, e2) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s || %s" p1.defined p2.defined)
+        (fun _ ->
+          Format.asprintf "%s != 0. || %s != 0. ? 1. : 0." p1.value p2.value)
+  | Unop (Mast.Not, e) ->
+      let p = gen e in
+      bind ~defined:p.defined (fun d ->
+          Format.asprintf "%s && %s == 0. ? 1. : 0." d p.value)
+  | Unop (Mast.Minus, e) ->
+      let p = gen e in
+      bind ~defined:p.defined (fun d ->
+          Format.asprintf "%s ? -(%s) : 0." d p.value)
+  | Index (var, e) ->
+      (* same cases as [m_array_index] of [MValue.java] *)
+      let p = gen e in
+      let var = Pos.unmark var in
+      let size = Option.get (var_to_mir var).Mir.Variable.is_table in
+      let n = fresh_temp () in
+      decls :=
+        Format.asprintf "int i%d = %s ? (int) Math.floor(%s) : 0;" n p.defined
+          p.value
+        :: !decls;
+      bind
+        ~defined:
+          (Format.asprintf
+             "%s && (i%d < 0 || i%d <= %d && isDefined(def, %s + i%d))"
+             p.defined n n size (get_tgv_position var) n)
+        (fun d ->
+          Format.asprintf "%s && i%d >= 0 ? tgv[%s + i%d] : 0." d n
+            (get_tgv_position var) n)
+  | Conditional (e1, e2, e3) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      let p3 = gen e3 in
+      bind
+        ~defined:
+          (Format.asprintf "%s && (%s != 0. ? %s : %s)" p1.defined p1.value
+             p2.defined p3.defined)
+        (fun d ->
+          Format.asprintf "%s ? (%s != 0. ? %s : %s) : 0." d p1.value p2.value
+            p3.value)
+  | FunctionCall (PresentFunc, [ arg ]) ->
+      let p = gen arg in
+      bind ~defined:"true" (fun _ -> Format.asprintf "%s ? 1. : 0." p.defined)
+  | FunctionCall (NullFunc, [ arg ]) ->
+      let p = gen arg in
+      bind ~defined:p.defined (fun d ->
+          Format.asprintf "%s && %s == 0. ? 1. : 0." d p.value)
+  | FunctionCall (ArrFunc, [ arg ]) ->
+      let p = gen arg in
+      bind ~defined:p.defined (fun d ->
+          Format.asprintf "%s ? mRound(%s) : 0." d p.value)
+  | FunctionCall (InfFunc, [ arg ]) ->
+      let p = gen arg in
+      bind ~defined:p.defined (fun d ->
+          Format.asprintf "%s ? mFloor(%s) : 0." d p.value)
+  | FunctionCall (MaxFunc, [ e1; e2 ]) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind ~defined:"true" (fun _ ->
+          Format.asprintf "Math.max(%s, %s)" p1.value p2.value)
+  | FunctionCall (MinFunc, [ e1; e2 ]) ->
+      let p1 = gen e1 in
+      let p2 = gen e2 in
+      bind ~defined:"true" (fun _ ->
+          Format.asprintf "Math.min(%s, %s)" p1.value p2.value)
+  | FunctionCall (Multimax, [ e1; (Var v2, _) ]) ->
+      let p1 = gen e1 in
+      bind ~defined:"true" (fun _ ->
+          Format.asprintf "mMultimax(%s, %s, tgv, %s)" p1.defined p1.value
+            (get_tgv_position v2))
+  | FunctionCall _ -> assert false (* should not happen *)
+  | Literal (Float f) -> { value = string_of_float f; defined = "true" }
+  | Literal Undefined -> { value = "0."; defined = "false" }
+  | Var var -> primitive_of_var var
+  | LocalVar lvar -> Mir.LocalVariableMap.find lvar env
+  | Error -> assert false (* should not happen *)
+  | LocalLet (lvar, e1, e2) ->
+      let p1 = gen e1 in
+      generate_primitive_expr (Mir.LocalVariableMap.add lvar p1 env) decls e2
+
+(* Statements computing [e] then [body], in a block if temporaries are
+   declared, so that the JIT knows where they die *)
+let generate_block (oc : Format.formatter) (e : expression Pos.marked)
+    (body : Format.formatter -> primitive_expr -> unit) =
+  let decls = ref [] in
+  let p = generate_primitive_expr Mir.LocalVariableMap.empty decls e in
+  if !decls = [] then body oc p
+  else
+    Format.fprintf oc "@[<v 2>{@,%a@,%a@]@,}"
+      (Format.pp_print_list Format.pp_print_string)
+      (List.rev !decls) body p
+
+let generate_store (position : string) (oc : Format.formatter)
+    (p : primitive_expr) =
+  Format.fprintf oc "set(tgv, def, %s, %s, %s);" position p.value p.defined
+
+let generate_var_def (var : variable) (data : variable_data)
+    (oc : Format.formatter) =
+  match data.var_definition with
+  | SimpleVar e -> generate_block oc e (generate_store (get_tgv_position var))
+  | TableVar (_, IndexTable es) ->
+      Format.pp_print_list
+        (fun fmt (i, e) ->
+          generate_block fmt e
+            (generate_store (get_tgv_position ~index:i var)))
+        oc (Mir.IndexMap.bindings es)
+  | TableVar (_size, IndexGeneric (v, e)) ->
+      let index = primitive_of_var v in
+      generate_block oc e (fun fmt p ->
+          Format.fprintf fmt
+            "@[<hv 2>if (%s) {@,set(tgv, def, %s + (int) %s, %s, %s);@]@,}"
+            index.defined (get_tgv_position var) index.value p.value p.defined)
+  | InputVar -> assert false
+
+let generate_var_cond (oc : Format.formatter) (cond : condition_data) =
+  let open Strings in
+  let cond_error, var = cond.cond_error in
+  let error_name = sanitize_str cond_error.Mir.Error.name in
+  let error_kind = sanitize_str cond_error.Mir.Error.descr.kind in
+  let error_major_code = sanitize_str cond_error.Mir.Error.descr.major_code in
+  let error_minor_code = sanitize_str cond_error.Mir.Error.descr.minor_code in
+  let error_description = sanitize_str cond_error.Mir.Error.descr.description in
+  let error_alias =
+    match var with
+    | Some v -> (
+        match (Bir.var_to_mir v).Mir.Variable.alias with
+        | Some alias -> "(( " ^ alias ^ " ))"
+        | None -> "")
+    | None -> ""
+  in
+  generate_block oc cond.cond_expr (fun fmt p ->
+      Format.fprintf fmt
+        "@[<v 2>if (%s && %s != 0.) {@,\
+         calc.calculationErrors.add(new MError(\"%s\", \"%s\", \"%s\", \
+         \"%s\", \"%s\", \"%s\"));"
+        p.defined p.value error_name error_kind error_major_code
+        error_minor_code error_description error_alias;
+      if cond_error.Mir.Error.typ = Anomaly then
+        Format.fprintf fmt
+          "@,\
+           calc.currentAnomalies++;@,\
+           @[<v 2>if (calc.currentAnomalies >= calc.maxAnomalies) {@,\
+           throw new MException(new \
+           ArrayList<MError>(calc.calculationErrors));@]@,\
+           }";
+      Format.fprintf fmt "@]@,}")
+
+let generate_rov_call (oc : Format.formatter) (rov : rule_or_verif) =
+  let tname = match rov.rov_code with Rule _ -> "rule" | Verif _ -> "verif" in
+  Format.fprintf oc "Rule.m_%s_%s(calc);" tname (Pos.unmark rov.rov_name)
+
+let rec generate_stmts (program : program) (oc : Format.formatter)
+    (stmts : stmt list) =
+  Format.pp_print_list (generate_stmt program) oc stmts
+
+and generate_stmt (program : program) (oc : Format.formatter) (stmt : stmt) :
+    unit =
+  match Pos.unmark stmt with
+  | SRovCall r ->
+      let rov = ROVMap.find r program.rules_and_verifs in
+      generate_rov_call oc rov
+  | SAssign (var, vdata) -> generate_var_def var vdata oc
+  | SConditional (cond, tt, ff) ->
+      let generate_branch fmt (test, stmts) =
+        if stmts <> [] then
+          Format.fprintf fmt "@,@[<v 2>if (%s) {@,%a@]@,}" test
+            (generate_stmts program) stmts
+      in
+      generate_block oc (Pos.same_pos_as cond stmt) (fun fmt p ->
+          Format.fprintf fmt "// condition %a%a%a" Pos.format_position_short
+            (Pos.get_position stmt) generate_branch
+            (Format.asprintf "%s && %s != 0." p.defined p.value, tt)
+            generate_branch
+            (Format.asprintf "%s && %s == 0." p.defined p.value, ff))
+  | SVerif v -> generate_var_cond oc v
+  | SFunctionCall (f, _) -> Format.fprintf oc "MppFunction.%s(calc);" f
+
+let generate_method (program : program) (oc : Format.formatter)
+    ((name : string), (stmts : stmt list)) =
+  fresh_temp_counter := 0;
+  Format.fprintf oc
+    "@[<v 2>static void %s(MPrimitiveCalculation calc) {@,\
+     double[] tgv = calc.tgv;@,\
+     long[] def = calc.def;@,\
+     %a@]@,\
+     }"
+    name (generate_stmts program) stmts
+
+let generate_rov_methods (oc : Format.formatter) (program : program) : unit =
+  let rovs = ROVMap.bindings program.rules_and_verifs in
+  Format.pp_print_list ~pp_sep:Bir_to_java.print_double_cut
+    (generate_method program) oc
+    (List.map
+       (fun (_, rov) ->
+         ( Format.asprintf "m_%s_%s"
+             (match rov.rov_code with Rule _ -> "rule" | Verif _ -> "verif")
+             (Pos.unmark rov.rov_name),
+           Bir.rule_or_verif_as_statements rov ))
+       rovs)
+
+let generate_mpp_functions (oc : Format.formatter) (program : program) =
+  let functions =
+    FunctionMap.bindings (Bir_interface.context_agnostic_mpp_functions program)
+  in
+  Format.pp_print_list ~pp_sep:Bir_to_java.print_double_cut
+    (generate_method program) oc
+    (List.map (fun (f, { mppf_stmts; _ }) -> (f, mppf_stmts)) functions)
+
+(* Copies between the arrays of the caller and the TGV, in methods of at most
+   [split_threshold] variables to stay below the size limit of Java methods *)
+let generate_copy_methods (oc : Format.formatter)
+    ((name : string), (vars : variable list), (split_threshold : int),
+     (print_copy : Format.formatter -> int * variable -> unit)) =
+  let rec split vars i current acc =
+    match vars with
+    | [] -> List.rev (if current = [] then acc else List.rev current :: acc)
+    | var :: tl ->
+        if List.length current >= split_threshold then
+          split tl (i + 1) [ (i, var) ] (List.rev current :: acc)
+        else split tl (i + 1) ((i, var) :: current) acc
+  in
+  let chunks = split vars 0 [] [] in
+  let signature =
+    "double[] tgv, long[] def, double[] values, boolean[] defined"
+  in
+  let print_method fmt (j, chunk) =
+    Format.fprintf fmt "@[<v 2>private static void %s_%d(%s) {@,%a@]@,}@,@,"
+      name j signature
+      (Format.pp_print_list print_copy)
+      chunk
+  in
+  List.iteri (fun j chunk -> print_method oc (j, chunk)) chunks;
+  Format.fprintf oc "@[<v 2>static void %s(%s) {%a@]@,}" name signature
+    (fun fmt () ->
+      List.iteri
+        (fun j _ ->
+          Format.fprintf fmt "@,%s_%d(tgv, def, values, defined);" name j)
+        chunks)
+    ()
+
+let generate_io_handler (function_spec : Bir_interface.bir_function)
+    (split_threshold : int) (oc : Format.formatter) () =
+  let inputs =
+    List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
+  in
+  let outputs =
+    List.map fst (VariableMap.bindings function_spec.func_outputs)
+  in
+  generate_copy_methods oc
+    ( "loadInputVariables",
+      inputs,
+      split_threshold,
+      fun fmt (i, var) ->
+        Format.fprintf fmt "set(tgv, def, %s, values[%d], defined[%d]);"
+          (get_tgv_position var) i i );
+  Format.fprintf oc "@,@,";
+  generate_copy_methods oc
+    ( "storeOutputVariables",
+      outputs,
+      split_threshold,
+      fun fmt (i, var) ->
+        let p = primitive_of_var var in
+        Format.fprintf fmt "values[%d] = %s;@,defined[%d] = %s;" i p.value i
+          p.defined )
+
+(* The names are split from a single constant, an array initializer being
+   compiled into one instruction per element in the static initializer *)
+let generate_names (oc : Format.formatter)
+    ((kind : string), (names : string list)) =
+  Format.fprintf oc
+    "private static final String[] %s_NAMES = %s;@,\
+     private static final Map<String, Integer> %s_INDEXES = \
+     indexNames(%s_NAMES);"
+    kind
+    (if names = [] then "new String[0]"
+    else Format.asprintf "\"%s\".split(\",\")" (String.concat "," names))
+    kind kind
+
+let generate_main_class (program : program) (var_table_size : int)
+    (split_threshold : int) (function_spec : Bir_interface.bir_function)
+    (fmt : Format.formatter) (class_name : string) =
+  let inputs =
+    List.map fst (VariableMap.bindings function_spec.func_variable_inputs)
+  in
+  let outputs =
+    List.map fst (VariableMap.bindings function_spec.func_outputs)
+  in
+  Format.fprintf fmt
+    "@[<v 2>public class %s {@,\
+     @,\
+     public static final int NUM_INPUTS = %d;@,\
+     public static final int NUM_OUTPUTS = %d;@,\
+     private static final int TGV_SIZE = %d;@,\
+     %a@,\
+     %a@,\
+     @,\
+     /**@,\
+    \ * @param name the name of an input variable@,\
+    \ * @return the index of the input in the arrays given to calculateTax, or \
+     -1 if it is not an input@,\
+    \ */@,\
+     @[<v 2>public static int getInputIndex(String name) {@,\
+     Integer index = INPUT_INDEXES.get(name);@,\
+     return index == null ? -1 : index;@]@,\
+     }@,\
+     @,\
+     @[<v 2>public static String getInputName(int index) {@,\
+     return INPUT_NAMES[index];@]@,\
+     }@,\
+     @,\
+     /**@,\
+    \ * @param name the name of an output variable@,\
+    \ * @return the index of the output in the arrays filled by calculateTax, \
+     or -1 if it is not an output@,\
+    \ */@,\
+     @[<v 2>public static int getOutputIndex(String name) {@,\
+     Integer index = OUTPUT_INDEXES.get(name);@,\
+     return index == null ? -1 : index;@]@,\
+     }@,\
+     @,\
+     @[<v 2>public static String getOutputName(int index) {@,\
+     return OUTPUT_NAMES[index];@]@,\
+     }@,\
+     @,\
+     /**@,\
+    \ * @param maxAnomalies max number of anomalies before a calculation \
+     throws an MException@,\
+    \ * @return the state of the calculations, to be reused by all the \
+     calculations of a thread@,\
+    \ */@,\
+     @[<v 2>public static MPrimitiveCalculation newCalculation(int \
+     maxAnomalies) {@,\
+     return new MPrimitiveCalculation(TGV_SIZE, maxAnomalies);@]@,\
+     }@,\
+     @,\
+     /**@,\
+    \ * Main calculation method for determining tax, allocating nothing unless \
+     anomalies occur@,\
+    \ * @param calc state of the calculations, from newCalculation@,\
+    \ * @param inputValues values of the inputs, by index@,\
+    \ * @param inputDefined whether each input is defined, an undefined input \
+     being ignored@,\
+    \ * @param outputValues filled with the values of the outputs, 0 if \
+     undefined@,\
+    \ * @param outputDefined filled with the definedness of the outputs@,\
+    \ * @return the anomalies that occurred, valid until the next calculation \
+     with calc@,\
+    \ */@,\
+     @[<v 2>public static List<MError> calculateTax(MPrimitiveCalculation \
+     calc, double[] inputValues, boolean[] inputDefined, double[] \
+     outputValues, boolean[] outputDefined) {@,\
+     calc.reset();@,\
+     double[] tgv = calc.tgv;@,\
+     long[] def = calc.def;@,\
+     IOHandler.loadInputVariables(tgv, def, inputValues, inputDefined);@,\
+     %a@,\
+     IOHandler.storeOutputVariables(tgv, def, outputValues, outputDefined);@,\
+     return calc.calculationErrors;@]@,\
+     }@,\
+     @,\
+     @[<v 2>private static final class IOHandler {@,\
+     %a@]@,\
+     }@,\
+     @,\
+     @[<v 2>private static final class MppFunction {@,\
+     %a@]@,\
+     }@,\
+     @,\
+     @[<v 2>private static final class Rule {@,\
+     %a@]@,\
+     }@]@,\
+     }"
+    class_name (List.length inputs) (List.length outputs) var_table_size
+    generate_names
+    ("INPUT", List.map Bir_to_java.generate_name inputs)
+    generate_names
+    ("OUTPUT", List.map Bir_to_java.generate_var_name outputs)
+    (fun fmt stmts ->
+      fresh_temp_counter := 0;
+      generate_stmts program fmt stmts)
+    (Bir.main_statements program)
+    (generate_io_handler function_spec split_threshold)
+    () generate_mpp_functions program generate_rov_methods program
+
+let generate_java_primitive_program (program : program)
+    (function_spec : Bir_interface.bir_function) (filename : string) : unit =
+  (* each operation takes more bytecode than with [MValue], so the methods get
+     fewer statements than with {!Bir_to_java} *)
+  let split_treshold = 50 in
+  let _oc = open_out filename in
+  let oc = Format.formatter_of_out_channel _oc in
+  let var_table_size = Bir.size_of_tgv () in
+  let program = Bir.squish_statements program split_treshold "java_rule_" in
+  let class_name =
+    Filename.basename filename |> String.split_on_char '.' |> List.hd
+  in
+  Format.fprintf oc
+    "@[<v 0>// %s@,%s@,/**@,\
+     \ * Main class containing calculation logic, on primitive arrays@,\
+     \ */@,%a@]@."
+    Prelude.message java_imports
+    (generate_main_class program var_table_size split_treshold function_spec)
+    class_name;
+  close_out _oc[@@ocamlformat "disable"]
@@ -0,0 +1,21 @@
+(* Copyright (C) 2021 Inria, contributor: James Barnes
+   <bureau.si-part-ircalcul@dgfip.finances.gouv.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+val generate_java_primitive_program :
+  Bir.program -> Bir_interface.bir_function -> string -> unit
+(** Same as {!Bir_to_java.generate_java_program}, but the generated class holds
+    the variables in primitive arrays and takes its inputs and outputs as arrays
+    indexed by variable, so that a calculation allocates nothing *)
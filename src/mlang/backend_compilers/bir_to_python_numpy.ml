@@ -0,0 +1,441 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(* The numpy backend computes many households at once, with the same layout as
+   the batched C backend: the TGV is a 2-D array [tgv] with a row per variable
+   and a column per household, and [df] is the array of the definedness flags,
+   undefined cells holding [0.]. A table is a block of consecutive rows. Each
+   statement is a few numpy operations over whole rows. Conditionals become
+   masks: a statement only updates the columns of its mask, and the branches
+   whose mask is empty are skipped. *)
+
+open Bir
+
+(* Value and definedness of an expression for all the households, either numpy
+   arrays or Python scalars *)
+type column_expr = { value : string; defined : string }
+
+(* Temporaries are numbered from 0 in each statement, so that the arrays of the
+   previous statements are released when their names are reused *)
+let fresh_temp_counter = ref 0
+
+let fresh_temp () : int =
+  let n = !fresh_temp_counter in
+  fresh_temp_counter := n + 1;
+  n
+
+let generate_comp_op (op : Mast.comp_op) : string =
+  match op with
+  | Mast.Gt -> ">"
+  | Mast.Gte -> ">="
+  | Mast.Lt -> "<"
+  | Mast.Lte -> "<="
+  | Mast.Eq -> "=="
+  | Mast.Neq -> "!="
+
+let column_of_var (var : variable) (index : int) : column_expr =
+  {
+    value = Format.asprintf "tgv[%d]" (var.offset + index);
+    defined = Format.asprintf "df[%d]" (var.offset + index);
+  }
+
+let table_size (var : variable) : int =
+  Option.get (var_to_mir var).Mir.Variable.is_table
+
+(* The code computing the columns of [e] is accumulated in [decls], in reverse
+   order, the definedness of a temporary being computed before its value *)
+let rec generate_column_expr (mask : string)
+    (env : column_expr Mir.LocalVariableMap.t) (decls : string list ref)
+    (e : expression Pos.marked) : column_expr =
+  let bind ~(defined : string) (value : string -> string) : column_expr =
+    let n = fresh_temp () in
+    let d = Format.asprintf "d%d" n in
+    let v = Format.asprintf "v%d" n in
+    decls :=
+      Format.asprintf "%s = %s" v (value d)
+      :: Format.asprintf "%s = %s" d defined
+      :: !decls;
+    { value = v; defined = d }
+  in
+  let gen = generate_column_expr mask env decls in
+  match Pos.unmark e with
+  | Comparison (op, e1, e2) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" c1.defined c2.defined)
+        (fun d ->
+          Format.asprintf "np.where(%s & (%s %s %s), 1., 0.)" d c1.value
+            (generate_comp_op (Pos.unmark op))
+            c2.value)
+  | Binop ((((Mast.Add | Mast.Sub) as op), _), e1, e2) ->
+      (* undefined cells hold [0.] so that they can be added directly *)
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s | %s" c1.defined c2.defined)
+        (fun _ ->
+          Format.asprintf "%s %s %s" c1.value
+            (if op = Mast.Add then "+" else "-")
+            c2.value)
+  | Binop ((Mast.Mul, _), e1, e2) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" c1.defined c2.defined)
+        (fun d ->
+          Format.asprintf "np.where(%s, %s * %s, 0.)" d c1.value c2.value)
+  | Binop ((Mast.Div, _), e1, e2) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" c1.defined c2.defined)
+        (fun d -> Format.asprintf "m_div(%s, %s, %s)" d c1.value c2.value)
+  | Binop ((Mast.And, _), e1, e2) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s & %s" c1.defined c2.defined)
+        (fun d ->
+          Format.asprintf "np.where(%s & (%s != 0.) & (%s != 0.), 1., 0.)" d
+            c1.value c2.value)
+  | Binop ((Mast.Or, _), e1, e2) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind
+        ~defined:(Format.asprintf "%s | %s" c1.defined c2.defined)
+        (fun _ ->
+          Format.asprintf "np.where((%s != 0.) | (%s != 0.), 1., 0.)" c1.value
+            c2.value)
+  | Unop (Mast.Not, e) ->
+      let c = gen e in
+      bind ~defined:c.defined (fun d ->
+          Format.asprintf "np.where(%s & (%s == 0.), 1., 0.)" d c.value)
+  | Unop (Mast.Minus, e) ->
+      let c = gen e in
+      bind ~defined:c.defined (fun d ->
+          Format.asprintf "np.where(%s, -(%s), 0.)" d c.value)
+  | Index (var, (Literal (Float f), _)) ->
+      (* same cases as [m_array_index], decided at compile time *)
+      let size = table_size (Pos.unmark var) in
+      if f < 0. then { value = "0."; defined = "True" }
+      else if f >= float_of_int (size - 1) then
+        { value = "0."; defined = "False" }
+      else column_of_var (Pos.unmark var) (int_of_float f)
+  | Index (var, e) ->
+      let c = gen e in
+      let var = Pos.unmark var in
+      let n = fresh_temp () in
+      decls :=
+        Format.asprintf "i%d = np.where(in%d, %s, 0.).astype(np.int64)" n n
+          c.value
+        :: Format.asprintf "in%d = %s & (%s >= 0.) & (%s < %d.)" n c.defined
+             c.value c.value
+             (table_size var - 1)
+        :: !decls;
+      bind
+        ~defined:
+          (Format.asprintf "%s & ((%s < 0.) | (in%d & df[%d + i%d, lanes]))"
+             c.defined c.value n var.offset n)
+        (fun _ ->
+          Format.asprintf "np.where(in%d, tgv[%d + i%d, lanes], 0.)" n
+            var.offset n)
+  | Conditional (e1, e2, e3) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      let c3 = gen e3 in
+      bind
+        ~defined:
+          (Format.asprintf "%s & np.where(%s != 0., %s, %s)" c1.defined
+             c1.value c2.defined c3.defined)
+        (fun d ->
+          Format.asprintf "np.where(%s, np.where(%s != 0., %s, %s), 0.)" d
+            c1.value c2.value c3.value)
+  | FunctionCall (PresentFunc, [ arg ]) ->
+      let c = gen arg in
+      bind ~defined:"True" (fun _ ->
+          Format.asprintf "np.where(%s, 1., 0.)" c.defined)
+  | FunctionCall (NullFunc, [ arg ]) ->
+      let c = gen arg in
+      bind ~defined:c.defined (fun d ->
+          Format.asprintf "np.where(%s & (%s == 0.), 1., 0.)" d c.value)
+  | FunctionCall (ArrFunc, [ arg ]) ->
+      let c = gen arg in
+      bind ~defined:c.defined (fun d ->
+          Format.asprintf
+            "np.where(%s, np.trunc(%s + np.where(%s < 0., -0.50005, 0.50005)), \
+             0.)"
+            d c.value c.value)
+  | FunctionCall (InfFunc, [ arg ]) ->
+      let c = gen arg in
+      bind ~defined:c.defined (fun d ->
+          Format.asprintf "np.where(%s, np.floor(%s + 0.000001), 0.)" d c.value)
+  | FunctionCall (MaxFunc, [ e1; e2 ]) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind ~defined:"True" (fun _ ->
+          Format.asprintf "np.fmax(%s, %s)" c1.value c2.value)
+  | FunctionCall (MinFunc, [ e1; e2 ]) ->
+      let c1 = gen e1 in
+      let c2 = gen e2 in
+      bind ~defined:"True" (fun _ ->
+          Format.asprintf "np.fmin(%s, %s)" c1.value c2.value)
+  | FunctionCall (Multimax, [ e1; (Var v2, _) ]) ->
+      let c1 = gen e1 in
+      bind ~defined:"True" (fun _ ->
+          Format.asprintf "m_multimax(%s & ~err, %s, %s, tgv[%d:%d])" mask
+            c1.value c1.defined v2.offset
+            (v2.offset + table_size v2))
+  | FunctionCall _ -> assert false (* should not happen *)
+  | Literal (Float f) -> { value = string_of_float f; defined = "True" }
+  | Literal Undefined -> { value = "0."; defined = "False" }
+  | Var var -> column_of_var var 0
+  | LocalVar lvar -> Mir.LocalVariableMap.find lvar env
+  | Error -> assert false (* should not happen *)
+  | LocalLet (lvar, e1, e2) ->
+      let c1 = gen e1 in
+      generate_column_expr mask (Mir.LocalVariableMap.add lvar c1 env) decls e2
+
+(* Lines computing [e], followed by [body] *)
+let generate_columns (mask : string) (oc : Format.formatter)
+    (e : expression Pos.marked)
+    (body : Format.formatter -> column_expr -> unit) =
+  fresh_temp_counter := 0;
+  let decls = ref [] in
+  let c = generate_column_expr mask Mir.LocalVariableMap.empty decls e in
+  Format.fprintf oc "%a%a@\n"
+    (fun fmt decls ->
+      List.iter (fun decl -> Format.fprintf fmt "%s@\n" decl) (List.rev decls))
+    !decls body c
+
+let generate_masked_store (mask : string) (cell : column_expr)
+    (oc : Format.formatter) (c : column_expr) =
+  Format.fprintf oc
+    "np.copyto(%s, %s, where=%s)@\nnp.copyto(%s, %s, where=%s)" cell.value
+    c.value mask cell.defined c.defined mask
+
+let generate_var_def (mask : string) (var : variable) (data : variable_data)
+    (oc : Format.formatter) : unit =
+  match data.var_definition with
+  | SimpleVar e ->
+      generate_columns mask oc e
+        (generate_masked_store mask (column_of_var var 0))
+  | TableVar (_, IndexTable es) ->
+      Mir.IndexMap.iter
+        (fun i e ->
+          generate_columns mask oc e
+            (generate_masked_store mask (column_of_var var i)))
+        es
+  | TableVar (_size, IndexGeneric (v, e)) ->
+      let index = column_of_var v 0 in
+      generate_columns mask oc e (fun fmt c ->
+          Format.fprintf fmt
+            "sel = %s & %s & (%s != 0.)@\n\
+             rows = %d + %s[sel].astype(np.int64)@\n\
+             tgv[rows, lanes[sel]] = np.broadcast_to(%s, lanes.shape)[sel]@\n\
+             df[rows, lanes[sel]] = np.broadcast_to(%s, lanes.shape)[sel]"
+            mask index.defined index.value var.offset index.value c.value
+            c.defined)
+  | InputVar -> assert false
+
+let generate_var_cond (mask : string) (cond : condition_data)
+    (oc : Format.formatter) =
+  if (fst cond.cond_error).typ = Mast.Anomaly then
+    generate_columns mask oc cond.cond_expr (fun fmt c ->
+        Format.fprintf fmt
+          "# Verification condition %a: %s@\nerr |= %s & %s & (%s != 0.)"
+          Pos.format_position_short
+          (Pos.get_position cond.cond_expr)
+          (Strings.sanitize_str (fst cond.cond_error).Mir.Error.name)
+          mask c.defined c.value)
+
+let fresh_mask_counter = ref 0
+
+let rec generate_stmt (program : program) (mask : string)
+    (oc : Format.formatter) (stmt : stmt) =
+  match Pos.unmark stmt with
+  | SAssign (var, vdata) -> generate_var_def mask var vdata oc
+  | SConditional (cond, tt, ff) ->
+      let n = !fresh_mask_counter in
+      fresh_mask_counter := n + 1;
+      let mask_tt = Format.asprintf "mask_%d_true" n in
+      let mask_ff = Format.asprintf "mask_%d_false" n in
+      let generate_branch fmt (branch_mask, stmts) =
+        if stmts <> [] then
+          Format.fprintf fmt "if %s.any():@\n@[<h 4>    %a@]@\n" branch_mask
+            (generate_stmts program branch_mask)
+            stmts
+      in
+      generate_columns mask oc (Pos.same_pos_as cond stmt) (fun fmt c ->
+          Format.fprintf fmt
+            "%s = %s & %s & (%s != 0.)@\n%s = %s & %s & (%s == 0.)" mask_tt
+            mask c.defined c.value mask_ff mask c.defined c.value);
+      Format.fprintf oc "%a%a" generate_branch (mask_tt, tt) generate_branch
+        (mask_ff, ff)
+  | SVerif v -> generate_var_cond mask v oc
+  | SRovCall r ->
+      let rov = ROVMap.find r program.rules_and_verifs in
+      Format.fprintf oc "%a(ctx, %s)@\n" generate_rov_function_name rov mask
+  | SFunctionCall (f, _) -> Format.fprintf oc "m_%s(ctx, %s)@\n" f mask
+
+and generate_stmts (program : program) (mask : string) (oc : Format.formatter)
+    (stmts : stmt list) =
+  List.iter (generate_stmt program mask oc) stmts
+
+and generate_rov_function_name (oc : Format.formatter) (rov : rule_or_verif) =
+  Format.fprintf oc "m_%s_%s"
+    (match rov.rov_code with Rule _ -> "rule" | Verif _ -> "verif")
+    (Pos.unmark rov.rov_name)
+
+let generate_function (program : program) (oc : Format.formatter)
+    ((name : string), stmts) =
+  Format.fprintf oc
+    "def %s(ctx, mask):@\n\
+     @[<h 4>    tgv = ctx.tgv@\n\
+     df = ctx.df@\n\
+     err = ctx.err@\n\
+     lanes = ctx.lanes@\n\
+     %a@]@\n\
+     @\n"
+    name (generate_stmts program "mask") stmts
+
+let generate_functions (program : program) (oc : Format.formatter) () =
+  let functions =
+    (ROVMap.bindings program.rules_and_verifs
+    |> List.map (fun (_, rov) ->
+           ( Format.asprintf "%a" generate_rov_function_name rov,
+             Bir.rule_or_verif_as_statements rov )))
+    @ (Bir.FunctionMap.bindings
+         (Bir_interface.context_agnostic_mpp_functions program)
+      |> List.map (fun (f, { mppf_stmts; _ }) -> ("m_" ^ f, mppf_stmts)))
+    @ [ ("m_main", Bir.main_statements program) ]
+  in
+  (* Python looks the functions up when they are called, so their order does
+     not matter *)
+  List.iter (generate_function program oc) functions
+
+let runtime =
+  {|import numpy as np
+
+
+def m_div(d, x, y):
+    ok = d & (y != 0.)
+    return np.where(ok, x / np.where(ok, y, 1.), 0.)
+
+
+def m_multimax(active, bound, bound_def, rows):
+    active = np.broadcast_to(active, rows.shape[1:])
+    if np.any(active & ~np.broadcast_to(bound_def, active.shape)):
+        raise ValueError("Multimax bound undefined!")
+    max_index = np.floor(np.where(active, bound, 0.))
+    i = np.arange(rows.shape[0])[:, np.newaxis]
+    res = np.max(np.where(i <= max_index, rows, -np.inf), axis=0)
+    return np.where(active, np.maximum(res, rows[0]), 0.)
+
+
+class Ctx:
+    """Variables of a chunk of households"""
+
+    def __init__(self, count):
+        self.count = count
+        self.tgv = np.zeros((TGV_SIZE, count))
+        self.df = np.zeros((TGV_SIZE, count), dtype=bool)
+        self.err = np.zeros(count, dtype=bool)
+        self.mask = np.ones(count, dtype=bool)
+        self.lanes = np.arange(count)
+
+    def reset(self):
+        self.tgv[WRITTEN_SLOTS] = 0.
+        self.df[WRITTEN_SLOTS] = False
+        self.err[:] = False
+
+
+|}
+
+let generate_tables (program : program) (oc : Format.formatter)
+    (function_spec : Bir_interface.bir_function) =
+  let offsets vars =
+    Format.pp_print_list
+      ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+      (fun fmt var ->
+        Format.fprintf fmt "(\"%s\", %d)" (Bir_to_c.generate_raw_name var)
+          var.offset)
+      oc
+      (List.map fst (VariableMap.bindings vars))
+  in
+  Format.fprintf oc "TGV_SIZE = %d@\n@\n" (Bir.size_of_tgv ());
+  Format.fprintf oc
+    "# Rows of the TGV that a computation can write, reset between chunks@\n\
+     WRITTEN_SLOTS = np.array([%a], dtype=np.int64)@\n\
+     @\n"
+    (Format.pp_print_list
+       ~pp_sep:(fun fmt () -> Format.fprintf fmt ",@ ")
+       Format.pp_print_int)
+    (Bir_to_c.get_written_slots program function_spec);
+  Format.fprintf oc "# Names and rows of the inputs and of the outputs@\n";
+  Format.fprintf oc "INPUTS = [@[<hov 0>";
+  offsets function_spec.func_variable_inputs;
+  Format.fprintf oc "@]]@\n@\nOUTPUTS = [@[<hov 0>";
+  offsets function_spec.func_outputs;
+  Format.fprintf oc "@]]@\n@\n@\n"
+
+let extracted_function =
+  {|def extracted(inputs, chunk_size=1024):
+    """Computes the households whose inputs are the columns of inputs, a
+    mapping from the names of the inputs (a pandas DataFrame works) to arrays
+    of the same length. A missing input or a NaN value is undefined. Returns
+    a dictionary of the columns of the outputs, NaN being an undefined value,
+    and of the column "is_error", telling whether the computation of a
+    household raised an error (its outputs are then all NaN). The households
+    are computed by chunks of chunk_size, the memory used being proportional to
+    it."""
+    columns = {name: (np.asarray(inputs[name], dtype=np.float64), row)
+               for (name, row) in INPUTS if name in inputs}
+    n = len(next(iter(columns.values()))[0]) if columns else 0
+    outputs = {name: np.full(n, np.nan) for (name, _) in OUTPUTS}
+    is_error = np.zeros(n, dtype=bool)
+    ctx = None
+    for start in range(0, n, chunk_size):
+        end = min(start + chunk_size, n)
+        if ctx is None or ctx.count != end - start:
+            ctx = Ctx(end - start)
+        else:
+            ctx.reset()
+        for (column, row) in columns.values():
+            values = column[start:end]
+            defined = ~np.isnan(values)
+            ctx.tgv[row] = np.where(defined, values, 0.)
+            ctx.df[row] = defined
+        m_main(ctx, ctx.mask)
+        is_error[start:end] = ctx.err
+        for (name, row) in OUTPUTS:
+            outputs[name][start:end] = np.where(ctx.df[row] & ~ctx.err,
+                                                ctx.tgv[row], np.nan)
+    outputs["is_error"] = is_error
+    return outputs
+|}
+
+let generate_python_numpy_program (program : program)
+    (function_spec : Bir_interface.bir_function) (filename : string) : unit =
+  fresh_mask_counter := 0;
+  let _oc = open_out filename in
+  let oc = Format.formatter_of_out_channel _oc in
+  Format.fprintf oc "# -*- coding: utf-8 -*-\n# %s\n\n%s%a%a%s@?"
+    Prelude.message runtime
+    (generate_tables program) function_spec
+    (generate_functions program) ()
+    extracted_function;
+  close_out _oc[@@ocamlformat "disable"]
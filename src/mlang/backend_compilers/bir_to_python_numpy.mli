@@ -0,0 +1,21 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+val generate_python_numpy_program :
+  Bir.program -> Bir_interface.bir_function -> (* filename *) string -> unit
+(** Same as {!Bir_to_python.generate_python_program}, but the generated
+    [extracted] computes whole columns of households with numpy, the same way
+    as {!Bir_to_c_batch} *)
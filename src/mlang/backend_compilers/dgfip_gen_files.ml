@@ -453,7 +453,8 @@ let gen_header fmt =
 
 |}
 
-(* Print a variable's description *)
+(* Print a variable's description, returns the name under which it can be
+   found *)
 let gen_var fmt req_type opt ~idx ~name ~tvar ~is_output ~typ_opt ~attributes
     ~desc ~alias_opt =
   let open Mast in
@@ -514,7 +515,8 @@ let gen_var fmt req_type opt ~idx ~name ~tvar ~is_output ~typ_opt ~attributes
     | Input _, Income -> Format.fprintf fmt ", \"%s\"" name
     | _ -> ()
   end;
-  Format.fprintf fmt " },\n"
+  Format.fprintf fmt " },\n";
+  var_name
 
 (* Check if a variable matches requested selection critaria *)
 let var_matches req_type var_type is_output =
@@ -526,7 +528,7 @@ let var_matches req_type var_type is_output =
   | Output -> is_output
   | Debug _i -> true
 
-(* Print the specified variable table *)
+(* Print the specified variable table, returns the names of its entries *)
 let gen_table fmt (flags : Dgfip_options.flags) vars req_type opt =
   gen_header fmt;
 
@@ -554,32 +556,38 @@ let gen_table fmt (flags : Dgfip_options.flags) vars req_type opt =
           table_name table_NAME
   end;
 
-  List.iter
-    (fun ( tvar,
-           idx1,
-           _idx2,
-           idxo_opt,
-           name,
-           alias_opt,
-           desc,
-           typ_opt,
-           attributes,
-           _size ) ->
-      let is_output = match idxo_opt with Some _ -> true | _ -> false in
-      if var_matches req_type tvar is_output then
-        match req_type with
-        | Debug _i ->
-            (* Special case for debug *)
-            let opt = { opt with with_alias = false } in
-            gen_var fmt req_type opt ~idx:idx1 ~name ~tvar ~is_output ~typ_opt
-              ~attributes ~desc ~alias_opt
-        | _ ->
-            (* General case*)
-            gen_var fmt req_type opt ~idx:idx1 ~name ~tvar ~is_output ~typ_opt
-              ~attributes ~desc ~alias_opt)
-    vars;
+  let names =
+    List.filter_map
+      (fun ( tvar,
+             idx1,
+             _idx2,
+             idxo_opt,
+             name,
+             alias_opt,
+             desc,
+             typ_opt,
+             attributes,
+             _size ) ->
+        let is_output = match idxo_opt with Some _ -> true | _ -> false in
+        if var_matches req_type tvar is_output then
+          match req_type with
+          | Debug _i ->
+              (* Special case for debug *)
+              let opt = { opt with with_alias = false } in
+              Some
+                (gen_var fmt req_type opt ~idx:idx1 ~name ~tvar ~is_output
+                   ~typ_opt ~attributes ~desc ~alias_opt)
+          | _ ->
+              (* General case*)
+              Some
+                (gen_var fmt req_type opt ~idx:idx1 ~name ~tvar ~is_output
+                   ~typ_opt ~attributes ~desc ~alias_opt)
+        else None)
+      vars
+  in
 
-  Format.fprintf fmt "};\n"
+  Format.fprintf fmt "};\n";
+  names
 
 let gen_desc fmt vars ~alias_only is_ebcdic =
   let vars = sort_vars_by_name vars is_ebcdic in
@@ -894,7 +902,8 @@ let gen_table_call fmt flags vars_debug rules chainings errors =
   gen_header fmt;
 
   if flags.Dgfip_options.flg_debug then begin
-    if flags.nb_debug_c <= 0 then gen_table_debug fmt flags vars_debug 0;
+    if flags.nb_debug_c <= 0 then
+      ignore (gen_table_debug fmt flags vars_debug 0);
 
     List.iter (fun rn -> Format.fprintf fmt "extern int regle_%d();\n" rn) rules;
 
@@ -1043,14 +1052,64 @@ let gen_var_h fmt flags vars vars_debug rules verifs chainings errors =
   if flags.flg_pro then
     Format.fprintf fmt "extern struct S_erreur *tabErreurs[];\n";
 
+  Format.fprintf fmt
+    "extern T_desc_var * cherche_desc_var_hash(const char *nom);\n";
+
   Format.fprintf fmt "#endif /* _VAR_ */\n"
 
-let gen_var_c fmt flags errors =
+(* Print the perfect hash of the names of the input and output variables used
+   by IRDATA_cherche_desc_var, [desc_tables] gives the names of the entries of
+   each table in order *)
+let gen_desc_hash fmt (desc_tables : (string * string list) list) =
+  let entries =
+    List.concat_map
+      (fun (table, names) -> List.mapi (fun i name -> (name, (table, i))) names)
+      desc_tables
+  in
+  let entries = Array.of_list entries in
+  let ph = Perfect_hash.create (Array.to_list (Array.map fst entries)) in
+  let print_ints fmt ints =
+    Array.iteri
+      (fun i v ->
+        Format.fprintf fmt "%s%d" (if i mod 16 = 0 then "\n  " else " ") v;
+        if i < Array.length ints - 1 then Format.fprintf fmt ",")
+      ints
+  in
+  Format.fprintf fmt "#include <stdint.h>\n\n";
+  if Array.length ph.slots = 0 then
+    Format.fprintf fmt
+      "T_desc_var * cherche_desc_var_hash(const char *nom) {\n\
+      \  return NULL;\n\
+       }\n\n"
+  else begin
+    Perfect_hash.generate_c_hash_function "desc_hash" fmt ();
+    Format.fprintf fmt "static const uint32_t desc_hash_seeds[%d] = {%a\n};\n\n"
+      (Array.length ph.seeds) print_ints ph.seeds;
+    Format.fprintf fmt "static T_desc_var * const desc_hash_vars[%d] = {\n"
+      (Array.length ph.slots);
+    Array.iter
+      (fun pos ->
+        let _, (table, i) = entries.(pos) in
+        Format.fprintf fmt "  (T_desc_var *)(desc_%s + %d),\n" table i)
+      ph.slots;
+    Format.fprintf fmt "};\n\n";
+    Format.fprintf fmt
+      "T_desc_var * cherche_desc_var_hash(const char *nom) {\n\
+      \  uint32_t seed = desc_hash_seeds[desc_hash(0, nom) %% %d];\n\
+      \  T_desc_var *desc = desc_hash_vars[desc_hash(seed, nom) %% %d];\n\
+      \  return strcmp(nom, desc->nom) == 0 ? desc : NULL;\n\
+       }\n\n"
+      (Array.length ph.seeds) (Array.length ph.slots)
+  end
+
+let gen_var_c fmt flags errors desc_tables =
   let open Mast in
   gen_header fmt;
 
   Format.fprintf fmt "#include \"var_static.c.inc\"\n\n";
 
+  gen_desc_hash fmt desc_tables;
+
   (* TODO before 2006, the format is slightly different *)
   List.iter
     (fun e ->
@@ -1222,31 +1281,31 @@ let generate_auxiliary_files flags prog cprog : Dgfip_varid.var_id_map =
   let vars = get_vars prog Dgfip_options.(flags.flg_tri_ebcdic) in
 
   let oc, fmt = open_file (Filename.concat folder "restitue.c") in
-  gen_table_output fmt flags vars;
+  let restituee_names = gen_table_output fmt flags vars in
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "contexte.c") in
-  gen_table_context fmt flags vars;
+  let contexte_names = gen_table_context fmt flags vars in
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "famille.c") in
-  gen_table_family fmt flags vars;
+  let famille_names = gen_table_family fmt flags vars in
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "revenu.c") in
-  gen_table_income fmt flags vars;
+  let revenu_names = gen_table_income fmt flags vars in
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "revcor.c") in
-  gen_table_corrincome fmt flags vars;
+  let revenu_correc_names = gen_table_corrincome fmt flags vars in
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "variatio.c") in
-  gen_table_variation fmt flags vars;
+  let variation_names = gen_table_variation fmt flags vars in
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "penalite.c") in
-  gen_table_penality fmt flags vars;
+  ignore (gen_table_penality fmt flags vars);
   close_out oc;
 
   let vars_debug = get_vars_debug vars Dgfip_options.(flags.flg_tri_ebcdic) in
@@ -1257,7 +1316,7 @@ let generate_auxiliary_files flags prog cprog : Dgfip_varid.var_id_map =
         (fun i vars ->
           let file = Printf.sprintf "tableg%02d.c" i in
           let oc, fmt = open_file (Filename.concat folder file) in
-          if flags.flg_debug then gen_table_debug fmt flags vars i
+          if flags.flg_debug then ignore (gen_table_debug fmt flags vars i)
           else gen_header fmt;
           close_out oc;
           i + 1)
@@ -1288,7 +1347,15 @@ let generate_auxiliary_files flags prog cprog : Dgfip_varid.var_id_map =
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "var.c") in
-  gen_var_c fmt flags errors;
+  gen_var_c fmt flags errors
+    [
+      ("contexte", contexte_names);
+      ("famille", famille_names);
+      ("revenu", revenu_names);
+      ("revenu_correc", revenu_correc_names);
+      ("variation", variation_names);
+      ("restituee", restituee_names);
+    ];
   close_out oc;
 
   let oc, fmt = open_file (Filename.concat folder "annee.h") in
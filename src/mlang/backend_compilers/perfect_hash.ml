@@ -0,0 +1,100 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+type t = { seeds : int array; slots : int array }
+
+(* OCaml integers have 63 bits, the products are truncated to the 32 bits of
+   the [uint32_t] of the generated code *)
+let mask32 = 0xFFFFFFFF
+
+let hash (seed : int) (key : string) : int =
+  let h = ref ((2166136261 lxor seed) land mask32) in
+  String.iter
+    (fun c -> h := (!h lxor Char.code c) * 16777619 land mask32)
+    key;
+  let h = !h in
+  let h = h lxor (h lsr 16) in
+  let h = h * 0x85ebca6b land mask32 in
+  let h = h lxor (h lsr 13) in
+  let h = h * 0xc2b2ae35 land mask32 in
+  h lxor (h lsr 16)
+
+(* Beyond this, the keys of a bucket are very likely to always collide *)
+let max_seed = 1 lsl 24
+
+let create (keys : string list) : t =
+  let seen = Hashtbl.create 1024 in
+  let distinct_keys =
+    List.fold_left
+      (fun (acc, pos) key ->
+        if Hashtbl.mem seen key then (acc, pos + 1)
+        else begin
+          Hashtbl.add seen key ();
+          ((key, pos) :: acc, pos + 1)
+        end)
+      ([], 0) keys
+    |> fst |> List.rev
+  in
+  let nb_keys = List.length distinct_keys in
+  (* Two keys per bucket on average *)
+  let nb_seeds = max 1 ((nb_keys + 1) / 2) in
+  let buckets = Array.make nb_seeds [] in
+  List.iter
+    (fun (key, pos) ->
+      let b = hash 0 key mod nb_seeds in
+      buckets.(b) <- (key, pos) :: buckets.(b))
+    distinct_keys;
+  let seeds = Array.make nb_seeds 0 in
+  let slots = Array.make nb_keys (-1) in
+  let rec place_bucket (b : int) (seed : int) =
+    if seed > max_seed then
+      Errors.raise_error "Unable to build a perfect hash of the variable names";
+    let bucket_slots =
+      List.map (fun (key, _) -> hash seed key mod nb_keys) buckets.(b)
+    in
+    if
+      List.length (List.sort_uniq compare bucket_slots)
+      = List.length bucket_slots
+      && List.for_all (fun s -> slots.(s) < 0) bucket_slots
+    then begin
+      seeds.(b) <- seed;
+      List.iter2 (fun s (_, pos) -> slots.(s) <- pos) bucket_slots buckets.(b)
+    end
+    else place_bucket b (seed + 1)
+  in
+  (* The largest buckets are placed first, while the table is still empty *)
+  List.init nb_seeds Fun.id
+  |> List.stable_sort (fun b1 b2 ->
+         compare (List.length buckets.(b2)) (List.length buckets.(b1)))
+  |> List.iter (fun b -> if buckets.(b) <> [] then place_bucket b 1);
+  { seeds; slots }
+
+let generate_c_hash_function (name : string) (oc : Format.formatter) () =
+  Format.fprintf oc
+    "static uint32_t %s(uint32_t seed, const char *key) {@\n\
+    \    uint32_t h = 2166136261u ^ seed;@\n\
+    \    for (; *key != '\\0'; key++) {@\n\
+    \        h = (h ^ (unsigned char)*key) * 16777619u;@\n\
+    \    }@\n\
+    \    h ^= h >> 16;@\n\
+    \    h *= 0x85ebca6bu;@\n\
+    \    h ^= h >> 13;@\n\
+    \    h *= 0xc2b2ae35u;@\n\
+    \    h ^= h >> 16;@\n\
+    \    return h;@\n\
+     }@\n\
+     @\n"
+    name
@@ -0,0 +1,42 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** Minimal perfect hashing of the variable names, so that the generated code
+    finds a name with two hashes and one string comparison.
+
+    The keys are spread into buckets by a first hash. Then each bucket, the
+    largest first, gets a seed for which a second hash sends its keys to free
+    slots of a table with one slot per key (hash and displace). A lookup
+    computes [slot = hash seeds.(hash 0 key mod nb_seeds) key mod nb_keys] and
+    compares the key with the one stored in the slot. *)
+
+type t = {
+  seeds : int array;  (** Seed of the second hash, for each bucket *)
+  slots : int array;
+      (** Position in the list of the keys of the key stored in each slot *)
+}
+
+val hash : int -> string -> int
+(** [hash seed key] is a 32-bit FNV-1a hash of [key] started from [seed],
+    followed by the finalizer of MurmurHash3 *)
+
+val create : string list -> t
+(** The keys appearing several times are stored once, at the position of their
+    first occurrence, and the table has one slot per distinct key *)
+
+val generate_c_hash_function : string -> Format.formatter -> unit -> unit
+(** [generate_c_hash_function name] prints the C definition of [hash], as a
+    static function called [name] *)
@@ -68,6 +68,13 @@ let allocate_variable (var : Mir.variable) : int =
 
 let size_of_tgv () = offset_alloc.size
 
+let get_offset_alloc () : offset_alloc =
+  { name_map = offset_alloc.name_map; size = offset_alloc.size }
+
+let set_offset_alloc (o : offset_alloc) : unit =
+  offset_alloc.name_map <- o.name_map;
+  offset_alloc.size <- o.size
+
 (* unify SSA variables *)
 let var_from_mir (on_tgv : tgv_id) (v : Mir.Variable.t) : variable =
   let mir_var = match v.origin with Some v -> v | None -> v in
@@ -70,6 +70,16 @@ val default_tgv : tgv_id
 
 val size_of_tgv : unit -> int
 
+type offset_alloc
+(** State of the allocator of the offsets of the variables in the TGV *)
+
+val get_offset_alloc : unit -> offset_alloc
+
+val set_offset_alloc : offset_alloc -> unit
+(** When a program is reloaded from disk, the offsets of its variables must be
+    known again, so that the TGV is sized for them and the variables allocated
+    afterwards do not overlap them *)
+
 val var_from_mir : tgv_id -> Mir.Variable.t -> variable
 
 val var_to_mir : variable -> Mir.Variable.t
@@ -0,0 +1,165 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+module IntMap = Map.Make (Int)
+
+type t = {
+  units : Bir.stmt array;
+  vars : Bir.variable array;
+  succs : int array array;
+}
+
+let rec flatten_function_calls (p : Bir.program) (stmts : Bir.stmt list) :
+    Bir.stmt list =
+  List.concat_map
+    (fun stmt ->
+      match Pos.unmark stmt with
+      | Bir.SFunctionCall (f, _) ->
+          flatten_function_calls p
+            (Bir.FunctionMap.find f p.mpp_functions).mppf_stmts
+      | _ -> [ stmt ])
+    stmts
+
+(* The variables are identified by their offset in the TGV, since it is what
+   the generated code reads and writes *)
+type accesses = {
+  reads : Bir.variable IntMap.t;
+  writes : Bir.variable IntMap.t;
+}
+
+let add_var (var : Bir.variable) (vars : Bir.variable IntMap.t) :
+    Bir.variable IntMap.t =
+  IntMap.add var.Bir.offset var vars
+
+let add_expr_reads (e : Bir.expression Pos.marked) (acc : accesses) : accesses =
+  {
+    acc with
+    reads =
+      Bir.VariableSet.fold add_var (Bir.get_used_variables e) acc.reads;
+  }
+
+let rec get_stmts_accesses (p : Bir.program) (acc : accesses)
+    (stmts : Bir.stmt list) : accesses =
+  List.fold_left (get_stmt_accesses p) acc stmts
+
+and get_stmt_accesses (p : Bir.program) (acc : accesses) (stmt : Bir.stmt) :
+    accesses =
+  match Pos.unmark stmt with
+  | Bir.SAssign (var, data) ->
+      let acc =
+        match data.Mir.var_definition with
+        | Mir.SimpleVar e -> add_expr_reads e acc
+        | Mir.TableVar (_, Mir.IndexTable es) ->
+            Mir.IndexMap.fold (fun _ e acc -> add_expr_reads e acc) es acc
+        | Mir.TableVar (_, Mir.IndexGeneric (v, e)) ->
+            add_expr_reads e { acc with reads = add_var v acc.reads }
+        | Mir.InputVar -> acc
+      in
+      { acc with writes = add_var var acc.writes }
+  | Bir.SConditional (e, t, f) ->
+      let acc = add_expr_reads (Pos.same_pos_as e stmt) acc in
+      get_stmts_accesses p (get_stmts_accesses p acc t) f
+  | Bir.SVerif cond -> add_expr_reads cond.Mir.cond_expr acc
+  | Bir.SRovCall r ->
+      get_stmts_accesses p acc
+        (Bir.rule_or_verif_as_statements
+           (Bir.ROVMap.find r p.rules_and_verifs))
+  | Bir.SFunctionCall (f, _) ->
+      get_stmts_accesses p acc
+        (Bir.FunctionMap.find f p.mpp_functions).mppf_stmts
+
+let get_units (p : Bir.program) : Bir.stmt array =
+  Array.of_list (flatten_function_calls p (Bir.main_statements p))
+
+let get_unit_accesses (p : Bir.program) (stmt : Bir.stmt) : int list * int list
+    =
+  let acc =
+    get_stmt_accesses p { reads = IntMap.empty; writes = IntMap.empty } stmt
+  in
+  ( List.map fst (IntMap.bindings acc.reads),
+    List.map fst (IntMap.bindings acc.writes) )
+
+let create (p : Bir.program) : t =
+  let units = get_units p in
+  let num_units = Array.length units in
+  let accesses =
+    Array.map
+      (get_stmt_accesses p { reads = IntMap.empty; writes = IntMap.empty })
+      units
+  in
+  let all_vars =
+    Array.fold_left
+      (fun vars acc ->
+        IntMap.fold IntMap.add acc.reads
+          (IntMap.fold IntMap.add acc.writes vars))
+      IntMap.empty accesses
+  in
+  let vars = Array.of_list (List.map snd (IntMap.bindings all_vars)) in
+  let var_nodes =
+    fst
+      (IntMap.fold
+         (fun offset _ (nodes, next) ->
+           (IntMap.add offset next nodes, next + 1))
+         all_vars (IntMap.empty, num_units))
+  in
+  let last_writers =
+    Array.fold_left
+      (fun (last_writers, u) acc ->
+        ( IntMap.fold (fun offset _ lw -> IntMap.add offset u lw) acc.writes
+            last_writers,
+          u + 1 ))
+      (IntMap.empty, 0) accesses
+    |> fst
+  in
+  let succs = Array.make (num_units + Array.length vars) [] in
+  let add_edge src dst = succs.(src) <- dst :: succs.(src) in
+  Array.iteri
+    (fun u acc ->
+      IntMap.iter
+        (fun offset _ ->
+          let v = IntMap.find offset var_nodes in
+          add_edge v u;
+          add_edge u v)
+        acc.writes;
+      IntMap.iter
+        (fun offset _ ->
+          let v = IntMap.find offset var_nodes in
+          add_edge v u;
+          match IntMap.find_opt offset last_writers with
+          | Some w when w >= u -> add_edge u v
+          | _ -> ())
+        acc.reads)
+    accesses;
+  {
+    units;
+    vars;
+    succs = Array.map (fun s -> Array.of_list (List.sort_uniq compare s)) succs;
+  }
+
+let var_node (g : t) (var : Bir.variable) : int option =
+  (* [g.vars] is sorted by offset *)
+  let rec search lo hi =
+    if lo >= hi then None
+    else
+      let mid = (lo + hi) / 2 in
+      let offset = g.vars.(mid).Bir.offset in
+      if offset = var.Bir.offset then Some (Array.length g.units + mid)
+      else if offset < var.Bir.offset then search (mid + 1) hi
+      else search lo mid
+  in
+  search 0 (Array.length g.vars)
+
+let num_nodes (g : t) : int = Array.length g.units + Array.length g.vars
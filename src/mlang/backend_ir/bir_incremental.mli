@@ -0,0 +1,56 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** Dependencies between the statements of a program, used to recompute only
+    the part of a previous computation affected by a change of its inputs.
+
+    The main function is cut into units: its statements, with the calls to mpp
+    functions replaced by their bodies. A rule call is a single unit. The nodes
+    of the graph are the units and the TGV variables they access. Starting from
+    the nodes of the changed inputs, the reachable units are the ones to
+    execute again, in the order of the program, and the reachable variables the
+    ones to reset to their initial value beforehand:
+
+    - the readers and the writers of a reset variable are executed again, so
+      that every value the variable took is computed again;
+    - the variables written by an executed unit are reset;
+    - a variable read by an executed unit and written at or after this unit is
+      reset, since the context holds its last value instead of the one the unit
+      has to read.
+
+    The units that are not reached read the same values as in the previous
+    computation, hence their effect on the context is still valid. *)
+
+type t = {
+  units : Bir.stmt array;  (** The units, in the order of the program *)
+  vars : Bir.variable array;
+      (** The variable of the node [Array.length units + i] is [vars.(i)] *)
+  succs : int array array;
+      (** Nodes reached from each node, units first and variables next *)
+}
+
+val create : Bir.program -> t
+
+val get_units : Bir.program -> Bir.stmt array
+(** The units of the main function, in the order of the program *)
+
+val get_unit_accesses : Bir.program -> Bir.stmt -> int list * int list
+(** Offsets of the TGV variables read and written by a unit *)
+
+val var_node : t -> Bir.variable -> int option
+(** Node of the TGV variable, if a unit accesses it *)
+
+val num_nodes : t -> int
@@ -20,93 +20,6 @@ module CodeLocationMap = Map.Make (struct
   let compare x y = compare x y
 end)
 
-type code_coverage_result =
-  Bir_interpreter.var_literal CodeLocationMap.t Bir.VariableMap.t
-(** The result of the code coverage measurement is a map of the successive
-    definitions of all the non-array variables during interpretation of the
-    program *)
-
-let empty_code_coverage_result : code_coverage_result = Bir.VariableMap.empty
-
-let code_coverage_acc : code_coverage_result ref =
-  ref empty_code_coverage_result
-
-let code_coverage_init () : unit =
-  code_coverage_acc := empty_code_coverage_result;
-  Bir_interpreter.assign_hook :=
-    fun var literal code_loc ->
-      code_coverage_acc :=
-        Bir.VariableMap.update var
-          (fun old_defs ->
-            match old_defs with
-            | None -> Some (CodeLocationMap.singleton code_loc (literal ()))
-            | Some old_defs ->
-                Some (CodeLocationMap.add code_loc (literal ()) old_defs))
-          !code_coverage_acc
-
-let code_coverage_result () : code_coverage_result = !code_coverage_acc
-
-module VarLiteralSet = Set.Make (struct
-  type t = Bir_interpreter.var_literal
-
-  let compare x y =
-    match (x, y) with
-    | Bir_interpreter.SimpleVar l1, Bir_interpreter.SimpleVar l2 ->
-        compare l1 l2
-    | Bir_interpreter.TableVar (size1, t1), Bir_interpreter.TableVar (size2, t2)
-      -> (
-        if size1 <> size2 then compare size1 size2
-        else
-          let different = ref None in
-          Array.iter2
-            (fun t1i t2i ->
-              if t1i = t2i then () else different := Some (compare t1i t2i))
-            t1 t2;
-          match !different with None -> 0 | Some i -> i)
-    | _ -> compare x y
-end)
-
-type code_coverage_map_value = VarLiteralSet.t
-
-type code_coverage_acc =
-  code_coverage_map_value CodeLocationMap.t Bir.VariableMap.t
-
-let merge_code_coverage_single_results_with_acc (results : code_coverage_result)
-    (acc : code_coverage_acc) : code_coverage_acc =
-  Bir.VariableMap.fold
-    (fun var (new_defs : Bir_interpreter.var_literal CodeLocationMap.t) acc ->
-      match Bir.VariableMap.find_opt var acc with
-      | None ->
-          Bir.VariableMap.add var
-            (CodeLocationMap.map (fun x -> VarLiteralSet.singleton x) new_defs)
-            acc
-      | Some old_defs ->
-          Bir.VariableMap.add var
-            (CodeLocationMap.fold
-               (fun code_loc new_def defs ->
-                 match CodeLocationMap.find_opt code_loc defs with
-                 | None ->
-                     CodeLocationMap.add code_loc
-                       (VarLiteralSet.singleton new_def)
-                       defs
-                 | Some old_def ->
-                     CodeLocationMap.add code_loc
-                       (VarLiteralSet.add new_def old_def)
-                       defs)
-               new_defs old_defs)
-            acc)
-    results acc
-
-let merge_code_coverage_acc (acc1 : code_coverage_acc)
-    (acc2 : code_coverage_acc) : code_coverage_acc =
-  Bir.VariableMap.union
-    (fun _ defs1 defs2 ->
-      Some
-        (CodeLocationMap.union
-           (fun _ def1 def2 -> Some (VarLiteralSet.union def1 def2))
-           defs1 defs2))
-    acc1 acc2
-
 type code_locs = Bir.variable CodeLocationMap.t
 
 let rec get_code_locs_stmt (p : Bir.program) (stmt : Bir.stmt)
@@ -145,3 +58,106 @@ and get_code_locs_stmts (p : Bir.program) (stmts : Bir.stmt list)
 
 let get_code_locs (p : Bir.program) : code_locs =
   get_code_locs_stmts p (Bir.main_statements p) []
+
+(* Code locations are numbered once, before the test runs are forked, so that
+   the numbers are the same in all the accumulators *)
+let code_loc_ids : (Bir_interpreter.code_location, int) Hashtbl.t =
+  Hashtbl.create 1
+
+let num_code_locs : int ref = ref 0
+
+let code_coverage_register_code_locs (locs : code_locs) : unit =
+  Hashtbl.reset code_loc_ids;
+  num_code_locs := 0;
+  CodeLocationMap.iter
+    (fun loc _ ->
+      Hashtbl.replace code_loc_ids loc !num_code_locs;
+      incr num_code_locs)
+    locs
+
+(* Values are only compared through their hash *)
+let hash_var_literal (l : Bir_interpreter.var_literal) : int =
+  Hashtbl.hash_param 256 256 l
+
+type code_coverage_result = (int * int) list
+(** The result of the code coverage measurement is, for each code location
+    executed during the interpretation of the program, the hash of the last
+    value assigned there *)
+
+let empty_code_coverage_result : code_coverage_result = []
+
+let run_hashes : int array ref = ref [||]
+
+let run_assigned : Bytes.t ref = ref Bytes.empty
+
+let run_locs : int list ref = ref []
+
+let code_coverage_init () : unit =
+  if Array.length !run_hashes <> !num_code_locs then begin
+    run_hashes := Array.make !num_code_locs 0;
+    run_assigned := Bytes.make !num_code_locs '\000'
+  end
+  else List.iter (fun id -> Bytes.set !run_assigned id '\000') !run_locs;
+  run_locs := [];
+  Bir_interpreter.assign_hook :=
+    fun _ literal code_loc ->
+      match Hashtbl.find_opt code_loc_ids code_loc with
+      | None -> ()
+      | Some id ->
+          if Bytes.get !run_assigned id = '\000' then begin
+            Bytes.set !run_assigned id '\001';
+            run_locs := id :: !run_locs
+          end;
+          !run_hashes.(id) <- hash_var_literal (literal ())
+
+let code_coverage_result () : code_coverage_result =
+  List.map (fun id -> (id, !run_hashes.(id))) !run_locs
+
+(* The report only distinguishes locations covered with zero, one, or two or
+   more values, so a few values per location are enough *)
+let max_distinct_values = 4
+
+type code_coverage_acc = {
+  num_values : int array;
+      (** Number of distinct values seen at each code location, capped at
+          [max_distinct_values] *)
+  values : int array;
+      (** The hashes of these values, [max_distinct_values] slots per code
+          location *)
+}
+
+let empty_code_coverage_acc () : code_coverage_acc =
+  {
+    num_values = Array.make !num_code_locs 0;
+    values = Array.make (!num_code_locs * max_distinct_values) 0;
+  }
+
+let add_value (acc : code_coverage_acc) (id : int) (hash : int) : unit =
+  let n = acc.num_values.(id) in
+  let base = id * max_distinct_values in
+  let rec mem i = i < n && (acc.values.(base + i) = hash || mem (i + 1)) in
+  if n < max_distinct_values && not (mem 0) then begin
+    acc.values.(base + n) <- hash;
+    acc.num_values.(id) <- n + 1
+  end
+
+let merge_code_coverage_single_results_with_acc (results : code_coverage_result)
+    (acc : code_coverage_acc) : code_coverage_acc =
+  List.iter (fun (id, hash) -> add_value acc id hash) results;
+  acc
+
+let merge_code_coverage_acc (acc1 : code_coverage_acc)
+    (acc2 : code_coverage_acc) : code_coverage_acc =
+  Array.iteri
+    (fun id n ->
+      for i = 0 to n - 1 do
+        add_value acc1 id acc2.values.((id * max_distinct_values) + i)
+      done)
+    acc2.num_values;
+  acc1
+
+let code_coverage_num_values (acc : code_coverage_acc)
+    (loc : Bir_interpreter.code_location) : int =
+  match Hashtbl.find_opt code_loc_ids loc with
+  | Some id when id < Array.length acc.num_values -> acc.num_values.(id)
+  | _ -> 0
@@ -16,14 +16,25 @@
 
 (** Instrumentation of the interpreter to computer code coverage *)
 
-(** {1 Code coverage for a single run}*)
+(** {1 Code locations}*)
 
 module CodeLocationMap : Map.S with type key = Bir_interpreter.code_location
 
-type code_coverage_result =
-  Bir_interpreter.var_literal CodeLocationMap.t Bir.VariableMap.t
-(** For each variable, and for each code location where it is assigned, we
-    record the value it has been assigned to during an interpreter run *)
+type code_locs = Bir.variable CodeLocationMap.t
+
+val get_code_locs : Bir.program -> code_locs
+(** Returns all code locations in a program *)
+
+val code_coverage_register_code_locs : code_locs -> unit
+(** Gives an integer identifier to each code location, which the code coverage
+    is then recorded against. This has to be done before the runs, and before
+    forking the processes whose results will be merged. *)
+
+(** {1 Code coverage for a single run}*)
+
+type code_coverage_result
+(** For each code location executed during an interpreter run, we record the
+    value it has been assigned to *)
 
 val empty_code_coverage_result : code_coverage_result
 
@@ -40,28 +51,25 @@ val code_coverage_result : unit -> code_coverage_result
 (** Code coverage is best measured for multiple runs of the interpreter on a set
     of test files. *)
 
-module VarLiteralSet : Set.S with type elt = Bir_interpreter.var_literal
-
-type code_coverage_map_value = VarLiteralSet.t
+type code_coverage_acc
+(** The accumulated coverage counts, for each code location, the distinct values
+    assigned there in the test runs so far, up to a small cap. It is stored in
+    flat arrays indexed by the identifiers of the code locations. *)
 
-type code_coverage_acc =
-  code_coverage_map_value CodeLocationMap.t Bir.VariableMap.t
-(** The accumulated coverage is the set of distinct values a particular variable
-    assignment has received in the tests runs so far *)
+val empty_code_coverage_acc : unit -> code_coverage_acc
 
 val merge_code_coverage_single_results_with_acc :
   code_coverage_result -> code_coverage_acc -> code_coverage_acc
 (** [merge_code_coverage_single_results_with_acc result acc] merges the code
-    coverage results of a single run [result] with the accumulated results over
-    the tests so far [acc] *)
+    coverage results of a single run [result] into the accumulated results over
+    the tests so far [acc], which is updated in place and returned *)
 
 val merge_code_coverage_acc :
   code_coverage_acc -> code_coverage_acc -> code_coverage_acc
-(** Merges two partial code coverage accumulator into a single, bigger one *)
-
-(** {1 Code locations}*)
+(** [merge_code_coverage_acc acc1 acc2] merges [acc2] into [acc1], which is
+    updated in place and returned *)
 
-type code_locs = Bir.variable CodeLocationMap.t
-
-val get_code_locs : Bir.program -> code_locs
-(** Returns all code locations in a program *)
+val code_coverage_num_values :
+  code_coverage_acc -> Bir_interpreter.code_location -> int
+(** Number of distinct values assigned at a code location, [0] if it has not
+    been covered. Numbers above a small cap are reported as the cap. *)
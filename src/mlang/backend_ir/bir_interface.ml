@@ -230,6 +230,38 @@ let read_function_from_spec (p : Bir.program) (spec_file : string) :
       Errors.raise_spanned_error "Error while parsing the m_spec file"
         (Parse_utils.mk_position (filebuf.lex_start_p, filebuf.lex_curr_p))
 
+let specialize_function (p : Bir.program) (f : bir_function)
+    (profile_file : string) :
+    Bir.expression Pos.marked Bir.VariableMap.t * bir_function =
+  let profile = read_function_from_spec p profile_file in
+  let consts =
+    Bir.VariableMap.fold
+      (fun var e acc ->
+        match
+          Bir.VariableMap.choose_opt
+            (Bir.VariableMap.filter
+               (fun input () -> input.Bir.offset = var.Bir.offset)
+               f.func_variable_inputs)
+        with
+        | Some (input, ()) -> Bir.VariableMap.add input e acc
+        | None ->
+            Errors.raise_spanned_error
+              (Format.asprintf
+                 "%s is fixed by the profile but is not an input of the \
+                  function"
+                 (Pos.unmark (Bir.var_to_mir var).Mir.Variable.name))
+              (Pos.get_position e))
+      profile.func_constant_inputs Bir.VariableMap.empty
+  in
+  ( consts,
+    {
+      f with
+      func_constant_inputs =
+        Bir.VariableMap.union
+          (fun _ _ e -> Some e)
+          f.func_constant_inputs consts;
+    } )
+
 let read_inputs_from_stdin (f : bir_function) : Mir.literal Bir.VariableMap.t =
   if Bir.VariableMap.cardinal f.func_variable_inputs > 0 then
     Cli.result_print "Enter the input values of the program:";
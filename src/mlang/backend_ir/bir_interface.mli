@@ -40,6 +40,15 @@ val read_function_from_spec : Bir.program -> string -> bir_function
 (** [read_function_from_spec program spec_file] reads and parses [spec_file] and
     extracts all the inputs, outputs and conditions from it. *)
 
+val specialize_function :
+  Bir.program ->
+  bir_function ->
+  string ->
+  Bir.expression Pos.marked Bir.VariableMap.t * bir_function
+(** [specialize_function program f profile_file] reads the [const] section of
+    [profile_file], whose variables must be inputs of [f]. It returns these
+    constants and [f] where they are added to the constant inputs. *)
+
 val read_inputs_from_stdin : bir_function -> Mir.literal Bir.VariableMap.t
 (** Given an input-output specification, prompts the user on [stdin] for the
     values of the inputs and returns them as a map *)
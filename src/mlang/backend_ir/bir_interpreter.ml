@@ -47,6 +47,8 @@ let exit_on_rte = ref true
 
 let repl_debug = ref false
 
+let compile_to_closures = ref false
+
 module type S = sig
   type custom_float
 
@@ -61,13 +63,18 @@ module type S = sig
   val format_var_value_with_var :
     Format.formatter -> Bir.variable * var_value -> unit
 
-  type ctx = {
-    ctx_local_vars : value Pos.marked Mir.LocalVariableMap.t;
-    ctx_vars : var_value Bir.VariableMap.t;
-  }
+  type ctx = { ctx_local_vars : value array; ctx_tgv : value array }
 
   val empty_ctx : ctx
 
+  val ctx_of_program : Bir.program -> ctx
+
+  val copy_ctx : ctx -> ctx
+
+  val get_var_value : ctx -> Bir.variable -> var_value
+
+  val set_var_value : ctx -> Bir.variable -> var_value -> unit
+
   val literal_to_value : Mir.literal -> value
 
   val var_literal_to_var_value : var_literal -> var_value
@@ -96,6 +103,17 @@ module type S = sig
     Mir.program -> Mir.VariableDict.t -> Mir.program
 
   val raise_runtime_as_structured : run_error -> ctx -> Mir.program -> 'a
+
+  val compile_program : Bir.program -> int -> ctx -> unit
+
+  type prepared_program
+
+  val prepare_program : Bir.program -> int -> prepared_program
+
+  val ctx_of_prepared_program : prepared_program -> ctx
+
+  val run_prepared_program :
+    ?conds:Bir.stmt list -> prepared_program -> ctx -> unit
 end
 
 module Make (N : Bir_number.NumberInterface) = struct
@@ -156,17 +174,36 @@ module Make (N : Bir_number.NumberInterface) = struct
             Format.fprintf fmt "| %d -> %a\n" idx format_value value)
           (Array.to_list values)
 
-  type ctx = {
-    ctx_local_vars : value Pos.marked Mir.LocalVariableMap.t;
-    ctx_vars : var_value Bir.VariableMap.t;
-  }
+  (* The TGV is a flat array indexed by [Bir.variable.offset], tables
+     occupying as many consecutive slots as their size. Local variables are
+     indexed by their [Mir.LocalVariable.id]. *)
+  type ctx = { ctx_local_vars : value array; ctx_tgv : value array }
+
+  let empty_ctx : ctx = { ctx_local_vars = [||]; ctx_tgv = [||] }
 
-  let empty_ctx : ctx =
+  let ctx_of_program (p : Bir.program) : ctx =
     {
-      ctx_local_vars = Mir.LocalVariableMap.empty;
-      ctx_vars = Bir.VariableMap.empty;
+      ctx_local_vars = Array.make (Bir.get_locals_size p + 1) Undefined;
+      ctx_tgv = Array.make (Bir.size_of_tgv ()) Undefined;
     }
 
+  let copy_ctx (ctx : ctx) : ctx =
+    {
+      ctx_local_vars = Array.copy ctx.ctx_local_vars;
+      ctx_tgv = Array.copy ctx.ctx_tgv;
+    }
+
+  let get_var_value (ctx : ctx) (var : Bir.variable) : var_value =
+    match (Bir.var_to_mir var).Mir.Variable.is_table with
+    | Some size -> TableVar (size, Array.sub ctx.ctx_tgv var.Bir.offset size)
+    | None -> SimpleVar ctx.ctx_tgv.(var.Bir.offset)
+
+  let set_var_value (ctx : ctx) (var : Bir.variable) (value : var_value) : unit
+      =
+    match value with
+    | SimpleVar v -> ctx.ctx_tgv.(var.Bir.offset) <- v
+    | TableVar (size, vals) -> Array.blit vals 0 ctx.ctx_tgv var.Bir.offset size
+
   let literal_to_value (l : Mir.literal) : value =
     match l with
     | Mir.Undefined -> Undefined
@@ -193,21 +230,14 @@ module Make (N : Bir_number.NumberInterface) = struct
     l
 
   let update_ctx_with_inputs (ctx : ctx)
-      (inputs : Mir.literal Bir.VariableMap.t) : ctx =
-    {
-      ctx with
-      ctx_vars =
-        Bir.VariableMap.fold
-          (fun var value ctx_vars ->
-            Bir.VariableMap.add var (SimpleVar value) ctx_vars)
-          (Bir.VariableMap.mapi
-             (fun v l ->
-               match l with
-               | Mir.Undefined -> Undefined
-               | Mir.Float f -> Number (N.of_float_input (Bir.var_to_mir v) f))
-             inputs)
-          ctx.ctx_vars;
-    }
+      (inputs : Mir.literal Bir.VariableMap.t) : unit =
+    Bir.VariableMap.iter
+      (fun v l ->
+        ctx.ctx_tgv.(v.Bir.offset) <-
+          (match l with
+          | Mir.Undefined -> Undefined
+          | Mir.Float f -> Number (N.of_float_input (Bir.var_to_mir v) f)))
+      inputs
 
   type run_error =
     | ErrorValue of string * Pos.t
@@ -243,10 +273,10 @@ module Make (N : Bir_number.NumberInterface) = struct
 
   let print_output (f : Bir_interface.bir_function) (results : ctx) : unit =
     Bir.VariableMap.iter
-      (fun var value ->
-        if Bir.VariableMap.mem var f.func_outputs then
-          Cli.result_print "%a" format_var_value_with_var (var, value))
-      results.ctx_vars
+      (fun var () ->
+        Cli.result_print "%a" format_var_value_with_var
+          (var, get_var_value results var))
+      f.func_outputs
 
   let repl_debugguer (ctx : ctx) (p : Mir.program) : unit =
     Cli.warning_print
@@ -304,14 +334,14 @@ module Make (N : Bir_number.NumberInterface) = struct
             Mir.(
               fun var ->
                 let bvar = Bir.(var_from_mir default_tgv) var in
-                try
-                  let var_l = Bir.VariableMap.find bvar ctx.ctx_vars in
+                if bvar.Bir.offset < Array.length ctx.ctx_tgv then
+                  let var_l = get_var_value ctx bvar in
                   Format.printf "[%a %a] -> %a@\n"
                     Format_mir.format_execution_number_short
                     var.Variable.execution_number Pos.format_position
                     var.Variable.execution_number.pos format_var_value_with_var
                     (bvar, var_l)
-                with Not_found ->
+                else
                   Format.printf "[%a %a] -> not computed@\n"
                     Format_mir.format_execution_number_short
                     var.Variable.execution_number Pos.format_position
@@ -378,8 +408,13 @@ module Make (N : Bir_number.NumberInterface) = struct
 
   let bool_of_real (f : N.t) : bool = not N.(f =. zero ())
 
-  let evaluate_array_index (index : value) (size : int) (values : value array) :
+  let evaluate_array_index (ctx : ctx) (index : value) (var : Bir.variable) :
       value =
+    let size =
+      match (Bir.var_to_mir var).Mir.Variable.is_table with
+      | Some size -> size
+      | None -> assert false (* should not happen *)
+    in
     let idx =
       match index with
       | Undefined -> assert false (* should not happen *)
@@ -387,7 +422,7 @@ module Make (N : Bir_number.NumberInterface) = struct
     in
     if N.(idx >=. N.of_int (Int64.of_int size)) then Undefined
     else if N.(idx <. N.zero ()) then Number (N.zero ())
-    else values.(Int64.to_int (N.to_int idx))
+    else ctx.ctx_tgv.(var.Bir.offset + Int64.to_int (N.to_int idx))
 
   let rec evaluate_expr (ctx : ctx) (p : Mir.program)
       (e : Bir.expression Pos.marked) : value =
@@ -461,28 +496,9 @@ module Make (N : Bir_number.NumberInterface) = struct
         | Index (var, e1) -> (
             let new_e1 = evaluate_expr ctx p e1 in
             if new_e1 = Undefined then Undefined
-            else
-              match Bir.VariableMap.find (Pos.unmark var) ctx.ctx_vars with
-              | SimpleVar _ -> assert false (* should not happen *)
-              | TableVar (size, values) ->
-                  evaluate_array_index new_e1 size values)
-        | LocalVar lvar -> (
-            try Pos.unmark (Mir.LocalVariableMap.find lvar ctx.ctx_local_vars)
-            with Not_found -> assert false (* should not happen*))
-        | Var var ->
-            let r =
-              try
-                match Bir.VariableMap.find var ctx.ctx_vars with
-                | SimpleVar l -> l
-                | TableVar _ -> assert false
-                (* should not happen *)
-              with Not_found ->
-                Errors.raise_spanned_error
-                  ("Var not found (should not happen): "
-                  ^ Pos.unmark (Bir.var_to_mir var).Mir.Variable.name)
-                  (Pos.get_position e)
-            in
-            r
+            else evaluate_array_index ctx new_e1 (Pos.unmark var))
+        | LocalVar lvar -> ctx.ctx_local_vars.(lvar.Mir.LocalVariable.id)
+        | Var var -> ctx.ctx_tgv.(var.Bir.offset)
         | Error ->
             raise
               (RuntimeError
@@ -493,17 +509,13 @@ module Make (N : Bir_number.NumberInterface) = struct
                    ctx ))
         | LocalLet (lvar, e1, e2) ->
             let new_e1 = evaluate_expr ctx p e1 in
-            let new_e2 =
-              evaluate_expr
-                {
-                  ctx with
-                  ctx_local_vars =
-                    Mir.LocalVariableMap.add lvar
-                      (Pos.same_pos_as new_e1 e1)
-                      ctx.ctx_local_vars;
-                }
-                p e2
-            in
+            (* the slot is restored afterwards in case the same local variable
+               is bound by an enclosing let, which inlining can produce *)
+            let slot = lvar.Mir.LocalVariable.id in
+            let old_e1 = ctx.ctx_local_vars.(slot) in
+            ctx.ctx_local_vars.(slot) <- new_e1;
+            let new_e2 = evaluate_expr ctx p e2 in
+            ctx.ctx_local_vars.(slot) <- old_e1;
             new_e2
         | FunctionCall (ArrFunc, [ arg ]) -> (
             let new_arg = evaluate_expr ctx p arg in
@@ -553,8 +565,13 @@ module Make (N : Bir_number.NumberInterface) = struct
                          ctx ))
             in
             let var_arg2 =
-              match Pos.unmark arg2 with Var v -> v | _ -> assert false
-              (* todo: rte *)
+              match Pos.unmark arg2 with
+              | Var v -> v
+              | _ ->
+                  Errors.raise_spanned_error
+                    "the second argument of multimax should be a table \
+                     variable"
+                    (Pos.get_position arg2)
             in
             let cast_to_int (v : value) : Int64.t option =
               match v with
@@ -611,7 +628,7 @@ module Make (N : Bir_number.NumberInterface) = struct
       else raise (RuntimeError (e, ctx))
     else out
 
-  let report_violatedcondition (cond : Bir.condition_data) (ctx : ctx) : 'a =
+  let report_violatedcondition (cond : Bir.condition_data) (ctx : ctx) : unit =
     let err = fst cond.cond_error in
     match err.Mir.Error.typ with
     | Mast.Anomaly ->
@@ -622,8 +639,7 @@ module Make (N : Bir_number.NumberInterface) = struct
                    cond.cond_expr,
                    List.rev
                    @@ List.fold_left
-                        (fun acc var ->
-                          (var, Bir.VariableMap.find var ctx.ctx_vars) :: acc)
+                        (fun acc var -> (var, get_var_value ctx var) :: acc)
                         []
                         (List.map
                            (fun (_, x) -> Bir.(var_from_mir default_tgv) x)
@@ -635,92 +651,60 @@ module Make (N : Bir_number.NumberInterface) = struct
                ctx ))
     | Mast.Discordance ->
         Cli.warning_print "Anomaly: %s"
-          (Pos.unmark (Mir.Error.err_descr_string err));
-        ctx
+          (Pos.unmark (Mir.Error.err_descr_string err))
     | Mast.Information ->
         Cli.debug_print "Information: %s"
-          (Pos.unmark (Mir.Error.err_descr_string err));
-        ctx
+          (Pos.unmark (Mir.Error.err_descr_string err))
 
-  let evaluate_variable (p : Bir.program) (ctx : ctx) (curr_value : var_value)
-      (vdef : Bir.variable Mir.variable_def_) : var_value =
+  let evaluate_variable (p : Bir.program) (ctx : ctx) (var : Bir.variable)
+      (vdef : Bir.variable Mir.variable_def_) : unit =
     match vdef with
-    | Mir.SimpleVar e -> SimpleVar (evaluate_expr ctx p.mir_program e)
-    | Mir.TableVar (size, es) ->
-        TableVar
-          ( size,
-            match es with
-            | IndexGeneric (v, e) ->
-                let i =
-                  match Bir.VariableMap.find v ctx.ctx_vars with
-                  | SimpleVar n -> n
-                  | TableVar _ -> assert false
-                  (* should not happen *)
-                  | exception Not_found ->
-                      raise
-                        (RuntimeError
-                           ( ErrorValue
-                               ( "no value found for dynamic index",
-                                 Pos.get_position e ),
-                             ctx ))
-                in
-                let tval =
-                  match curr_value with
-                  | SimpleVar _ -> assert false (* should not happen *)
-                  | TableVar (s, vals) ->
-                      assert (s = size);
-                      vals
-                in
-                (match i with
-                | Undefined -> ()
-                | Number f ->
-                    let i = int_of_float (N.to_float f) in
-                    if i < 0 || i >= size then
-                      raise
-                        (RuntimeError
-                           ( IndexOutOfBounds
-                               ("dynamic index out of bound", Pos.get_position e),
-                             ctx )));
-                Array.init size (fun idx ->
-                    match i with
-                    | Number f when int_of_float (N.to_float f) = idx ->
-                        evaluate_expr ctx p.mir_program e
-                    | Number _ | Undefined -> tval.(idx))
-            | IndexTable es ->
-                Array.init size (fun idx ->
-                    let e = Mir.IndexMap.find idx es in
-                    evaluate_expr ctx p.mir_program e) )
+    | Mir.SimpleVar e ->
+        ctx.ctx_tgv.(var.Bir.offset) <- evaluate_expr ctx p.mir_program e
+    | Mir.TableVar (size, es) -> (
+        match es with
+        | IndexGeneric (v, e) -> (
+            match ctx.ctx_tgv.(v.Bir.offset) with
+            | Undefined -> ()
+            | Number f ->
+                let i = int_of_float (N.to_float f) in
+                if i < 0 || i >= size then
+                  raise
+                    (RuntimeError
+                       ( IndexOutOfBounds
+                           ("dynamic index out of bound", Pos.get_position e),
+                         ctx ));
+                ctx.ctx_tgv.(var.Bir.offset + i) <-
+                  evaluate_expr ctx p.mir_program e)
+        | IndexTable es ->
+            (* all the cells are computed before any is written, as they may
+               refer to the previous value of the table *)
+            let values =
+              Array.init size (fun idx ->
+                  let e = Mir.IndexMap.find idx es in
+                  evaluate_expr ctx p.mir_program e)
+            in
+            Array.blit values 0 ctx.ctx_tgv var.Bir.offset size)
     | Mir.InputVar -> assert false
 
   let rec evaluate_stmt (p : Bir.program) (ctx : ctx) (stmt : Bir.stmt)
-      (loc : code_location) =
+      (loc : code_location) : unit =
     match Pos.unmark stmt with
     | Bir.SAssign (var, vdata) ->
-        let value =
-          try Bir.VariableMap.find var ctx.ctx_vars
-          with Not_found -> (
-            match (Bir.var_to_mir var).is_table with
-            | Some size -> TableVar (size, Array.make size Undefined)
-            | None -> SimpleVar Undefined)
-        in
-        let res = evaluate_variable p ctx value vdata.var_definition in
-        !assign_hook var (fun _ -> var_value_to_var_literal res) loc;
-        { ctx with ctx_vars = Bir.VariableMap.add var res ctx.ctx_vars }
+        evaluate_variable p ctx var vdata.var_definition;
+        !assign_hook var
+          (fun _ -> var_value_to_var_literal (get_var_value ctx var))
+          loc
     | Bir.SConditional (b, t, f) -> (
-        match
-          evaluate_variable p ctx (SimpleVar Undefined)
-            (SimpleVar (b, Pos.no_pos))
-        with
-        | SimpleVar (Number z) when N.(z =. zero ()) ->
+        match evaluate_expr ctx p.mir_program (b, Pos.no_pos) with
+        | Number z when N.(z =. zero ()) ->
             evaluate_stmts p ctx f (ConditionalBranch false :: loc) 0
-        | SimpleVar (Number _) ->
-            evaluate_stmts p ctx t (ConditionalBranch true :: loc) 0
-        | SimpleVar Undefined -> ctx
-        | _ -> assert false)
+        | Number _ -> evaluate_stmts p ctx t (ConditionalBranch true :: loc) 0
+        | Undefined -> ())
     | Bir.SVerif data -> (
         match evaluate_expr ctx p.mir_program data.cond_expr with
         | Number f when not (N.is_zero f) -> report_violatedcondition data ctx
-        | _ -> ctx)
+        | _ -> ())
     | Bir.SRovCall r ->
         let rule = Bir.ROVMap.find r p.rules_and_verifs in
         evaluate_stmts p ctx
@@ -733,25 +717,409 @@ module Make (N : Bir_number.NumberInterface) = struct
      are actually output. Does this actually make sense ? *)
 
   and evaluate_stmts (p : Bir.program) (ctx : ctx) (stmts : Bir.stmt list)
-      (loc : code_location) (start_value : int) : ctx =
-    let ctx, _ =
-      List.fold_left
-        (fun (ctx, i) stmt ->
-          (evaluate_stmt p ctx stmt (InsideBlock i :: loc), i + 1))
-        (ctx, start_value) stmts
+      (loc : code_location) (start_value : int) : unit =
+    List.iteri
+      (fun i stmt ->
+        evaluate_stmt p ctx stmt (InsideBlock (start_value + i) :: loc))
+      stmts
+
+  (** {2 Closure compilation}
+
+      Instead of walking the AST each time the program is run, statements and
+      expressions can be translated once into OCaml closures specialized for
+      the operator at hand, with variables already resolved to their slot in
+      the context. The closures must behave exactly like [evaluate_expr] and
+      [evaluate_stmt]. *)
+
+  let check_nan_or_inf (e : Bir.expression Pos.marked) (ctx : ctx)
+      (out : value) : value =
+    match out with
+    | Number x when N.is_nan_or_inf x ->
+        raise
+          (RuntimeError (NanOrInf (Format.asprintf "%a" N.format_t x, e), ctx))
+    | _ -> out
+
+  let rec compile_expr (p : Mir.program) (e : Bir.expression Pos.marked) :
+      ctx -> value =
+    let f : ctx -> value =
+      match Pos.unmark e with
+      | Comparison (op, e1, e2) ->
+          let c1 = compile_expr p e1 in
+          let c2 = compile_expr p e2 in
+          let cmp =
+            match Pos.unmark op with
+            | Mast.Gt -> N.( >. )
+            | Mast.Gte -> N.( >=. )
+            | Mast.Lt -> N.( <. )
+            | Mast.Lte -> N.( <=. )
+            | Mast.Eq -> N.( =. )
+            | Mast.Neq -> fun i1 i2 -> not N.(i1 =. i2)
+          in
+          fun ctx ->
+            let v1 = c1 ctx in
+            let v2 = c2 ctx in
+            begin
+              match (v1, v2) with
+              | Number i1, Number i2 -> Number (real_of_bool (cmp i1 i2))
+              | _ -> Undefined
+            end
+      | Binop (op, e1, e2) -> (
+          let c1 = compile_expr p e1 in
+          let c2 = compile_expr p e2 in
+          let binop (f : value -> value -> value) ctx =
+            let v1 = c1 ctx in
+            let v2 = c2 ctx in
+            f v1 v2
+          in
+          match Pos.unmark op with
+          | Mast.Add ->
+              binop (fun v1 v2 ->
+                  match (v1, v2) with
+                  | Number i1, Number i2 -> Number N.(i1 +. i2)
+                  | Number i1, Undefined -> Number N.(i1 +. zero ())
+                  | Undefined, Number i2 -> Number N.(zero () +. i2)
+                  | Undefined, Undefined -> Undefined)
+          | Mast.Sub ->
+              binop (fun v1 v2 ->
+                  match (v1, v2) with
+                  | Number i1, Number i2 -> Number N.(i1 -. i2)
+                  | Number i1, Undefined -> Number N.(i1 -. zero ())
+                  | Undefined, Number i2 -> Number N.(zero () -. i2)
+                  | Undefined, Undefined -> Undefined)
+          | Mast.Mul ->
+              binop (fun v1 v2 ->
+                  match (v1, v2) with
+                  | Number i1, Number i2 -> Number N.(i1 *. i2)
+                  | _ -> Undefined)
+          | Mast.Div ->
+              binop (fun v1 v2 ->
+                  match (v1, v2) with
+                  | Undefined, _ | _, Undefined -> Undefined
+                  | _, l2 when is_zero l2 -> Number (N.zero ())
+                  | Number i1, Number i2 -> Number N.(i1 /. i2))
+          | Mast.And ->
+              binop (fun v1 v2 ->
+                  match (v1, v2) with
+                  | Undefined, _ | _, Undefined -> Undefined
+                  | Number i1, Number i2 ->
+                      Number
+                        (real_of_bool (bool_of_real i1 && bool_of_real i2)))
+          | Mast.Or ->
+              binop (fun v1 v2 ->
+                  match (v1, v2) with
+                  | Undefined, Undefined -> Undefined
+                  | Undefined, Number i | Number i, Undefined -> Number i
+                  | Number i1, Number i2 ->
+                      Number
+                        (real_of_bool (bool_of_real i1 || bool_of_real i2))))
+      | Unop (op, e1) -> (
+          let c1 = compile_expr p e1 in
+          match op with
+          | Mast.Not -> (
+              fun ctx ->
+                match c1 ctx with
+                | Number b1 -> Number (real_of_bool (not (bool_of_real b1)))
+                | Undefined -> Undefined)
+          | Mast.Minus -> (
+              fun ctx ->
+                match c1 ctx with
+                | Number f1 -> Number N.(zero () -. f1)
+                | Undefined -> Undefined))
+      | Conditional (e1, e2, e3) -> (
+          let c1 = compile_expr p e1 in
+          let c2 = compile_expr p e2 in
+          let c3 = compile_expr p e3 in
+          fun ctx ->
+            match c1 ctx with
+            | Number z when N.(z =. zero ()) -> c3 ctx
+            | Number _ -> c2 ctx
+            | Undefined -> Undefined)
+      | Literal l ->
+          let v = literal_to_value l in
+          fun _ -> v
+      | Index (var, e1) -> (
+          let c1 = compile_expr p e1 in
+          let var = Pos.unmark var in
+          fun ctx ->
+            match c1 ctx with
+            | Undefined -> Undefined
+            | idx -> evaluate_array_index ctx idx var)
+      | LocalVar lvar ->
+          let slot = lvar.Mir.LocalVariable.id in
+          fun ctx -> ctx.ctx_local_vars.(slot)
+      | Var var ->
+          let offset = var.Bir.offset in
+          fun ctx -> ctx.ctx_tgv.(offset)
+      | Error ->
+          fun ctx ->
+            raise
+              (RuntimeError
+                 ( ErrorValue
+                     ( Format.asprintf "%a" Pos.format_position
+                         (Pos.get_position e),
+                       Pos.get_position e ),
+                   ctx ))
+      | LocalLet (lvar, e1, e2) ->
+          let c1 = compile_expr p e1 in
+          let c2 = compile_expr p e2 in
+          let slot = lvar.Mir.LocalVariable.id in
+          fun ctx ->
+            let new_e1 = c1 ctx in
+            let old_e1 = ctx.ctx_local_vars.(slot) in
+            ctx.ctx_local_vars.(slot) <- new_e1;
+            let new_e2 = c2 ctx in
+            ctx.ctx_local_vars.(slot) <- old_e1;
+            new_e2
+      | FunctionCall (ArrFunc, [ arg ]) -> (
+          let c = compile_expr p arg in
+          fun ctx ->
+            match c ctx with
+            | Number x -> Number (roundf x)
+            | Undefined -> Undefined)
+      | FunctionCall (InfFunc, [ arg ]) -> (
+          let c = compile_expr p arg in
+          fun ctx ->
+            match c ctx with
+            | Number x -> Number (truncatef x)
+            | Undefined -> Undefined)
+      | FunctionCall (PresentFunc, [ arg ]) -> (
+          let c = compile_expr p arg in
+          fun ctx ->
+            match c ctx with Undefined -> false_value () | _ -> true_value ())
+      | FunctionCall (NullFunc, [ arg ]) -> (
+          let c = compile_expr p arg in
+          fun ctx ->
+            match c ctx with
+            | Undefined -> Undefined
+            | Number f -> if N.is_zero f then true_value () else false_value ())
+      | FunctionCall (MinFunc, [ arg1; arg2 ]) -> (
+          let c1 = compile_expr p arg1 in
+          let c2 = compile_expr p arg2 in
+          fun ctx ->
+            let v1 = c1 ctx in
+            let v2 = c2 ctx in
+            match (v1, v2) with
+            | Undefined, Number f | Number f, Undefined ->
+                Number (N.min (N.zero ()) f)
+            | Undefined, Undefined -> Number (N.zero ())
+            | Number fl, Number fr -> Number (N.min fl fr))
+      | FunctionCall (MaxFunc, [ arg1; arg2 ]) -> (
+          let c1 = compile_expr p arg1 in
+          let c2 = compile_expr p arg2 in
+          fun ctx ->
+            let v1 = c1 ctx in
+            let v2 = c2 ctx in
+            match (v1, v2) with
+            | Undefined, Undefined -> Number (N.zero ())
+            | Undefined, Number f | Number f, Undefined ->
+                Number (N.max (N.zero ()) f)
+            | Number fl, Number fr -> Number (N.max fl fr))
+      | FunctionCall (Multimax, [ arg1; arg2 ]) -> (
+          let c_up = compile_expr p arg1 in
+          match Pos.unmark arg2 with
+          | Var var_arg2 ->
+              fun ctx ->
+                let up =
+                  match c_up ctx with
+                  | Number f -> N.to_int (roundf f)
+                  | e ->
+                      raise
+                        (RuntimeError
+                           ( ErrorValue
+                               ( Format.asprintf
+                                   "evaluation of %a should be an integer, not \
+                                    %a"
+                                   Format_bir.format_expression
+                                   (Pos.unmark arg1) format_value e,
+                                 Pos.get_position arg1 ),
+                             ctx ))
+                in
+                let access_index (i : int) : Int64.t =
+                  match
+                    evaluate_array_index ctx
+                      (Number (N.of_float (float_of_int i)))
+                      var_arg2
+                  with
+                  | Number f -> N.to_int (roundf f)
+                  | Undefined -> Int64.zero
+                in
+                let maxi = ref (access_index 0) in
+                for i = 0 to Int64.to_int up do
+                  maxi := max !maxi (access_index i)
+                done;
+                Number (N.of_int !maxi)
+          | _ ->
+              Errors.raise_spanned_error
+                "the second argument of multimax should be a table variable"
+                (Pos.get_position arg2))
+      | FunctionCall (func, _) ->
+          fun ctx ->
+            raise
+              (RuntimeError
+                 ( ErrorValue
+                     ( Format.asprintf "the function %a  has not been expanded"
+                         Format_mir.format_func func,
+                       Pos.get_position e ),
+                   ctx ))
     in
-    ctx
+    fun ctx -> check_nan_or_inf e ctx (f ctx)
+
+  (* Error handling is only installed at the root of each expression, unlike
+     [evaluate_expr] which does it at every node *)
+  let compile_root_expr (p : Mir.program) (e : Bir.expression Pos.marked) :
+      ctx -> value =
+    let f = compile_expr p e in
+    fun ctx ->
+      try f ctx with
+      | RuntimeError (err, ctx) ->
+          if !exit_on_rte then raise_runtime_as_structured err ctx p
+          else raise (RuntimeError (err, ctx))
+      | Errors.StructuredError (msg, pos, kont) ->
+          if !exit_on_rte then
+            raise
+              (Errors.StructuredError
+                 ( msg,
+                   pos
+                   @ [
+                       (Some "Expression raising the error:", Pos.get_position e);
+                     ],
+                   kont ))
+          else raise (RuntimeError (StructuredError (msg, pos, kont), ctx))
 
-  let evaluate_program (p : Bir.program) (ctx : ctx)
-      (code_loc_start_value : int) : ctx =
-    try
-      let ctx =
-        evaluate_stmts p ctx (Bir.main_statements p) [] code_loc_start_value
-      in
-      ctx
+  let compile_variable (p : Bir.program) (var : Bir.variable)
+      (vdef : Bir.variable Mir.variable_def_) : ctx -> unit =
+    let offset = var.Bir.offset in
+    match vdef with
+    | Mir.SimpleVar e ->
+        let c = compile_root_expr p.mir_program e in
+        fun ctx -> ctx.ctx_tgv.(offset) <- c ctx
+    | Mir.TableVar (size, IndexGeneric (v, e)) -> (
+        let c = compile_root_expr p.mir_program e in
+        let index_offset = v.Bir.offset in
+        fun ctx ->
+          match ctx.ctx_tgv.(index_offset) with
+          | Undefined -> ()
+          | Number f ->
+              let i = int_of_float (N.to_float f) in
+              if i < 0 || i >= size then
+                raise
+                  (RuntimeError
+                     ( IndexOutOfBounds
+                         ("dynamic index out of bound", Pos.get_position e),
+                       ctx ));
+              ctx.ctx_tgv.(offset + i) <- c ctx)
+    | Mir.TableVar (size, IndexTable es) ->
+        let cs =
+          Array.init size (fun idx ->
+              compile_root_expr p.mir_program (Mir.IndexMap.find idx es))
+        in
+        fun ctx ->
+          let values = Array.map (fun c -> c ctx) cs in
+          Array.blit values 0 ctx.ctx_tgv offset size
+    | Mir.InputVar -> fun _ -> assert false
+
+  let rec compile_stmt (p : Bir.program) (stmt : Bir.stmt)
+      (loc : code_location) : ctx -> unit =
+    match Pos.unmark stmt with
+    | Bir.SAssign (var, vdata) ->
+        let assign = compile_variable p var vdata.var_definition in
+        fun ctx ->
+          assign ctx;
+          !assign_hook var
+            (fun _ -> var_value_to_var_literal (get_var_value ctx var))
+            loc
+    | Bir.SConditional (b, t, f) -> (
+        let cb = compile_root_expr p.mir_program (b, Pos.no_pos) in
+        let ct = compile_stmts p t (ConditionalBranch true :: loc) 0 in
+        let cf = compile_stmts p f (ConditionalBranch false :: loc) 0 in
+        fun ctx ->
+          match cb ctx with
+          | Number z when N.(z =. zero ()) -> cf ctx
+          | Number _ -> ct ctx
+          | Undefined -> ())
+    | Bir.SVerif data -> (
+        let c = compile_root_expr p.mir_program data.cond_expr in
+        fun ctx ->
+          match c ctx with
+          | Number f when not (N.is_zero f) -> report_violatedcondition data ctx
+          | _ -> ())
+    | Bir.SRovCall r ->
+        let rule = Bir.ROVMap.find r p.rules_and_verifs in
+        compile_stmts p
+          (Bir.rule_or_verif_as_statements rule)
+          (InsideRule r :: loc) 0
+    | Bir.SFunctionCall (f, _args) ->
+        compile_stmts p
+          (Bir.FunctionMap.find f p.mpp_functions).mppf_stmts
+          loc 0
+
+  and compile_stmts (p : Bir.program) (stmts : Bir.stmt list)
+      (loc : code_location) (start_value : int) : ctx -> unit =
+    let compiled =
+      Array.of_list
+        (List.mapi
+           (fun i stmt ->
+             compile_stmt p stmt (InsideBlock (start_value + i) :: loc))
+           stmts)
+    in
+    fun ctx -> Array.iter (fun stmt -> stmt ctx) compiled
+
+  let catch_runtime_errors (p : Bir.program) (f : ctx -> unit) (ctx : ctx) :
+      unit =
+    try f ctx
     with RuntimeError (e, ctx) ->
+      (* the context keeps being mutated by whoever runs it next, so errors
+         carry a snapshot of it *)
+      let ctx = copy_ctx ctx in
       if !exit_on_rte then raise_runtime_as_structured e ctx p.mir_program
       else raise (RuntimeError (e, ctx))
+
+  let compile_program (p : Bir.program) (code_loc_start_value : int) :
+      ctx -> unit =
+    catch_runtime_errors p
+      (compile_stmts p (Bir.main_statements p) [] code_loc_start_value)
+
+  type prepared_program = {
+    prep_program : Bir.program;
+    prep_code_loc_start_value : int;
+    prep_num_statements : int;
+    prep_run : ctx -> unit;
+        (** The main statements, as closures with [compile_to_closures] *)
+  }
+
+  let prepare_program (p : Bir.program) (code_loc_start_value : int) :
+      prepared_program =
+    let stmts = Bir.main_statements p in
+    {
+      prep_program = p;
+      prep_code_loc_start_value = code_loc_start_value;
+      prep_num_statements = List.length stmts;
+      prep_run =
+        (if !compile_to_closures then
+         compile_stmts p stmts [] code_loc_start_value
+        else fun ctx -> evaluate_stmts p ctx stmts [] code_loc_start_value);
+    }
+
+  let ctx_of_prepared_program (prep : prepared_program) : ctx =
+    ctx_of_program prep.prep_program
+
+  let run_prepared_program ?(conds : Bir.stmt list = [])
+      (prep : prepared_program) (ctx : ctx) : unit =
+    let p = prep.prep_program in
+    (* the conditions come after the main statements, so their code locations
+       follow; they are only run once, so they are walked and not compiled *)
+    let conds_start_value =
+      prep.prep_code_loc_start_value + prep.prep_num_statements
+    in
+    catch_runtime_errors p
+      (fun ctx ->
+        prep.prep_run ctx;
+        evaluate_stmts p ctx conds [] conds_start_value)
+      ctx
+
+  let evaluate_program (p : Bir.program) (ctx : ctx)
+      (code_loc_start_value : int) : unit =
+    run_prepared_program (prepare_program p code_loc_start_value) ctx
 end
 
 module RegularFloatInterpreter = Make (Bir_number.RegularFloatNumber)
@@ -773,54 +1141,74 @@ type value_sort =
   | Interval
   | Rational
 
-let evaluate_program (bir_func : Bir_interface.bir_function) (p : Bir.program)
-    (inputs : Mir.literal Bir.VariableMap.t) (code_loc_start_value : int)
-    (sort : value_sort) : unit -> unit =
+type prepared_program =
+  | RegularFloatProgram of RegularFloatInterpreter.prepared_program
+  | MPFRProgram of int * MPFRInterpreter.prepared_program
+  | BigIntProgram of int * BigIntInterpreter.prepared_program
+  | IntervalProgram of IntervalInterpreter.prepared_program
+  | RationalProgram of RationalInterpreter.prepared_program
+
+let prepare_program (p : Bir.program) (code_loc_start_value : int)
+    (sort : value_sort) : prepared_program =
   match sort with
   | RegularFloat ->
-      let ctx =
-        RegularFloatInterpreter.update_ctx_with_inputs
-          RegularFloatInterpreter.empty_ctx inputs
-      in
-      let ctx =
-        RegularFloatInterpreter.evaluate_program p ctx code_loc_start_value
-      in
-      fun () -> RegularFloatInterpreter.print_output bir_func ctx
+      RegularFloatProgram
+        (RegularFloatInterpreter.prepare_program p code_loc_start_value)
   | MPFR prec ->
       Mpfr.set_default_prec prec;
-      let ctx =
-        MPFRInterpreter.update_ctx_with_inputs MPFRInterpreter.empty_ctx inputs
-      in
-      let ctx = MPFRInterpreter.evaluate_program p ctx code_loc_start_value in
-      fun () -> MPFRInterpreter.print_output bir_func ctx
+      MPFRProgram (prec, MPFRInterpreter.prepare_program p code_loc_start_value)
   | BigInt prec ->
       BigIntPrecision.scaling_factor_bits := prec;
-      let ctx =
-        BigIntInterpreter.update_ctx_with_inputs BigIntInterpreter.empty_ctx
-          inputs
-      in
-      let ctx = BigIntInterpreter.evaluate_program p ctx code_loc_start_value in
-      fun () -> BigIntInterpreter.print_output bir_func ctx
+      BigIntProgram
+        (prec, BigIntInterpreter.prepare_program p code_loc_start_value)
   | Interval ->
       Mpfr.set_default_prec 64;
-      let ctx =
-        IntervalInterpreter.update_ctx_with_inputs IntervalInterpreter.empty_ctx
-          inputs
-      in
-      let ctx =
-        IntervalInterpreter.evaluate_program p ctx code_loc_start_value
-      in
-      fun () -> IntervalInterpreter.print_output bir_func ctx
+      IntervalProgram
+        (IntervalInterpreter.prepare_program p code_loc_start_value)
   | Rational ->
-      let ctx =
-        RationalInterpreter.update_ctx_with_inputs RationalInterpreter.empty_ctx
-          inputs
-      in
-      let ctx =
-        RationalInterpreter.evaluate_program p ctx code_loc_start_value
-      in
+      RationalProgram
+        (RationalInterpreter.prepare_program p code_loc_start_value)
+
+let run_prepared_program ?(conds : Bir.stmt list = [])
+    (bir_func : Bir_interface.bir_function) (prep : prepared_program)
+    (inputs : Mir.literal Bir.VariableMap.t) : unit -> unit =
+  match prep with
+  | RegularFloatProgram prep ->
+      let ctx = RegularFloatInterpreter.ctx_of_prepared_program prep in
+      RegularFloatInterpreter.update_ctx_with_inputs ctx inputs;
+      RegularFloatInterpreter.run_prepared_program ~conds prep ctx;
+      fun () -> RegularFloatInterpreter.print_output bir_func ctx
+  | MPFRProgram (prec, prep) ->
+      Mpfr.set_default_prec prec;
+      let ctx = MPFRInterpreter.ctx_of_prepared_program prep in
+      MPFRInterpreter.update_ctx_with_inputs ctx inputs;
+      MPFRInterpreter.run_prepared_program ~conds prep ctx;
+      fun () -> MPFRInterpreter.print_output bir_func ctx
+  | BigIntProgram (prec, prep) ->
+      BigIntPrecision.scaling_factor_bits := prec;
+      let ctx = BigIntInterpreter.ctx_of_prepared_program prep in
+      BigIntInterpreter.update_ctx_with_inputs ctx inputs;
+      BigIntInterpreter.run_prepared_program ~conds prep ctx;
+      fun () -> BigIntInterpreter.print_output bir_func ctx
+  | IntervalProgram prep ->
+      Mpfr.set_default_prec 64;
+      let ctx = IntervalInterpreter.ctx_of_prepared_program prep in
+      IntervalInterpreter.update_ctx_with_inputs ctx inputs;
+      IntervalInterpreter.run_prepared_program ~conds prep ctx;
+      fun () -> IntervalInterpreter.print_output bir_func ctx
+  | RationalProgram prep ->
+      let ctx = RationalInterpreter.ctx_of_prepared_program prep in
+      RationalInterpreter.update_ctx_with_inputs ctx inputs;
+      RationalInterpreter.run_prepared_program ~conds prep ctx;
       fun () -> RationalInterpreter.print_output bir_func ctx
 
+let evaluate_program (bir_func : Bir_interface.bir_function) (p : Bir.program)
+    (inputs : Mir.literal Bir.VariableMap.t) (code_loc_start_value : int)
+    (sort : value_sort) : unit -> unit =
+  run_prepared_program bir_func
+    (prepare_program p code_loc_start_value sort)
+    inputs
+
 let evaluate_expr (p : Mir.program) (e : Bir.expression Pos.marked)
     (sort : value_sort) : Mir.literal =
   let f p e =
@@ -56,6 +56,10 @@ val exit_on_rte : bool ref
 val repl_debug : bool ref
 (** If set to true, prints the REPL debugger in case of runtime error *)
 
+val compile_to_closures : bool ref
+(** If set to true, programs are first translated into OCaml closures and then
+    run, instead of being interpreted by walking their AST *)
+
 (** {1 The interpreter functor}*)
 
 (** The intepreter is parametrized by the kind of floating-point values used for
@@ -80,13 +84,23 @@ module type S = sig
   val format_var_value_with_var :
     Format.formatter -> Bir.variable * var_value -> unit
 
-  type ctx = {
-    ctx_local_vars : value Pos.marked Mir.LocalVariableMap.t;
-    ctx_vars : var_value Bir.VariableMap.t;
-  }
-  (** Interpretation context *)
+  type ctx = { ctx_local_vars : value array; ctx_tgv : value array }
+  (** Interpretation context. It is mutable: [ctx_tgv] holds every variable at
+      its [Bir.variable.offset], tables spanning as many consecutive slots as
+      their size, and [ctx_local_vars] is indexed by [Mir.LocalVariable.id] *)
 
   val empty_ctx : ctx
+  (** Context without any slot, only suitable for closed expressions *)
+
+  val ctx_of_program : Bir.program -> ctx
+  (** Allocates a context big enough for the TGV and the local variables of a
+      program, all set to [Undefined] *)
+
+  val copy_ctx : ctx -> ctx
+
+  val get_var_value : ctx -> Bir.variable -> var_value
+
+  val set_var_value : ctx -> Bir.variable -> var_value -> unit
 
   val literal_to_value : Mir.literal -> value
 
@@ -120,6 +134,26 @@ module type S = sig
 
   val raise_runtime_as_structured : run_error -> ctx -> Mir.program -> 'a
   (** Raises a runtime error with a formatted error message and context *)
+
+  val compile_program : Bir.program -> int -> ctx -> unit
+  (** Translates the program once into closures specialized for the number
+      representation, with variables resolved to their slot in the context.
+      The integer is the start value of the code locations. The result can be
+      run on as many contexts as needed. *)
+
+  type prepared_program
+  (** A program ready to be run on many contexts: its main statements are
+      translated into closures once if [compile_to_closures] is set *)
+
+  val prepare_program : Bir.program -> int -> prepared_program
+  (** The integer is the start value of the code locations *)
+
+  val ctx_of_prepared_program : prepared_program -> ctx
+  (** A fresh context for the program, where every input is [Undefined] *)
+
+  val run_prepared_program :
+    ?conds:Bir.stmt list -> prepared_program -> ctx -> unit
+  (** Runs the program on the context, then checks the [conds] *)
 end
 
 module RegularFloatInterpreter : S
@@ -143,6 +177,22 @@ type value_sort =
   | Interval
   | Rational
 
+type prepared_program
+(** A program prepared for a [value_sort], see {!S.prepare_program} *)
+
+val prepare_program : Bir.program -> int -> value_sort -> prepared_program
+
+val run_prepared_program :
+  ?conds:Bir.stmt list ->
+  Bir_interface.bir_function ->
+  prepared_program ->
+  Mir.literal Bir.VariableMap.t ->
+  unit ->
+  unit
+(** Runs the program in a fresh context where only the given inputs are
+    defined, then checks the [conds]. Running the same prepared program for
+    many sets of inputs and conditions only translates it once. *)
+
 val evaluate_program :
   Bir_interface.bir_function ->
   Bir.program ->
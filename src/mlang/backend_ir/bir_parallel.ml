@@ -0,0 +1,163 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+module IntMap = Map.Make (Int)
+
+type step = Sequential of Bir.stmt list | Parallel of Bir.stmt list list
+
+(* Costs are in number of nodes of the expressions evaluated. Below
+   [min_chunk_cost], a chunk does not pay for the synchronization of the
+   threads *)
+let min_chunk_cost = 500
+
+let max_chunks = 64
+
+let rec stmt_cost (p : Bir.program) (stmt : Bir.stmt) : int =
+  match Pos.unmark stmt with
+  | Bir.SAssign (_, data) -> (
+      match data.Mir.var_definition with
+      | Mir.SimpleVar e -> Inlining.expr_size e
+      | Mir.TableVar (_, Mir.IndexTable es) ->
+          Mir.IndexMap.fold (fun _ e acc -> acc + Inlining.expr_size e) es 0
+      | Mir.TableVar (_, Mir.IndexGeneric (_, e)) -> Inlining.expr_size e
+      | Mir.InputVar -> 0)
+  | Bir.SConditional (e, t, f) ->
+      Inlining.expr_size (Pos.same_pos_as e stmt)
+      + stmts_cost p t + stmts_cost p f
+  | Bir.SVerif cond -> Inlining.expr_size cond.Mir.cond_expr
+  | Bir.SRovCall r ->
+      stmts_cost p
+        (Bir.rule_or_verif_as_statements (Bir.ROVMap.find r p.rules_and_verifs))
+  | Bir.SFunctionCall (f, _) ->
+      stmts_cost p (Bir.FunctionMap.find f p.mpp_functions).mppf_stmts
+
+and stmts_cost (p : Bir.program) (stmts : Bir.stmt list) : int =
+  List.fold_left (fun acc stmt -> acc + stmt_cost p stmt) 0 stmts
+
+(* Whether the unit must run alone on the calling thread: a verification ends
+   the computation when it fails, and a call to an mpp function, even nested in
+   a conditional, returns its error through the output of the entry point,
+   which the chunks do not have *)
+let rec runs_alone (p : Bir.program) (stmt : Bir.stmt) : bool =
+  match Pos.unmark stmt with
+  | Bir.SAssign _ -> false
+  | Bir.SVerif _ | Bir.SFunctionCall _ -> true
+  | Bir.SConditional (_, t, f) ->
+      List.exists (runs_alone p) t || List.exists (runs_alone p) f
+  | Bir.SRovCall r -> (
+      match (Bir.ROVMap.find r p.rules_and_verifs).rov_code with
+      | Bir.Rule stmts -> List.exists (runs_alone p) stmts
+      | Bir.Verif _ -> true)
+
+type level = {
+  level_units : (int * Bir.stmt) list;  (** In reverse order *)
+  level_cost : int;
+  level_barrier : bool;
+}
+
+let get_levels (p : Bir.program) : level list =
+  let last_writes = Hashtbl.create 1000 in
+  let last_reads = Hashtbl.create 1000 in
+  let level_of tbl offset =
+    Option.value ~default:(-1) (Hashtbl.find_opt tbl offset)
+  in
+  let levels, _, _ =
+    Array.fold_left
+      (fun (levels, top, floor) (i, stmt) ->
+        let barrier = runs_alone p stmt in
+        let level =
+          if barrier then top + 1
+          else
+            let reads, writes = Bir_incremental.get_unit_accesses p stmt in
+            let level =
+              List.fold_left
+                (fun level offset -> max level (level_of last_writes offset))
+                floor (reads @ writes)
+            in
+            let level =
+              List.fold_left
+                (fun level offset -> max level (level_of last_reads offset))
+                level writes
+              + 1
+            in
+            List.iter
+              (fun offset ->
+                Hashtbl.replace last_reads offset
+                  (max level (level_of last_reads offset)))
+              reads;
+            List.iter
+              (fun offset -> Hashtbl.replace last_writes offset level)
+              writes;
+            level
+        in
+        let l =
+          Option.value
+            ~default:
+              { level_units = []; level_cost = 0; level_barrier = barrier }
+            (IntMap.find_opt level levels)
+        in
+        let l =
+          {
+            l with
+            level_units = (i, stmt) :: l.level_units;
+            level_cost = l.level_cost + stmt_cost p stmt;
+          }
+        in
+        ( IntMap.add level l levels,
+          max top level,
+          if barrier then level else floor ))
+      (IntMap.empty, -1, -1)
+      (Array.mapi (fun i stmt -> (i, stmt)) (Bir_incremental.get_units p))
+  in
+  List.map snd (IntMap.bindings levels)
+
+(* The largest units first, each to the chunk with the lowest cost so far *)
+let split_level (p : Bir.program) (l : level) : Bir.stmt list list =
+  let num_chunks =
+    min
+      (List.length l.level_units)
+      (min max_chunks (l.level_cost / min_chunk_cost))
+  in
+  let chunks = Array.make num_chunks (0, []) in
+  List.map (fun (i, stmt) -> (stmt_cost p stmt, i, stmt)) l.level_units
+  |> List.sort (fun (c1, _, _) (c2, _, _) -> compare c2 c1)
+  |> List.iter (fun (cost, i, stmt) ->
+         let lightest = ref 0 in
+         Array.iteri
+           (fun c (chunk_cost, _) ->
+             if chunk_cost < fst chunks.(!lightest) then lightest := c)
+           chunks;
+         let chunk_cost, units = chunks.(!lightest) in
+         chunks.(!lightest) <- (chunk_cost + cost, (i, stmt) :: units));
+  Array.to_list chunks
+  |> List.map (fun (_, units) ->
+         List.map snd (List.sort (fun (i1, _) (i2, _) -> compare i1 i2) units))
+
+let create (p : Bir.program) : step list =
+  List.fold_left
+    (fun steps l ->
+      if
+        l.level_barrier
+        || List.length l.level_units < 2
+        || l.level_cost < 2 * min_chunk_cost
+      then
+        let units = List.rev_map snd l.level_units in
+        match steps with
+        | Sequential previous :: steps -> Sequential (previous @ units) :: steps
+        | _ -> Sequential units :: steps
+      else Parallel (split_level p l) :: steps)
+    [] (get_levels p)
+  |> List.rev
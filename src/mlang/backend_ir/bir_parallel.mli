@@ -0,0 +1,38 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** Schedule of the main function on several threads, for the latency of a
+    single computation.
+
+    The units of the main function (see {!Bir_incremental.get_units}) are
+    placed into levels: a unit goes one level above the last unit before it
+    that writes a variable it accesses, or that reads a variable it writes. The
+    units of a level are thus independent and can run in any order, with the
+    same results as the sequential computation. The units that can stop the
+    computation (verifications) or that call an mpp function get a level of
+    their own, above all the units before them and below all the units after
+    them, and run on the calling thread.
+
+    The levels too small to be worth waking other threads run on the calling
+    thread. The other ones are split into chunks of balanced cost, claimed by
+    the threads as they become free. *)
+
+type step =
+  | Sequential of Bir.stmt list  (** Units run in order by the calling thread *)
+  | Parallel of Bir.stmt list list
+      (** Chunks of independent units, each run by a single thread *)
+
+val create : Bir.program -> step list
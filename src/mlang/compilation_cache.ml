@@ -0,0 +1,96 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+type entry = {
+  source_m_program : Mast.program;
+  full_m_program : Mir_interface.full_program;
+  combined_program : Bir.program;
+  counters : Mir.counters;
+  offset_alloc : Bir.offset_alloc;
+}
+
+(* The marshalled values are only readable by the same executable *)
+let executable_digest () : string =
+  try Digest.to_hex (Digest.file Sys.executable_name)
+  with Sys_error _ -> Sys.ocaml_version
+
+let key (source_files : string list) (mpp_file : string)
+    (options : string list) : string =
+  let file_digest f = f ^ ":" ^ Digest.to_hex (Digest.file f) in
+  Digest.to_hex
+    (Digest.string
+       (String.concat "\n"
+          ((executable_digest () :: List.map file_digest source_files)
+          @ (file_digest mpp_file :: options))))
+
+let entry_file (cache_dir : string) (key : string) : string =
+  Filename.concat cache_dir (key ^ ".mlcache")
+
+(* An entry file is made of this magic string, to be changed with the layout
+   of the file, the digest of the marshalled entry and the marshalled entry.
+   The digest is checked before unmarshalling, which could crash the program on
+   a truncated or corrupted entry. *)
+let magic = "MLCACHE1"
+
+exception Invalid_entry
+
+let load (cache_dir : string) (key : string) : entry option =
+  let file = entry_file cache_dir key in
+  if not (Sys.file_exists file) then None
+  else
+    try
+      let ic = open_in_bin file in
+      let data =
+        Fun.protect
+          ~finally:(fun () -> close_in_noerr ic)
+          (fun () -> really_input_string ic (in_channel_length ic))
+      in
+      let magic_size = String.length magic in
+      let header_size = magic_size + 16 in
+      if
+        String.length data < header_size
+        || String.sub data 0 magic_size <> magic
+        || Digest.substring data header_size (String.length data - header_size)
+           <> String.sub data magic_size 16
+      then raise Invalid_entry;
+      Some (Marshal.from_string data header_size : entry)
+    with
+    | Invalid_entry | End_of_file | Failure _ | Invalid_argument _ | Sys_error _
+      ->
+        Cli.warning_print "Ignoring invalid cache entry %s" file;
+        None
+
+let store (cache_dir : string) (key : string) (entry : entry) : unit =
+  try
+    if not (Sys.file_exists cache_dir) then Unix.mkdir cache_dir 0o755;
+    (* Writing to a temporary file then renaming it keeps concurrent [mlang]
+       invocations from reading a partial entry *)
+    let tmp_file, oc =
+      Filename.open_temp_file ~mode:[ Open_binary ] ~temp_dir:cache_dir
+        "mlcache" ".tmp"
+    in
+    let data = Marshal.to_string entry [] in
+    output_string oc magic;
+    Digest.output oc (Digest.string data);
+    output_string oc data;
+    close_out oc;
+    Sys.rename tmp_file (entry_file cache_dir key)
+  with
+  | Sys_error msg ->
+      Cli.warning_print "Could not write the compilation cache: %s" msg
+  | Unix.Unix_error (err, _, _) ->
+      Cli.warning_print "Could not write the compilation cache: %s"
+        (Unix.error_message err)
@@ -0,0 +1,40 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** On-disk cache of the front-end passes (parsing, translation to MIR,
+    typechecking and creation of the combined program), so that the backends
+    can be run repeatedly on the same M sources without redoing them. *)
+
+type entry = {
+  source_m_program : Mast.program;
+  full_m_program : Mir_interface.full_program;
+  combined_program : Bir.program;
+  counters : Mir.counters;
+  offset_alloc : Bir.offset_alloc;
+}
+
+val key : string list -> string -> string list -> string
+(** [key source_files mpp_file options] hashes the contents of the files, along
+    with the options that change the result of the front-end passes and the
+    [mlang] executable itself *)
+
+val load : string -> string -> entry option
+(** [load cache_dir key] returns [None] if no valid entry is found. An entry
+    that cannot be read, or whose header or digest does not match, is ignored
+    with a warning. *)
+
+val store : string -> string -> entry -> unit
+(** Failing to write the cache only issues a warning *)
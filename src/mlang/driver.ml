@@ -34,6 +34,13 @@ let process_dgfip_options (backend : string option)
     end
   | _ -> Dgfip_options.default_flags
 
+let patched_appli_flags (backend : string option)
+    (dgfip_flags : Dgfip_options.flags) : bool * bool * bool =
+  match backend with
+  | Some backend when String.lowercase_ascii backend = "dgfip_c" ->
+      (dgfip_flags.flg_cfir, dgfip_flags.flg_gcos, dgfip_flags.flg_iliad)
+  | _ -> (false, false, true)
+
 (* The legacy compiler plays a nasty trick on us, that we have to reproduce:
    rule 1 is modified to add assignments to APPLI_XXX variables according to the
    target application (OCEANS, BATCH and ILIAD). *)
@@ -49,12 +56,7 @@ let patch_rule_1 (backend : string option) (dgfip_flags : Dgfip_options.flags)
         },
       Pos.no_pos )
   in
-  let oceans, batch, iliad =
-    match backend with
-    | Some backend when String.lowercase_ascii backend = "dgfip_c" ->
-        (dgfip_flags.flg_cfir, dgfip_flags.flg_gcos, dgfip_flags.flg_iliad)
-    | _ -> (false, false, true)
-  in
+  let oceans, batch, iliad = patched_appli_flags backend dgfip_flags in
   List.map
     (fun item ->
       match Pos.unmark item with
@@ -71,6 +73,44 @@ let patch_rule_1 (backend : string option) (dgfip_flags : Dgfip_options.flags)
       | _ -> item)
     source_file
 
+(** Parses one M file. This is run in a worker process by {!module Parmap}, so
+    the errors are returned to be raised in the main process. Any failure,
+    from opening the file to patching its rules, is returned with the name of
+    the file. *)
+let parse_source_file (backend : string option)
+    (dgfip_flags : Dgfip_options.flags) (source_file : string) :
+    (Mast.source_file, string * (string option * Pos.t) list) result =
+  try
+    let input = open_in source_file in
+    Fun.protect
+      ~finally:(fun () -> close_in input)
+      (fun () ->
+        let filebuf = Lexing.from_channel input in
+        let filebuf =
+          {
+            filebuf with
+            lex_curr_p = { filebuf.lex_curr_p with pos_fname = source_file };
+          }
+        in
+        try
+          let commands = Mparser.source_file token filebuf in
+          Ok (patch_rule_1 backend dgfip_flags commands)
+        with
+        | Mparser.Error ->
+            Error
+              ( "M syntax error",
+                [
+                  ( None,
+                    Parse_utils.mk_position
+                      (filebuf.lex_start_p, filebuf.lex_curr_p) );
+                ] )
+        | Errors.StructuredError (msg, pos, _) -> Error (msg, pos))
+  with e ->
+    Error
+      ( Format.asprintf "could not parse %s: %s" source_file
+          (Printexc.to_string e),
+        [] )
+
 (** Entry function for the executable. Returns a negative number in case of
     error. *)
 let driver (files : string list) (debug : bool) (var_info_debug : string list)
@@ -81,68 +121,112 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
     (optimize_unsafe_float : bool) (code_coverage : bool)
     (precision : string option) (test_error_margin : float option)
     (m_clean_calls : bool) (dgfip_options : string list option)
-    (var_dependencies : (string * string) option) =
+    (var_dependencies : (string * string) option) (cache_dir : string option)
+    (test_workers : int option) (test_chunksize : int)
+    (test_report : string option) (specialize : string list)
+    (instrument : bool) (parallel_rules : bool) =
   Cli.set_all_arg_refs files debug var_info_debug display_time dep_graph_file
     print_cycles output optimize_unsafe_float m_clean_calls;
   try
     let dgfip_flags = process_dgfip_options backend dgfip_options in
-    Cli.debug_print "Reading M files...";
-    let m_program = ref [] in
     if List.length !Cli.source_files = 0 then
       Errors.raise_error "please provide at least one M source file";
-    let current_progress, finish = Cli.create_progress_bar "Parsing" in
-    List.iter
-      (fun source_file ->
-        let filebuf, input =
-          if source_file <> "" then
-            let input = open_in source_file in
-            (Lexing.from_channel input, input)
-          else failwith "You have to specify at least one file!"
-        in
-        current_progress source_file;
-        let filebuf =
-          {
-            filebuf with
-            lex_curr_p = { filebuf.lex_curr_p with pos_fname = source_file };
-          }
-        in
-        try
-          let commands = Mparser.source_file token filebuf in
-          let commands = patch_rule_1 backend dgfip_flags commands in
-          m_program := commands :: !m_program
-        with Mparser.Error ->
-          close_in input;
-          Errors.raise_spanned_error "M syntax error"
-            (Parse_utils.mk_position (filebuf.lex_start_p, filebuf.lex_curr_p)))
-      !Cli.source_files;
-    finish "completed!";
-    Cli.debug_print "Elaborating...";
-    let source_m_program = !m_program in
-    let m_program = Mast_to_mir.translate !m_program in
-    let full_m_program =
-      Mir_interface.to_full_program m_program Mast.all_tags
+    let front_end () : Compilation_cache.entry =
+      Cli.debug_print "Reading M files...";
+      if List.mem "" !Cli.source_files then
+        failwith "You have to specify at least one file!";
+      let current_progress, finish = Cli.create_progress_bar "Parsing" in
+      current_progress
+        (Format.asprintf "%d files on %d cores"
+           (List.length !Cli.source_files)
+           (Parmap.get_default_ncores ()));
+      let parsed_files =
+        Parmap.parmap ~keeporder:true ~chunksize:1
+          (parse_source_file backend dgfip_flags)
+          (Parmap.L !Cli.source_files)
+      in
+      (* The errors are reported in the order of the files, and the program is
+         built in reverse order, as when the files were parsed sequentially *)
+      let source_m_program =
+        List.fold_left
+          (fun m_program parsed_file ->
+            match parsed_file with
+            | Ok commands -> commands :: m_program
+            | Error (msg, pos) -> Errors.raise_multispanned_error msg pos)
+          [] parsed_files
+      in
+      finish "completed!";
+      Cli.debug_print "Elaborating...";
+      let m_program = Mast_to_mir.translate source_m_program in
+      let full_m_program =
+        Mir_interface.to_full_program m_program Mast.all_tags
+      in
+      let full_m_program = Mir_typechecker.expand_functions full_m_program in
+      Cli.debug_print "Typechecking...";
+      let full_m_program = Mir_typechecker.typecheck full_m_program in
+      Mir.TagMap.iter
+        (fun tag Mir_interface.{ dep_graph; _ } ->
+          Cli.debug_print
+            "Checking for circular variable definitions for chain %a..."
+            Format_mast.format_chain_tag tag;
+          if
+            Mir_dependency_graph.check_for_cycle dep_graph
+              full_m_program.program true
+          then Errors.raise_error "Cycles between rules.")
+        full_m_program.chains_orders;
+      let mpp = Mpp_frontend.process mpp_file full_m_program in
+      let full_m_program =
+        Mir_interface.to_full_program
+          (match function_spec with
+          | Some _ -> Mir_interface.reset_all_outputs full_m_program.program
+          | None -> full_m_program.program)
+          Mast.all_tags
+      in
+      Cli.debug_print "Creating combined program suitable for execution...";
+      let combined_program =
+        Mpp_ir_to_bir.create_combined_program full_m_program mpp mpp_function
+      in
+      Compilation_cache.
+        {
+          source_m_program;
+          full_m_program;
+          combined_program;
+          counters = Mir.get_counters ();
+          offset_alloc = Bir.get_offset_alloc ();
+        }
     in
-    let full_m_program = Mir_typechecker.expand_functions full_m_program in
-    Cli.debug_print "Typechecking...";
-    let full_m_program = Mir_typechecker.typecheck full_m_program in
-    Mir.TagMap.iter
-      (fun tag Mir_interface.{ dep_graph; _ } ->
-        Cli.debug_print
-          "Checking for circular variable definitions for chain %a..."
-          Format_mast.format_chain_tag tag;
-        if
-          Mir_dependency_graph.check_for_cycle dep_graph full_m_program.program
-            true
-        then Errors.raise_error "Cycles between rules.")
-      full_m_program.chains_orders;
-    let mpp = Mpp_frontend.process mpp_file full_m_program in
-    let full_m_program =
-      Mir_interface.to_full_program
-        (match function_spec with
-        | Some _ -> Mir_interface.reset_all_outputs full_m_program.program
-        | None -> full_m_program.program)
-        Mast.all_tags
+    let Compilation_cache.
+          {
+            source_m_program;
+            full_m_program;
+            combined_program;
+            counters;
+            offset_alloc;
+          } =
+      match cache_dir with
+      | None -> front_end ()
+      | Some cache_dir -> (
+          (* Only these options change the result of the front-end passes *)
+          let oceans, batch, iliad = patched_appli_flags backend dgfip_flags in
+          let key =
+            Compilation_cache.key !Cli.source_files mpp_file
+              [
+                mpp_function;
+                Printf.sprintf "%b %b %b" oceans batch iliad;
+                string_of_bool (function_spec <> None);
+              ]
+          in
+          match Compilation_cache.load cache_dir key with
+          | Some entry ->
+              Cli.debug_print "Reusing the cached combined program %s..." key;
+              entry
+          | None ->
+              let entry = front_end () in
+              Compilation_cache.store cache_dir key entry;
+              entry)
     in
+    Mir.set_counters counters;
+    Bir.set_offset_alloc offset_alloc;
     (match var_dependencies with
     | Some (var, chain) ->
         let var =
@@ -152,10 +236,6 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
         Mir_interface.output_var_dependencies full_m_program chain var;
         exit 0
     | None -> ());
-    Cli.debug_print "Creating combined program suitable for execution...";
-    let combined_program =
-      Mpp_ir_to_bir.create_combined_program full_m_program mpp mpp_function
-    in
     let value_sort =
       let precision = Option.get precision in
       if precision = "double" then Bir_interpreter.RegularFloat
@@ -179,6 +259,10 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
             Errors.raise_error
               (Format.asprintf "Unkown precision option: %s" precision)
     in
+    (match backend with
+    | Some backend when String.lowercase_ascii backend = "closure" ->
+        Bir_interpreter.compile_to_closures := true
+    | _ -> ());
     if run_all_tests <> None then begin
       if code_coverage && optimize then
         Errors.raise_error
@@ -190,6 +274,8 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
       Test_interpreter.check_all_tests combined_program tests optimize
         code_coverage value_sort
         (Option.get test_error_margin)
+        (Option.value ~default:(Parmap.get_default_ncores ()) test_workers)
+        test_chunksize test_report
     end
     else if run_test <> None then begin
       Bir_interpreter.repl_debug := true;
@@ -214,24 +300,63 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
         | Some spec_file ->
             Bir_interface.read_function_from_spec combined_program spec_file
       in
-      let combined_program, _ =
-        Bir_interface.adapt_program_to_function combined_program function_spec
-      in
-      let combined_program =
+      let extract_function (function_spec : Bir_interface.bir_function) :
+          Bir.program =
+        let program, _ =
+          Bir_interface.adapt_program_to_function combined_program function_spec
+        in
         if optimize then begin
           Cli.debug_print "Translating to CFG form for optimizations...";
-          let oir_program = Bir_to_oir.bir_program_to_oir combined_program in
+          let oir_program = Bir_to_oir.bir_program_to_oir program in
           Cli.debug_print "Optimizing...";
           let oir_program = Oir_optimizations.optimize oir_program in
           Cli.debug_print "Translating back to AST...";
-          let combined_program = Bir_to_oir.oir_program_to_bir oir_program in
-          combined_program
+          Bir_to_oir.oir_program_to_bir oir_program
         end
-        else combined_program
+        else program
+      in
+      if
+        specialize <> []
+        && Option.map String.lowercase_ascii backend <> Some "c"
+      then Errors.raise_error "--specialize is only supported by the C backend";
+      if instrument && Option.map String.lowercase_ascii backend <> Some "c"
+      then Errors.raise_error "--instrument is only supported by the C backend";
+      if
+        parallel_rules
+        && Option.map String.lowercase_ascii backend <> Some "c"
+      then
+        Errors.raise_error
+          "--parallel_rules is only supported by the C backend";
+      if parallel_rules && instrument then
+        Errors.raise_error
+          "--parallel_rules and --instrument cannot be used together";
+      if specialize <> [] && not optimize then
+        Cli.warning_print
+          "The specialized variants are only simplified with optimizations \
+           enabled (-O)";
+      let specializations =
+        List.map
+          (fun profile_file ->
+            Cli.debug_print "Specializing the function for %s..." profile_file;
+            let consts, profile_spec =
+              Bir_interface.specialize_function combined_program function_spec
+                profile_file
+            in
+            {
+              Bir_to_c.spec_name =
+                Filename.remove_extension (Filename.basename profile_file);
+              spec_consts = consts;
+              spec_program = extract_function profile_spec;
+            })
+          specialize
       in
+      let combined_program = extract_function function_spec in
       match backend with
       | Some backend ->
-          if String.lowercase_ascii backend = "interpreter" then begin
+          if
+            String.lowercase_ascii backend = "interpreter"
+            || String.lowercase_ascii backend = "closure"
+          then begin
             Cli.debug_print "Interpreting the program...";
             let inputs = Bir_interface.read_inputs_from_stdin function_spec in
             let print_output =
@@ -248,14 +373,31 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
               !Cli.output_file;
             Cli.debug_print "Result written to %s" !Cli.output_file
           end
+          else if String.lowercase_ascii backend = "python_numpy" then begin
+            Cli.debug_print "Compiling the codebase to Python with numpy...";
+            if !Cli.output_file = "" then
+              Errors.raise_error "an output file must be defined with --output";
+            Bir_to_python_numpy.generate_python_numpy_program combined_program
+              function_spec !Cli.output_file;
+            Cli.debug_print "Result written to %s" !Cli.output_file
+          end
           else if String.lowercase_ascii backend = "c" then begin
             Cli.debug_print "Compiling the codebase to C...";
             if !Cli.output_file = "" then
               Errors.raise_error "an output file must be defined with --output";
-            Bir_to_c.generate_c_program combined_program function_spec
+            Bir_to_c.generate_c_program ~specializations ~instrument
+              ~parallel:parallel_rules combined_program function_spec
               !Cli.output_file;
             Cli.debug_print "Result written to %s" !Cli.output_file
           end
+          else if String.lowercase_ascii backend = "c_batch" then begin
+            Cli.debug_print "Compiling the codebase to batched C...";
+            if !Cli.output_file = "" then
+              Errors.raise_error "an output file must be defined with --output";
+            Bir_to_c_batch.generate_c_batch_program combined_program
+              function_spec !Cli.output_file;
+            Cli.debug_print "Result written to %s" !Cli.output_file
+          end
           else if String.lowercase_ascii backend = "java" then begin
             Cli.debug_print "Compiling codebase to Java...";
             if !Cli.output_file = "" then
@@ -263,6 +405,13 @@ let driver (files : string list) (debug : bool) (var_info_debug : string list)
             Bir_to_java.generate_java_program combined_program function_spec
               !Cli.output_file
           end
+          else if String.lowercase_ascii backend = "java_primitive" then begin
+            Cli.debug_print "Compiling codebase to Java on primitive arrays...";
+            if !Cli.output_file = "" then
+              Errors.raise_error "an output file must be defined with --output";
+            Bir_to_java_primitive.generate_java_primitive_program
+              combined_program function_spec !Cli.output_file
+          end
           else if String.lowercase_ascii backend = "dgfip_c" then begin
             Cli.debug_print "Compiling the codebase to DGFiP C...";
             if !Cli.output_file = "" then
@@ -149,12 +149,12 @@ module Variable = struct
     is_table : int option;
   }
 
-  let fresh_id : unit -> id =
-    let counter : int ref = ref 0 in
-    fun () ->
-      let v = !counter in
-      counter := !counter + 1;
-      v
+  let counter : int ref = ref 0
+
+  let fresh_id () : id =
+    let v = !counter in
+    counter := !counter + 1;
+    v
 
   let new_var (name : string Pos.marked) (alias : string option)
       (descr : string Pos.marked) (execution_number : execution_number)
@@ -391,12 +391,12 @@ type rov_id = RuleID of int | VerifID of int
 
 let num_of_rule_or_verif_id = function RuleID n | VerifID n -> n
 
-let fresh_rule_num =
-  let count = ref 0 in
-  fun () ->
-    let n = !count in
-    incr count;
-    n
+let rule_num_counter : int ref = ref 0
+
+let fresh_rule_num () =
+  let n = !rule_num_counter in
+  incr rule_num_counter;
+  n
 
 (** Special rule id for initial definition of variables *)
 let initial_undef_rule_id = RuleID (-1)
@@ -646,3 +646,24 @@ let find_vars_by_io (p : program) (io_to_find : io) : VariableDict.t =
       then VariableDict.add var acc
       else acc)
     p VariableDict.empty
+
+type counters = {
+  variable_counter : int;
+  local_variable_counter : int;
+  error_counter : int;
+  rule_num_counter : int;
+}
+
+let get_counters () : counters =
+  {
+    variable_counter = !Variable.counter;
+    local_variable_counter = !LocalVariable.counter;
+    error_counter = !Error.counter;
+    rule_num_counter = !rule_num_counter;
+  }
+
+let set_counters (c : counters) : unit =
+  Variable.counter := c.variable_counter;
+  LocalVariable.counter := c.local_variable_counter;
+  Error.counter := c.error_counter;
+  rule_num_counter := c.rule_num_counter
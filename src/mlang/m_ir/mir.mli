@@ -346,3 +346,12 @@ val find_vars_by_io : program -> io -> VariableDict.t
 (** Returns a VariableDict.t containing all the variables that have a given io
     type, only one variable per name is entered in the VariableDict.t, this
     function chooses the one with the highest execution number*)
+
+type counters
+(** State of the generators of fresh variable, error and rule identifiers *)
+
+val get_counters : unit -> counters
+
+val set_counters : counters -> unit
+(** When a program is reloaded from disk, the identifiers generated afterwards
+    must not collide with those of the program *)
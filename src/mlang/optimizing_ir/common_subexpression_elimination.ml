@@ -0,0 +1,279 @@
+(* Copyright (C) 2019-2021 Inria, contributors: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+open Oir
+
+let rec strip_positions (e : Bir.expression) : Bir.expression =
+  let strip (e, _) = (strip_positions e, Pos.no_pos) in
+  match e with
+  | Mir.Unop (op, e1) -> Mir.Unop (op, strip e1)
+  | Mir.Comparison ((op, _), e1, e2) ->
+      Mir.Comparison ((op, Pos.no_pos), strip e1, strip e2)
+  | Mir.Binop ((op, _), e1, e2) ->
+      Mir.Binop ((op, Pos.no_pos), strip e1, strip e2)
+  | Mir.Index ((var, _), e1) -> Mir.Index ((var, Pos.no_pos), strip e1)
+  | Mir.Conditional (e1, e2, e3) ->
+      Mir.Conditional (strip e1, strip e2, strip e3)
+  | Mir.FunctionCall (f, args) -> Mir.FunctionCall (f, List.map strip args)
+  | Mir.LocalLet (l, e1, e2) -> Mir.LocalLet (l, strip e1, strip e2)
+  | Mir.Literal _ | Mir.Var _ | Mir.LocalVar _ | Mir.Error -> e
+
+module ExprTbl = Hashtbl.Make (struct
+  type t = Bir.expression
+
+  let equal = ( = )
+
+  (* the default limits would only hash the top of the expressions *)
+  let hash = Hashtbl.hash_param 64 256
+end)
+
+(* Leaves are never worth sharing. Local variables could be bound differently
+   at two occurrences of the same expression. *)
+let rec is_candidate (e : Bir.expression) : bool =
+  match e with
+  | Mir.Literal _ | Mir.Var _ | Mir.LocalVar _ | Mir.Error | Mir.LocalLet _ ->
+      false
+  | _ -> no_local_vars_nor_error e
+
+and no_local_vars_nor_error (e : Bir.expression) : bool =
+  match e with
+  | Mir.LocalVar _ | Mir.LocalLet _ | Mir.Error -> false
+  | Mir.Literal _ | Mir.Var _ -> true
+  | Mir.Unop (_, e1) | Mir.Index (_, e1) -> no_local_vars_nor_error (fst e1)
+  | Mir.Binop (_, e1, e2) | Mir.Comparison (_, e1, e2) ->
+      no_local_vars_nor_error (fst e1) && no_local_vars_nor_error (fst e2)
+  | Mir.Conditional (e1, e2, e3) ->
+      no_local_vars_nor_error (fst e1)
+      && no_local_vars_nor_error (fst e2)
+      && no_local_vars_nor_error (fst e3)
+  | Mir.FunctionCall (_, args) ->
+      List.for_all (fun arg -> no_local_vars_nor_error (fst arg)) args
+
+(** {1 Sharing inside a definition} *)
+
+(* Counts the occurrences of the candidate subexpressions that are always
+   evaluated with [e], and keeps the first one *)
+let rec count_unconditional
+    (counts : (int * Bir.expression Pos.marked) ExprTbl.t)
+    (e : Bir.expression Pos.marked) : unit =
+  let count = count_unconditional counts in
+  if is_candidate (Pos.unmark e) then begin
+    let key = strip_positions (Pos.unmark e) in
+    match ExprTbl.find_opt counts key with
+    | None -> ExprTbl.add counts key (1, e)
+    | Some (n, first) -> ExprTbl.replace counts key (n + 1, first)
+  end;
+  match Pos.unmark e with
+  | Mir.Conditional (e1, _, _) ->
+      (* at most one of the branches is evaluated *)
+      count e1
+  | Mir.Unop (_, e1) | Mir.Index (_, e1) -> count e1
+  | Mir.Binop (_, e1, e2)
+  | Mir.Comparison (_, e1, e2)
+  | Mir.LocalLet (_, e1, e2) ->
+      count e1;
+      count e2
+  | Mir.FunctionCall (_, args) -> List.iter count args
+  | Mir.Literal _ | Mir.Var _ | Mir.LocalVar _ | Mir.Error -> ()
+
+let rec replace_subexpr (key : Bir.expression) (l : Mir.LocalVariable.t)
+    (e : Bir.expression Pos.marked) : Bir.expression Pos.marked =
+  let replace = replace_subexpr key l in
+  Pos.same_pos_as
+    (if is_candidate (Pos.unmark e) && strip_positions (Pos.unmark e) = key
+    then Mir.LocalVar l
+    else
+      match Pos.unmark e with
+      | Mir.Unop (op, e1) -> Mir.Unop (op, replace e1)
+      | Mir.Comparison (op, e1, e2) ->
+          Mir.Comparison (op, replace e1, replace e2)
+      | Mir.Binop (op, e1, e2) -> Mir.Binop (op, replace e1, replace e2)
+      | Mir.Index (var, e1) -> Mir.Index (var, replace e1)
+      | Mir.Conditional (e1, e2, e3) ->
+          Mir.Conditional (replace e1, replace e2, replace e3)
+      | Mir.FunctionCall (f, args) ->
+          Mir.FunctionCall (f, List.map replace args)
+      | Mir.LocalLet (l', e1, e2) -> Mir.LocalLet (l', replace e1, replace e2)
+      | (Mir.Literal _ | Mir.Var _ | Mir.LocalVar _ | Mir.Error) as e -> e)
+    e
+
+(* Binds the largest repeated subexpression to a local variable, until no
+   subexpression is repeated *)
+let rec share_subexprs (num_shared : int ref) (e : Bir.expression Pos.marked)
+    : Bir.expression Pos.marked =
+  let counts = ExprTbl.create 16 in
+  count_unconditional counts e;
+  let largest =
+    ExprTbl.fold
+      (fun key (count, first) acc ->
+        if count < 2 then acc
+        else
+          let size = Inlining.expr_size first in
+          match acc with
+          | Some (_, _, best_size) when best_size >= size -> acc
+          | _ -> Some (key, first, size))
+      counts None
+  in
+  match largest with
+  | None -> e
+  | Some (key, first, _) ->
+      incr num_shared;
+      let l = Mir.LocalVariable.new_var () in
+      share_subexprs num_shared
+        (Pos.same_pos_as (Mir.LocalLet (l, first, replace_subexpr key l e)) e)
+
+(** {1 Reusing previous definitions} *)
+
+type ctx = {
+  ctx_defs_pos : int BlockMap.t Bir.VariableMap.t;
+      (** Position of the last definition of each variable in each block *)
+  ctx_ssa : Oir_ssa.t;
+  ctx_exprs : (Bir.variable * block_id * int) list ExprTbl.t;
+      (** Definitions already seen, by defining expression *)
+  ctx_num_reused : int ref;
+  ctx_num_shared : int ref;
+}
+
+let add_def_to_ctx (var : Bir.variable) (block : block_id) (pos : int)
+    (ctx : ctx) : ctx =
+  {
+    ctx with
+    ctx_defs_pos =
+      Bir.VariableMap.update var
+        (fun defs ->
+          Some
+            (BlockMap.add block pos
+               (Option.value ~default:BlockMap.empty defs)))
+        ctx.ctx_defs_pos;
+  }
+
+(* Same as in {!module: Inlining}: the SSA name of [var] just before the
+   statement [pos] of [block] *)
+let def_site_before (var : Bir.variable) (ctx : ctx) (block : block_id)
+    (pos : int) : Oir_ssa.def_site option =
+  match
+    Option.bind
+      (Bir.VariableMap.find_opt var ctx.ctx_defs_pos)
+      (BlockMap.find_opt block)
+  with
+  | Some def_pos -> if def_pos < pos then Some (Oir_ssa.Def block) else None
+  | None -> Some (Oir_ssa.def_at_block_entry ctx.ctx_ssa var block)
+
+let find_available_def (key : Bir.expression) (used_vars : Bir.VariableSet.t)
+    (ctx : ctx) (block : block_id) (pos : int) : Bir.variable option =
+  List.find_map
+    (fun (var, def_block, def_pos) ->
+      let is_still_defined =
+        def_site_before var ctx block pos = Some (Oir_ssa.Def def_block)
+        && Option.bind
+             (Bir.VariableMap.find_opt var ctx.ctx_defs_pos)
+             (BlockMap.find_opt def_block)
+           = Some def_pos
+      in
+      let same_operands =
+        Bir.VariableSet.for_all
+          (fun used_var ->
+            match def_site_before used_var ctx def_block def_pos with
+            | None -> false
+            | Some site -> def_site_before used_var ctx block pos = Some site)
+          used_vars
+      in
+      if is_still_defined && same_operands then Some var else None)
+    (Option.value ~default:[] (ExprTbl.find_opt ctx.ctx_exprs key))
+
+let rec cse_in_stmt (stmt : stmt) (ctx : ctx) (block : block_id) (pos : int) :
+    stmt * ctx * int =
+  match Pos.unmark stmt with
+  | SAssign (var, data) -> (
+      let with_def def =
+        Pos.same_pos_as (SAssign (var, { data with var_definition = def })) stmt
+      in
+      let ctx_after = add_def_to_ctx var block pos ctx in
+      match data.var_definition with
+      | SimpleVar e when is_candidate (Pos.unmark e) -> (
+          let key = strip_positions (Pos.unmark e) in
+          match
+            find_available_def key (Bir.get_used_variables e) ctx block pos
+          with
+          | Some previous_var when Bir.compare_variable previous_var var <> 0
+            ->
+              incr ctx.ctx_num_reused;
+              ( with_def
+                  (Mir.SimpleVar (Pos.same_pos_as (Mir.Var previous_var) e)),
+                ctx_after,
+                pos )
+          | _ ->
+              ExprTbl.replace ctx.ctx_exprs key
+                ((var, block, pos)
+                :: Option.value ~default:[]
+                     (ExprTbl.find_opt ctx.ctx_exprs key));
+              ( with_def (Mir.SimpleVar (share_subexprs ctx.ctx_num_shared e)),
+                ctx_after,
+                pos ))
+      | TableVar (size, IndexTable es) ->
+          ( with_def
+              (Mir.TableVar
+                 ( size,
+                   Mir.IndexTable
+                     (Mir.IndexMap.map (share_subexprs ctx.ctx_num_shared) es)
+                 )),
+            ctx_after,
+            pos )
+      | InputVar -> (stmt, ctx, pos)
+      | SimpleVar _ | TableVar (_, IndexGeneric _) -> (stmt, ctx_after, pos))
+  | SRovCall (rov_id, name, stmts) ->
+      let new_stmts, ctx, pos =
+        List.fold_left
+          (fun (stmts, ctx, pos) stmt ->
+            let new_stmt, ctx, pos = cse_in_stmt stmt ctx block pos in
+            (new_stmt :: stmts, ctx, pos + 1))
+          ([], ctx, pos) stmts
+      in
+      ( Pos.same_pos_as (SRovCall (rov_id, name, List.rev new_stmts)) stmt,
+        ctx,
+        pos )
+  | SConditional _ | SVerif _ | SGoto _ | SFunctionCall _ -> (stmt, ctx, pos)
+
+let common_subexpression_elimination (p : program) : program =
+  let analysis = get_cfg_analysis p in
+  let ctx =
+    {
+      ctx_defs_pos = Bir.VariableMap.empty;
+      ctx_ssa = Oir_ssa.create p analysis;
+      ctx_exprs = ExprTbl.create 1000;
+      ctx_num_reused = ref 0;
+      ctx_num_shared = ref 0;
+    }
+  in
+  let p, ctx =
+    Topological.fold
+      (fun (block_id : block_id) (p, ctx) ->
+        let block = BlockMap.find block_id p.blocks in
+        let new_block, ctx, _ =
+          List.fold_left
+            (fun (new_block, ctx, pos) stmt ->
+              let new_stmt, ctx, pos = cse_in_stmt stmt ctx block_id pos in
+              (new_stmt :: new_block, ctx, pos + 1))
+            ([], ctx, 0) block
+        in
+        ( { p with blocks = BlockMap.add block_id (List.rev new_block) p.blocks },
+          ctx ))
+      analysis.cfg (p, ctx)
+  in
+  Cli.debug_print
+    "Common subexpressions: %d definitions reused, %d subexpressions shared"
+    !(ctx.ctx_num_reused) !(ctx.ctx_num_shared);
+  p
@@ -0,0 +1,30 @@
+(* Copyright (C) 2019-2021-2020 Inria, contributors: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** Common subexpression elimination on OIR.
+
+    A definition [Y = e] becomes [Y = X] if a definition [X = e] is in effect
+    with the same values of the variables used by [e], which is checked with
+    their SSA names (see {!module: Oir_ssa}). Inside a definition, a
+    subexpression evaluated several times is bound once with a local variable.
+    Expressions are compared modulo positions.
+
+    Only subexpressions whose evaluation does not depend on a condition are
+    shared inside a definition, so that no expression gets evaluated where it
+    was not before. Expressions are pure, so the undefined values are
+    propagated exactly as before. *)
+
+val common_subexpression_elimination : Oir.program -> Oir.program
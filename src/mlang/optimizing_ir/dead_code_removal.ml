@@ -163,15 +163,13 @@ let remove_dead_statements (stmts : block) (id : block_id)
   (used_vars, used_defs, new_stmts)
 
 let dead_code_removal (p : program) : program =
-  let g = get_cfg p in
+  let { cfg = g; doms; paths = path_checker } = get_cfg_analysis p in
   let rev_topological_order = Topological.fold (fun id acc -> id :: acc) g [] in
   let is_entry block_id = block_id = p.entry_block in
   let is_reachable = Reachability.analyze is_entry g in
   let p =
     { p with blocks = BlockMap.filter (fun bid _ -> is_reachable bid) p.blocks }
   in
-  let path_checker = Paths.create g in
-  let doms = Dominators.idom_to_dom (Dominators.compute_idom g p.entry_block) in
   let _, _, p =
     List.fold_left
       (fun (used_vars, defs_vars, p) block_id ->
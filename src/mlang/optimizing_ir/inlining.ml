@@ -20,16 +20,14 @@ type ctx = {
   ctx_vars : (Bir.variable_def * int) BlockMap.t Bir.VariableMap.t;
   (* the int is the statement number inside the block *)
   ctx_local_vars : Bir.expression Mir.LocalVariableMap.t;
-  ctx_doms : Dominators.dom;
-  ctx_paths : Paths.path_checker;
+  ctx_ssa : Oir_ssa.t;
 }
 
-let empty_ctx (g : CFG.t) (entry_block : block_id) =
+let empty_ctx (ssa : Oir_ssa.t) =
   {
     ctx_vars = Bir.VariableMap.empty;
     ctx_local_vars = Mir.LocalVariableMap.empty;
-    ctx_doms = Dominators.idom_to_dom (Dominators.compute_idom g entry_block);
-    ctx_paths = Paths.create g;
+    ctx_ssa = ssa;
   }
 
 let add_var_def_to_ctx (var : Bir.variable) (def : Bir.variable_def)
@@ -95,66 +93,50 @@ let is_inlining_worthy (e : Bir.expression Pos.marked) : bool =
 
 (* todo: size and no local vars *)
 
+let find_var_def (var : Bir.variable) (ctx : ctx) (block : block_id) :
+    (Bir.variable_def * int) option =
+  Option.bind
+    (Bir.VariableMap.find_opt var ctx.ctx_vars)
+    (BlockMap.find_opt block)
+
+(* The SSA name of [var] just before the statement [pos] of [block]. Only the
+   last definition of each block is recorded, so we cannot tell which
+   definition is in effect at [pos] if that last one is not before [pos]. *)
+let def_site_before (var : Bir.variable) (ctx : ctx) (block : block_id)
+    (pos : int) : Oir_ssa.def_site option =
+  match find_var_def var ctx block with
+  | Some (_, def_pos) ->
+      if def_pos < pos then Some (Oir_ssa.Def block) else None
+  | None -> Some (Oir_ssa.def_at_block_entry ctx.ctx_ssa var block)
+
 let rec inline_in_expr (e : Bir.expression) (ctx : ctx)
     (current_block : block_id) (current_pos : int) : Bir.expression =
   match e with
   | Mir.Var var_x -> (
-      match Bir.VariableMap.find_opt var_x ctx.ctx_vars with
-      | Some previous_x_defs -> (
-          let candidate =
-            BlockMap.filter
-              (fun previous_x_def_block_id (previous_x_def, previous_x_def_pos) ->
-                (* first we pick dominating definitions *)
-                (previous_x_def_block_id = current_block
-                || ctx.ctx_doms previous_x_def_block_id current_block)
-                &&
-                match previous_x_def with
-                | Mir.SimpleVar previous_e ->
-                    is_inlining_worthy previous_e
-                    &&
-                    let vars_used_in_previous_x_def =
-                      Bir.get_used_variables previous_e
-                    in
-                    (* we're trying to replace the use of [var] with
-                       [previous_e]. This is valid only if [var] and the
-                       variables used in [previous_e] have not been redefined
-                       between [previous_def_block_id] and [current_block] *)
-                    let exists_def_between_previous_x_def_and_here
-                        (var : Bir.variable) : bool =
-                      let var_defs =
-                        match Bir.VariableMap.find_opt var ctx.ctx_vars with
-                        | None -> BlockMap.empty
-                        | Some defs -> defs
-                      in
-                      BlockMap.exists
-                        (fun intermediate_block (_, intermediate_block_pos) ->
-                          if intermediate_block = previous_x_def_block_id then
-                            intermediate_block_pos > previous_x_def_pos
-                          else if intermediate_block = current_block then
-                            current_pos > intermediate_block_pos
-                          else
-                            Paths.check_path ctx.ctx_paths
-                              previous_x_def_block_id intermediate_block
-                            && Paths.check_path ctx.ctx_paths intermediate_block
-                                 current_block)
-                        var_defs
-                    in
-                    Bir.VariableSet.for_all
+      match def_site_before var_x ctx current_block current_pos with
+      | Some (Oir_ssa.Def previous_x_def_block_id) -> (
+          match find_var_def var_x ctx previous_x_def_block_id with
+          | Some (Mir.SimpleVar previous_e, previous_x_def_pos)
+            when is_inlining_worthy previous_e
+                 (* we're trying to replace the use of [var_x] with
+                    [previous_e]. This is valid only if the variables used in
+                    [previous_e] have not been redefined between the
+                    definition of [var_x] and here, i.e. they have the same
+                    SSA name at both places *)
+                 && Bir.VariableSet.for_all
                       (fun var ->
-                        not (exists_def_between_previous_x_def_and_here var))
-                      vars_used_in_previous_x_def
-                    && not (exists_def_between_previous_x_def_and_here var_x)
-                | _ -> false)
-              previous_x_defs
-          in
-          (* at this point, [candidate] should contain at most one definition *)
-          match BlockMap.choose_opt candidate with
-          | Some (_, previous_def) -> (
-              match fst previous_def with
-              | SimpleVar previous_e -> Pos.unmark previous_e
-              | _ -> assert false (* should not happen *))
-          | None -> e)
-      | None -> e)
+                        match
+                          def_site_before var ctx previous_x_def_block_id
+                            previous_x_def_pos
+                        with
+                        | None -> false
+                        | Some site ->
+                            def_site_before var ctx current_block current_pos
+                            = Some site)
+                      (Bir.get_used_variables previous_e) ->
+              Pos.unmark previous_e
+          | _ -> e)
+      | _ -> e)
   | Mir.Comparison (op, e1, e2) ->
       let new_e1 =
         Pos.same_pos_as
@@ -348,7 +330,8 @@ let rec inline_in_stmt (stmt : stmt) (ctx : ctx) (current_block : block_id)
 (* TODO: Implement me *)
 
 let inlining (p : program) : program =
-  let g = get_cfg p in
+  let analysis = get_cfg_analysis p in
+  let ssa = Oir_ssa.create p analysis in
   let p, _ =
     Topological.fold
       (fun (block_id : block_id) (p, ctx) ->
@@ -364,7 +347,7 @@ let inlining (p : program) : program =
         in
         ( { p with blocks = BlockMap.add block_id (List.rev new_block) p.blocks },
           ctx ))
-      g
-      (p, empty_ctx g p.entry_block)
+      analysis.cfg
+      (p, empty_ctx ssa)
   in
   p
@@ -14,4 +14,7 @@
    You should have received a copy of the GNU General Public License along with
    this program. If not, see <https://www.gnu.org/licenses/>. *)
 
+val expr_size : Bir.expression Pos.marked -> int
+(** Number of nodes of the expression, used to bound inlining *)
+
 val inlining : Oir.program -> Oir.program
@@ -104,3 +104,41 @@ module Reachability =
 
       let analyze _ x = x
     end)
+
+type cfg_analysis = {
+  cfg : CFG.t;
+  idom : Dominators.idom;
+  doms : Dominators.dom;
+  paths : Paths.path_checker;
+}
+
+(* The optimization passes rewrite the statements of the blocks much more
+   often than the jumps between them, so the last analysis is kept and only
+   recomputed when the entry block or an edge of the CFG changes. *)
+let last_cfg_analysis :
+    ((block_id * (block_id * block_id list) list) * cfg_analysis) option ref =
+  ref None
+
+let get_cfg_analysis (p : program) : cfg_analysis =
+  let g = get_cfg p in
+  let shape =
+    ( p.entry_block,
+      List.sort compare
+        (CFG.fold_vertex
+           (fun v acc -> (v, List.sort compare (CFG.succ g v)) :: acc)
+           g []) )
+  in
+  match !last_cfg_analysis with
+  | Some (last_shape, analysis) when compare last_shape shape = 0 -> analysis
+  | _ ->
+      let idom = Dominators.compute_idom g p.entry_block in
+      let analysis =
+        {
+          cfg = g;
+          idom;
+          doms = Dominators.idom_to_dom idom;
+          paths = Paths.create g;
+        }
+      in
+      last_cfg_analysis := Some (shape, analysis);
+      analysis
@@ -65,3 +65,15 @@ end
 module Reachability : sig
   val analyze : (CFG.V.t -> bool) -> CFG.t -> CFG.V.t -> bool
 end
+
+type cfg_analysis = {
+  cfg : CFG.t;
+  idom : Dominators.idom;
+  doms : Dominators.dom;
+  paths : Paths.path_checker;
+}
+
+val get_cfg_analysis : program -> cfg_analysis
+(** Returns the CFG of the program with its dominator tree and a path checker.
+    The analysis is reused as long as the shape of the CFG does not change
+    between two calls. *)
@@ -16,8 +16,6 @@
 
 open Oir
 
-exception Exit
-
 let get_reduction_percent (init : int) (old : int) (new_ : int) : float =
   float_of_int (old - new_) /. float_of_int init *. 100.
 
@@ -35,32 +33,143 @@ let print_done ?msg (init : int) (old : int) (new_ : int) : unit =
        (if strict_reduction then "↘" else "~")
        reduction_percent)
 
+exception Fixpoint
+
+(** Definitions of each variable assigned in a block, in reverse order *)
+let rec block_defs (acc : Bir.variable_data list Bir.VariableMap.t)
+    (stmts : stmt list) : Bir.variable_data list Bir.VariableMap.t =
+  List.fold_left
+    (fun acc stmt ->
+      match Pos.unmark stmt with
+      | SAssign (var, data) ->
+          Bir.VariableMap.update var
+            (fun defs -> Some (data :: Option.value ~default:[] defs))
+            acc
+      | SRovCall (_, _, stmts) -> block_defs acc stmts
+      | _ -> acc)
+    acc stmts
+
+(** Number of variables whose definitions differ between two versions of a
+    block *)
+let changed_defs (old_block : block option) (new_block : block option) : int =
+  let defs b = block_defs Bir.VariableMap.empty (Option.value ~default:[] b) in
+  Bir.VariableMap.cardinal
+    (Bir.VariableMap.merge
+       (fun _ old_defs new_defs ->
+         if compare old_defs new_defs = 0 then None else Some ())
+       (defs old_block) (defs new_block))
+
+(** Blocks that were added, removed or rewritten by a pass, with the number of
+    definitions that changed in them. [compare] is used rather than [=] so that
+    NaN literals do not make a block look changed forever. *)
+let changes (old_p : program) (new_p : program) : int * int =
+  BlockMap.fold
+    (fun _ (old_block, new_block) (blocks, defs) ->
+      (blocks + 1, defs + changed_defs old_block new_block))
+    (BlockMap.merge
+       (fun _ old_block new_block ->
+         match (old_block, new_block) with
+         | Some o, Some n when o == n || compare o n = 0 -> None
+         | _ -> Some (old_block, new_block))
+       old_p.blocks new_p.blocks)
+    (0, 0)
+
+(* The program gets a new generation each time a pass changes one of its
+   blocks. A pass whose last run changed nothing is skipped as long as the
+   program stays at the generation of that run, since it would change nothing
+   again. *)
+type pass = {
+  pass_name : string;
+  pass_run : program -> program;
+  mutable pass_runs : int;
+  mutable pass_skips : int;
+  mutable pass_noop_at : int option;
+      (** Generation of the program on which the last run changed nothing *)
+  mutable pass_time : float;
+  mutable pass_removed_instrs : int;
+  mutable pass_changed_blocks : int;
+  mutable pass_changed_defs : int;
+}
+
+let mk_pass (name : string) (run : program -> program) : pass =
+  {
+    pass_name = name;
+    pass_run = run;
+    pass_runs = 0;
+    pass_skips = 0;
+    pass_noop_at = None;
+    pass_time = 0.;
+    pass_removed_instrs = 0;
+    pass_changed_blocks = 0;
+    pass_changed_defs = 0;
+  }
+
+let run_pass (generation : int ref) (start_instrs : int) (pass : pass)
+    (p : program) : program =
+  if pass.pass_noop_at = Some !generation then begin
+    pass.pass_skips <- pass.pass_skips + 1;
+    Cli.debug_print "%s skipped, no block changed since its last run"
+      pass.pass_name;
+    p
+  end
+  else begin
+    let old_instrs = count_instr p in
+    let start_time = Unix.gettimeofday () in
+    let new_p = pass.pass_run p in
+    let time = Unix.gettimeofday () -. start_time in
+    let new_instrs = count_instr new_p in
+    let changed_blocks, changed_defs = changes p new_p in
+    pass.pass_runs <- pass.pass_runs + 1;
+    pass.pass_time <- pass.pass_time +. time;
+    pass.pass_removed_instrs <-
+      pass.pass_removed_instrs + old_instrs - new_instrs;
+    pass.pass_changed_blocks <- pass.pass_changed_blocks + changed_blocks;
+    pass.pass_changed_defs <- pass.pass_changed_defs + changed_defs;
+    if changed_blocks = 0 then pass.pass_noop_at <- Some !generation
+    else incr generation;
+    print_done ~msg:pass.pass_name start_instrs old_instrs new_instrs;
+    Cli.debug_print "%s done in %.3fs, %d blocks and %d definitions changed"
+      pass.pass_name time changed_blocks changed_defs;
+    new_p
+  end
+
 let optimize (p : program) : program =
   let start_instrs = count_instr p in
-  Cli.debug_print "Dead code removal...";
-  let p = Dead_code_removal.dead_code_removal p in
-  print_done start_instrs start_instrs (count_instr p);
-  let p = ref p in
+  let generation = ref 0 in
+  let dce = mk_pass "Dead code removal" Dead_code_removal.dead_code_removal in
+  let pe = mk_pass "Partial evaluation" Partial_evaluation.partial_evaluation in
+  let inl = mk_pass "Inlining" Inlining.inlining in
+  (* Sharing expressions undoes what inlining does, so it is only done once
+     the other passes are done *)
+  let cse =
+    mk_pass "Common subexpression elimination"
+      Common_subexpression_elimination.common_subexpression_elimination
+  in
+  let p = ref (run_pass generation start_instrs dce p) in
+  let rounds = ref 0 in
   (try
      while true do
-       Cli.debug_print "Partial evaluation...";
-       let old_instrs = count_instr !p in
-       p := Partial_evaluation.partial_evaluation !p;
-       p := Dead_code_removal.dead_code_removal !p;
-       let intermediate_instrs = count_instr !p in
-       print_done start_instrs old_instrs intermediate_instrs;
-       if intermediate_instrs = old_instrs then raise Exit
-       else begin
-         Cli.debug_print "Inlining...";
-         p := Inlining.inlining !p;
-         p := Dead_code_removal.dead_code_removal !p;
-         let end_instrs = count_instr !p in
-         print_done start_instrs intermediate_instrs end_instrs;
-         if end_instrs = intermediate_instrs then raise Exit
-       end
+       incr rounds;
+       let round_start = !generation in
+       p := run_pass generation start_instrs pe !p;
+       p := run_pass generation start_instrs dce !p;
+       p := run_pass generation start_instrs inl !p;
+       p := run_pass generation start_instrs dce !p;
+       (* the fixpoint is reached once a whole round leaves every block as it
+          was, rather than when the instruction count stops decreasing *)
+       if !generation = round_start then raise Fixpoint
      done
-   with Exit -> ());
-  let p = !p in
+   with Fixpoint -> ());
+  let p = run_pass generation start_instrs cse !p in
+  Cli.debug_print "Fixpoint reached after %d rounds" !rounds;
+  List.iter
+    (fun pass ->
+      Cli.debug_print
+        "%s: %d runs, %d skipped, %d instructions removed, %d blocks and %d \
+         definitions changed in %.3fs"
+        pass.pass_name pass.pass_runs pass.pass_skips pass.pass_removed_instrs
+        pass.pass_changed_blocks pass.pass_changed_defs pass.pass_time)
+    [ dce; pe; inl; cse ];
   let end_instrs = count_instr p in
   print_done ~msg:"Optimizations done! Total effect" start_instrs start_instrs
     end_instrs;
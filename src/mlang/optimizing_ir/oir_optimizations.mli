@@ -15,3 +15,8 @@
    this program. If not, see <https://www.gnu.org/licenses/>. *)
 
 val optimize : Oir.program -> Oir.program
+(** Alternates partial evaluation and inlining, each followed by dead code
+    removal, until a round changes no block. A pass is skipped when its last
+    run changed nothing and no block changed since. Common subexpressions are
+    then shared once. The runs, time spent, instructions removed and blocks
+    and definitions changed by each pass are printed in debug mode. *)
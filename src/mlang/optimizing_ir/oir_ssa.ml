@@ -0,0 +1,172 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+open Oir
+module BlockSet = Set.Make (Int)
+
+type def_site = Entry | Def of block_id | Phi of block_id
+
+type t = {
+  cfg : CFG.t;
+  entry_block : block_id;
+  idom : Dominators.idom;
+  is_reachable : block_id -> bool;
+  dom_frontier : (block_id, block_id list) Hashtbl.t;
+  def_blocks : BlockSet.t Bir.VariableMap.t;
+  mutable phi_blocks : BlockSet.t Bir.VariableMap.t;
+  mutable entry_defs : (block_id, def_site) Hashtbl.t Bir.VariableMap.t;
+      (** Memoized results of [def_at_block_entry] *)
+}
+
+let reachable_preds (is_reachable : block_id -> bool) (g : CFG.t)
+    (id : block_id) : block_id list =
+  List.filter is_reachable (CFG.pred g id)
+
+(* Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm" *)
+let compute_dom_frontier (g : CFG.t) (idom : Dominators.idom)
+    (is_reachable : block_id -> bool) : (block_id, block_id list) Hashtbl.t =
+  let df = Hashtbl.create 1000 in
+  CFG.iter_vertex
+    (fun id ->
+      let preds = reachable_preds is_reachable g id in
+      if is_reachable id && List.length preds >= 2 then
+        List.iter
+          (fun pred ->
+            let rec walk runner =
+              if runner <> idom id then begin
+                let frontier =
+                  Option.value ~default:[] (Hashtbl.find_opt df runner)
+                in
+                if not (List.mem id frontier) then
+                  Hashtbl.replace df runner (id :: frontier);
+                walk (idom runner)
+              end
+            in
+            walk pred)
+          preds)
+    g;
+  df
+
+let create (p : program) (analysis : cfg_analysis) : t =
+  let is_entry id = id = p.entry_block in
+  let is_reachable = Reachability.analyze is_entry analysis.cfg in
+  let rec add_defs (id : block_id) (stmts : stmt list)
+      (defs : BlockSet.t Bir.VariableMap.t) =
+    List.fold_left
+      (fun defs stmt ->
+        match Pos.unmark stmt with
+        | SAssign (_, { Mir.var_definition = Mir.InputVar; _ }) -> defs
+        | SAssign (var, _) ->
+            Bir.VariableMap.update var
+              (fun blocks ->
+                Some
+                  (BlockSet.add id
+                     (Option.value ~default:BlockSet.empty blocks)))
+              defs
+        | SRovCall (_, _, stmts) -> add_defs id stmts defs
+        | SConditional _ | SVerif _ | SGoto _ | SFunctionCall _ -> defs)
+      defs stmts
+  in
+  {
+    cfg = analysis.cfg;
+    entry_block = p.entry_block;
+    idom = analysis.idom;
+    is_reachable;
+    dom_frontier = compute_dom_frontier analysis.cfg analysis.idom is_reachable;
+    def_blocks = BlockMap.fold add_defs p.blocks Bir.VariableMap.empty;
+    phi_blocks = Bir.VariableMap.empty;
+    entry_defs = Bir.VariableMap.empty;
+  }
+
+let def_blocks (ssa : t) (var : Bir.variable) : BlockSet.t =
+  Option.value ~default:BlockSet.empty
+    (Bir.VariableMap.find_opt var ssa.def_blocks)
+
+(* Iterated dominance frontier of the blocks defining [var] *)
+let phi_blocks (ssa : t) (var : Bir.variable) : BlockSet.t =
+  match Bir.VariableMap.find_opt var ssa.phi_blocks with
+  | Some phis -> phis
+  | None ->
+      let rec place phis worklist =
+        match worklist with
+        | [] -> phis
+        | id :: worklist ->
+            let phis, worklist =
+              List.fold_left
+                (fun (phis, worklist) join ->
+                  if BlockSet.mem join phis then (phis, worklist)
+                  else (BlockSet.add join phis, join :: worklist))
+                (phis, worklist)
+                (Option.value ~default:[]
+                   (Hashtbl.find_opt ssa.dom_frontier id))
+            in
+            place phis worklist
+      in
+      let phis =
+        place BlockSet.empty
+          (BlockSet.elements
+             (BlockSet.filter ssa.is_reachable (def_blocks ssa var)))
+      in
+      ssa.phi_blocks <- Bir.VariableMap.add var phis ssa.phi_blocks;
+      phis
+
+let rec def_at_block_entry (ssa : t) (var : Bir.variable) (id : block_id) :
+    def_site =
+  if not (ssa.is_reachable id) then Entry
+  else
+    let memo =
+      match Bir.VariableMap.find_opt var ssa.entry_defs with
+      | Some memo -> memo
+      | None ->
+          let memo = Hashtbl.create 16 in
+          ssa.entry_defs <- Bir.VariableMap.add var memo ssa.entry_defs;
+          memo
+    in
+    match Hashtbl.find_opt memo id with
+    | Some site -> site
+    | None ->
+        let site =
+          if BlockSet.mem id (phi_blocks ssa var) then Phi id
+          else if id = ssa.entry_block then Entry
+          else def_at_block_exit ssa var (ssa.idom id)
+        in
+        Hashtbl.add memo id site;
+        site
+
+and def_at_block_exit (ssa : t) (var : Bir.variable) (id : block_id) : def_site
+    =
+  if BlockSet.mem id (def_blocks ssa var) then Def id
+  else def_at_block_entry ssa var id
+
+let phi_operands (ssa : t) (var : Bir.variable) (join : block_id) :
+    def_site list =
+  List.map
+    (fun pred -> def_at_block_exit ssa var pred)
+    (reachable_preds ssa.is_reachable ssa.cfg join)
+
+let reaching_defs (ssa : t) (var : Bir.variable) (site : def_site) :
+    def_site list =
+  let rec expand (visited, acc) site =
+    match site with
+    | Entry | Def _ -> (visited, if List.mem site acc then acc else site :: acc)
+    | Phi join ->
+        if BlockSet.mem join visited then (visited, acc)
+        else
+          List.fold_left expand
+            (BlockSet.add join visited, acc)
+            (phi_operands ssa var join)
+  in
+  List.rev (snd (expand (BlockSet.empty, []) site))
@@ -0,0 +1,52 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** SSA view of an OIR program.
+
+    The statements are not rewritten: a variable is still assigned in place,
+    but each definition site gets an SSA name. Phi nodes are placed at the join
+    points of the [SConditional]s, on the iterated dominance frontier of the
+    blocks defining each variable. The definition reaching a block is then
+    found by walking up the dominator tree instead of comparing every
+    definition of the variable against every other. *)
+
+(** The SSA name of a variable at some point of the program *)
+type def_site =
+  | Entry  (** The variable has not been assigned since the entry block *)
+  | Def of Oir.block_id
+      (** The last definition of the variable in this block *)
+  | Phi of Oir.block_id
+      (** The merge of the definitions coming from the predecessors of this
+          join block *)
+
+type t
+
+val create : Oir.program -> Oir.cfg_analysis -> t
+(** Collects the definition sites of the variables of the program. Phi nodes
+    and reaching definitions are computed lazily, per variable. *)
+
+val def_at_block_entry : t -> Bir.variable -> Oir.block_id -> def_site
+(** Blocks unreachable from the entry block get [Entry]. *)
+
+val def_at_block_exit : t -> Bir.variable -> Oir.block_id -> def_site
+
+val phi_operands : t -> Bir.variable -> Oir.block_id -> def_site list
+(** Definitions merged by the phi node of the variable at this join block, one
+    per reachable predecessor. *)
+
+val reaching_defs : t -> Bir.variable -> def_site -> def_site list
+(** Expands the phi nodes into the [Entry] and [Def] sites they merge. The
+    result has no duplicates. *)
@@ -106,18 +106,16 @@ type partial_ev_ctx = {
       (** The option at the leaves of the [BlockMap.t] is to account for
           definitions that are not literals but that are to be taken into
           account for validity of inlining later *)
-  ctx_doms : Dominators.dom;
-  ctx_paths : Paths.path_checker;
+  ctx_ssa : Oir_ssa.t;
   ctx_entry_block : block_id;
   ctx_inside_block : block_id option;
 }
 
-let empty_ctx (g : CFG.t) (entry_block : block_id) =
+let empty_ctx (ssa : Oir_ssa.t) (entry_block : block_id) =
   {
     ctx_local_vars = Mir.LocalVariableMap.empty;
     ctx_vars = Bir.VariableMap.empty;
-    ctx_doms = Dominators.idom_to_dom (Dominators.compute_idom g entry_block);
-    ctx_paths = Paths.create g;
+    ctx_ssa = ssa;
     ctx_inside_block = None;
     ctx_entry_block = entry_block;
   }
@@ -129,13 +127,6 @@ let reset_ctx (ctx : partial_ev_ctx) (block_id : block_id) =
     ctx_inside_block = Some block_id;
   }
 
-let compare_for_min_dom (dom : Dominators.dom) (id1 : block_id) (id2 : block_id)
-    : int =
-  (* the sort puts smaller items first, and we want the first item to be the
-     block that is less dominating. So if id1 dominates id2, we want id2 to be
-     smaller hence returning a positive value *)
-  if dom id1 id2 then 1 else if dom id2 id1 then -1 else 0
-
 let add_var_def_to_ctx (ctx : partial_ev_ctx) (block_id : block_id)
     (var : Bir.variable) (var_lit : var_literal option) : partial_ev_ctx =
   {
@@ -148,120 +139,97 @@ let add_var_def_to_ctx (ctx : partial_ev_ctx) (block_id : block_id)
         ctx.ctx_vars;
   }
 
+(* If several definitions can reach a use but they have the same
+   defined-ness, we keep that information *)
+let merge_defs (def : var_literal) (other_defs : var_literal option list) :
+    var_literal option =
+  List.fold_left
+    (fun acc od ->
+      match (acc, od) with
+      | _, None | None, _ -> None
+      | Some (SimpleVar a), Some (SimpleVar d) -> (
+          match (a, d) with
+          | PartialLiteral (Float _), PartialLiteral (Float _)
+          | PartialLiteral (Float _), UnknownFloat
+          | UnknownFloat, PartialLiteral (Float _)
+          | UnknownFloat, UnknownFloat ->
+              Some (SimpleVar UnknownFloat)
+          | _ -> None)
+      | Some (TableVar (ai, aa)), Some (TableVar (di, da)) -> (
+          assert (ai = di);
+          let partials =
+            List.fold_left2
+              (fun acc a d ->
+                match acc with
+                | None -> None
+                | Some acc -> (
+                    match (a, d) with
+                    | PartialLiteral (Float _), PartialLiteral (Float _)
+                    | PartialLiteral (Float _), UnknownFloat
+                    | UnknownFloat, PartialLiteral (Float _)
+                    | UnknownFloat, UnknownFloat ->
+                        Some (UnknownFloat :: acc)
+                    | _ -> None))
+              (Some []) (Array.to_list aa) (Array.to_list da)
+          in
+          match partials with
+          | None -> None
+          | Some ps -> Some (TableVar (ai, Array.of_list (List.rev ps))))
+      | Some (TableVar _), _ | _, Some (TableVar _) -> assert false)
+    (Some def) other_defs
+
 let get_closest_dominating_def (var : Bir.variable) (ctx : partial_ev_ctx) :
     var_literal option =
   let curr_block = Option.get ctx.ctx_inside_block in
   match Bir.VariableMap.find_opt var ctx.ctx_vars with
   | None -> None
   | Some previous_defs -> (
-      let dominating_defs =
-        BlockMap.bindings
-          (BlockMap.filter
-             (fun def_block_id def ->
-               Option.is_some def
-               (* we only consider definitions that were partially evaluated to
-                  a literal *)
-               && (def_block_id = curr_block
-                  || ctx.ctx_doms def_block_id curr_block))
-             previous_defs)
-      in
-      let sorted_dominating_defs =
-        List.sort
-          (fun (b1, _) (b2, _) -> compare_for_min_dom ctx.ctx_doms b1 b2)
-          dominating_defs
-      in
-      match sorted_dominating_defs with
-      | [] -> None
-      | (_, None) :: _ -> assert false (* should not happen *)
-      | (def_block, Some def) :: _ ->
-          (* Now we have the closest def in a block that dominates the current
-             block. But something could go wrong in the case where a branch of
-             an if in between the current block and the def block redefines the
-             variable. So we have to check that they are no such defs *)
-          if def_block = Option.get ctx.ctx_inside_block then Some def
-          else
-            let exists_other_def_in_between =
-              BlockMap.filter
-                (fun intermediate_block ov ->
-                  if
-                    intermediate_block = def_block
-                    || intermediate_block = curr_block
-                  then false
-                  else
-                    Paths.check_path ctx.ctx_paths def_block intermediate_block
-                    && Paths.check_path ctx.ctx_paths intermediate_block
-                         curr_block
-                    (* if the definition is the same, this is not an issue *)
-                    && (Option.compare Stdlib.compare) ov (Some def) <> 0)
-                previous_defs
-            in
-            if BlockMap.cardinal exists_other_def_in_between > 0 then
-              (* if there are multiple conflicting definitions but they have the
-                 same defined-ness, we keep that information *)
-              let defs =
-                List.map snd (BlockMap.bindings exists_other_def_in_between)
-              in
-              let result =
-                List.fold_left
-                  (fun acc od ->
-                    match (acc, od) with
-                    | _, None | None, _ -> None
-                    | Some (SimpleVar a), Some (SimpleVar d) -> (
-                        match (a, d) with
-                        | PartialLiteral (Float _), PartialLiteral (Float _)
-                        | PartialLiteral (Float _), UnknownFloat
-                        | UnknownFloat, PartialLiteral (Float _)
-                        | UnknownFloat, UnknownFloat ->
-                            Some (SimpleVar UnknownFloat)
-                        | _ -> None)
-                    | Some (TableVar (ai, aa)), Some (TableVar (di, da)) -> (
-                        assert (ai = di);
-                        let partials =
-                          List.fold_left2
-                            (fun acc a d ->
-                              match acc with
-                              | None -> None
-                              | Some acc -> (
-                                  match (a, d) with
-                                  | ( PartialLiteral (Float _),
-                                      PartialLiteral (Float _) )
-                                  | PartialLiteral (Float _), UnknownFloat
-                                  | UnknownFloat, PartialLiteral (Float _)
-                                  | UnknownFloat, UnknownFloat ->
-                                      Some (UnknownFloat :: acc)
-                                  | _ -> None))
-                            (Some []) (Array.to_list aa) (Array.to_list da)
-                        in
-                        match partials with
-                        | None -> None
-                        | Some ps ->
-                            Some (TableVar (ai, Array.of_list (List.rev ps))))
-                    | Some (TableVar _), _ | _, Some (TableVar _) ->
-                        assert false)
-                  (Some def) defs
-              in
-              result
-            else Some def)
+      match BlockMap.find_opt curr_block previous_defs with
+      | Some def ->
+          (* the variable has already been defined earlier in this block *)
+          def
+      | None -> (
+          (* the blocks are visited in topological order so every definition
+             reaching the current block has already been recorded *)
+          let reaching_defs =
+            List.map
+              (function
+                | Oir_ssa.Def def_block ->
+                    Option.join (BlockMap.find_opt def_block previous_defs)
+                | Oir_ssa.Entry | Oir_ssa.Phi _ -> None)
+              (Oir_ssa.reaching_defs ctx.ctx_ssa var
+                 (Oir_ssa.def_at_block_entry ctx.ctx_ssa var curr_block))
+          in
+          match reaching_defs with
+          | [] | None :: _ -> None
+          | Some def :: other_defs ->
+              (* if the definition is the same, this is not an issue *)
+              merge_defs def
+                (List.filter
+                   (fun od ->
+                     (Option.compare Stdlib.compare) od (Some def) <> 0)
+                   other_defs)))
 
 let interpreter_ctx_from_partial_ev_ctx (ctx : partial_ev_ctx) :
     Bir_interpreter.RegularFloatInterpreter.ctx =
-  {
-    Bir_interpreter.RegularFloatInterpreter.empty_ctx with
-    Bir_interpreter.RegularFloatInterpreter.ctx_vars =
-      Bir.VariableMap.map Option.get
-        (Bir.VariableMap.filter
-           (fun _ x -> Option.is_some x)
-           (Bir.VariableMap.mapi
-              (fun var _ ->
-                match get_closest_dominating_def var ctx with
-                | Some (SimpleVar (PartialLiteral l)) ->
-                    Some
-                      (Bir_interpreter.RegularFloatInterpreter.SimpleVar
-                         (Bir_interpreter.RegularFloatInterpreter
-                          .literal_to_value l))
-                | _ -> None)
-              ctx.ctx_vars));
-  }
+  let ictx =
+    {
+      Bir_interpreter.RegularFloatInterpreter.empty_ctx with
+      Bir_interpreter.RegularFloatInterpreter.ctx_tgv =
+        Array.make (Bir.size_of_tgv ())
+          Bir_interpreter.RegularFloatInterpreter.Undefined;
+    }
+  in
+  Bir.VariableMap.iter
+    (fun var _ ->
+      match get_closest_dominating_def var ctx with
+      | Some (SimpleVar (PartialLiteral l)) ->
+          Bir_interpreter.RegularFloatInterpreter.set_var_value ictx var
+            (Bir_interpreter.RegularFloatInterpreter.SimpleVar
+               (Bir_interpreter.RegularFloatInterpreter.literal_to_value l))
+      | _ -> ())
+    ctx.ctx_vars;
+  ictx
 
 let check e d =
   match Pos.unmark e with
@@ -763,7 +731,8 @@ let rec partially_evaluate_stmt (stmt : stmt) (block_id : block_id)
 (* TODO: Implement me *)
 
 let partial_evaluation (p : program) : program =
-  let g = get_cfg p in
+  let analysis = get_cfg_analysis p in
+  let ssa = Oir_ssa.create p analysis in
   let p, _ =
     Topological.fold
       (fun (block_id : block_id) (p, ctx) ->
@@ -777,7 +746,7 @@ let partial_evaluation (p : program) : program =
         in
         ( { p with blocks = BlockMap.add block_id (List.rev new_block) p.blocks },
           ctx ))
-      g
-      (p, empty_ctx g p.entry_block)
+      analysis.cfg
+      (p, empty_ctx ssa p.entry_block)
   in
   p
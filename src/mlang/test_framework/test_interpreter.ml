@@ -120,55 +120,63 @@ let to_MIR_function_and_inputs (program : Bir.program) (t : test_file)
   ( { func_variable_inputs; func_constant_inputs; func_outputs; func_conds },
     input_file )
 
-let add_test_conds_to_combined_program (p : Bir.program)
-    (conds : Bir.condition_data Bir.VariableMap.t) : Bir.program =
-  (* because evaluate_program redefines everything each time, we have to make
-     sure that the redefinitions of our constant inputs are removed from the
-     main list of statements *)
-  let filter_stmts stmts =
-    List.filter_map
-      (fun stmt ->
-        match Pos.unmark stmt with
-        | Bir.SAssign (var, var_data) -> (
-            let new_var_data =
-              {
-                var_data with
-                var_io = Regular;
-                var_definition =
-                  (match var_data.var_definition with
-                  | InputVar ->
-                      SimpleVar
-                        (Pos.same_pos_as (Mir.Literal Undefined)
-                           (Bir.var_to_mir var).Mir.Variable.name)
-                  | SimpleVar old -> SimpleVar old
-                  | TableVar (size, old) -> TableVar (size, old));
-              }
-            in
-            match new_var_data.var_definition with
-            | InputVar -> None
-            | _ -> Some (Pos.same_pos_as (Bir.SAssign (var, new_var_data)) stmt)
-            )
-        | _ -> Some stmt)
-      stmts
+let optimize_program (combined_program : Bir.program) : Bir.program =
+  Cli.debug_print "Translating to CFG form for optimizations...";
+  let oir_program = Bir_to_oir.bir_program_to_oir combined_program in
+  Cli.debug_print "Optimizing...";
+  let oir_program = Oir_optimizations.optimize oir_program in
+  Cli.debug_print "Translating back to AST...";
+  Bir_to_oir.oir_program_to_bir oir_program
+
+(* All the tests run the same program, prepared only once: it is adapted to a
+   function whose inputs are all the inputs of the tests and whose outputs are
+   all the variables they check, and optimized with [optimize]. Each test then
+   runs it from a fresh context, where only its own inputs are defined, and
+   checks its conditions after it. *)
+let program_for_tests (p : Bir.program) (tests : test_file list)
+    (optimize : bool) : Bir.program * int =
+  let add_vars (vars : unit Bir.VariableMap.t) (var_values : var_values) =
+    List.fold_left
+      (fun vars (var, _, pos) ->
+        match find_var_of_name p.mir_program (var, pos) with
+        | var -> Bir.VariableMap.add Bir.(var_from_mir default_tgv var) () vars
+        (* unknown variables make the test itself fail later on *)
+        | exception Not_found -> vars)
+      vars var_values
   in
-  let new_stmts = filter_stmts (Bir.main_statements p) in
-  let conditions_stmts =
-    Bir.VariableMap.fold
-      (fun _ cond stmts ->
-        (Bir.SVerif cond, Pos.get_position cond.cond_expr) :: stmts)
-      conds []
+  let func_variable_inputs, func_outputs =
+    List.fold_left
+      (fun (inputs, outputs) t -> (add_vars inputs t.ep, add_vars outputs t.rp))
+      (Bir.VariableMap.empty, Bir.VariableMap.empty)
+      tests
   in
-  let mpp_functions =
-    Bir.FunctionMap.add p.Bir.main_function
-      Bir.{ mppf_stmts = new_stmts @ conditions_stmts; mppf_is_verif = false }
-      p.mpp_functions
+  let p, code_loc_offset =
+    Bir_interface.adapt_program_to_function p
+      {
+        func_variable_inputs;
+        func_constant_inputs = Bir.VariableMap.empty;
+        func_outputs;
+        func_conds = Bir.VariableMap.empty;
+      }
   in
-  { p with mpp_functions }
+  ((if optimize then optimize_program p else p), code_loc_offset)
 
-let check_test (combined_program : Bir.program) (test_name : string)
-    (optimize : bool) (code_coverage : bool)
-    (value_sort : Bir_interpreter.value_sort) (test_error_margin : float) :
-    Bir_instrumentation.code_coverage_result =
+let prepare_for_tests (p : Bir.program) (tests : test_file list)
+    (optimize : bool) (value_sort : Bir_interpreter.value_sort) :
+    Bir_interpreter.prepared_program =
+  let p, code_loc_offset = program_for_tests p tests optimize in
+  Bir_interpreter.prepare_program p (-code_loc_offset) value_sort
+
+let conds_statements (conds : Bir.condition_data Bir.VariableMap.t) :
+    Bir.stmt list =
+  Bir.VariableMap.fold
+    (fun _ cond stmts ->
+      (Bir.SVerif cond, Pos.get_position cond.cond_expr) :: stmts)
+    conds []
+
+let check_test_with_program (prepared : Bir_interpreter.prepared_program)
+    (combined_program : Bir.program) (test_name : string) (code_coverage : bool)
+    (test_error_margin : float) : Bir_instrumentation.code_coverage_result =
   Cli.debug_print "Parsing %s..." test_name;
   let t = parse_file test_name in
   Cli.debug_print "Running test %s..." t.nom;
@@ -176,34 +184,26 @@ let check_test (combined_program : Bir.program) (test_name : string)
     to_MIR_function_and_inputs combined_program t test_error_margin
   in
   Cli.debug_print "Executing program";
-  let combined_program, code_loc_offset =
-    Bir_interface.adapt_program_to_function combined_program f
-  in
-  let combined_program =
-    add_test_conds_to_combined_program combined_program f.func_conds
-  in
-  (* Cli.debug_print "Combined Program (w/o verif conds):@.%a@."
-     Format_bir.format_program combined_program; *)
-  let combined_program =
-    if optimize then begin
-      Cli.debug_print "Translating to CFG form for optimizations...";
-      let oir_program = Bir_to_oir.bir_program_to_oir combined_program in
-      Cli.debug_print "Optimizing...";
-      let oir_program = Oir_optimizations.optimize oir_program in
-      Cli.debug_print "Translating back to AST...";
-      let combined_program = Bir_to_oir.oir_program_to_bir oir_program in
-      combined_program
-    end
-    else combined_program
-  in
   if code_coverage then Bir_instrumentation.code_coverage_init ();
   let _print_outputs =
-    Bir_interpreter.evaluate_program f combined_program input_file
-      (-code_loc_offset) value_sort
+    Bir_interpreter.run_prepared_program
+      ~conds:(conds_statements f.func_conds)
+      f prepared input_file
   in
   if code_coverage then Bir_instrumentation.code_coverage_result ()
   else Bir_instrumentation.empty_code_coverage_result
 
+let check_test (combined_program : Bir.program) (test_name : string)
+    (optimize : bool) (code_coverage : bool)
+    (value_sort : Bir_interpreter.value_sort) (test_error_margin : float) :
+    Bir_instrumentation.code_coverage_result =
+  let prepared =
+    prepare_for_tests combined_program [ parse_file test_name ] optimize
+      value_sort
+  in
+  check_test_with_program prepared combined_program test_name code_coverage
+    test_error_margin
+
 type test_failures = (string * Mir.literal * Mir.literal) list Bir.VariableMap.t
 
 type process_acc =
@@ -220,9 +220,92 @@ let incr_int_key (m : int IntMap.t) (key : int) : int IntMap.t =
   | None -> IntMap.add key 0 m
   | Some i -> IntMap.add key (i + 1) m
 
+type test_result = {
+  test_name : string;
+  test_time : float;  (** Wall time of the test, in seconds *)
+  test_error : string option;  (** [None] if the test passed *)
+  test_failures : test_failures;
+}
+
+let escape_json (str : string) : string =
+  let buf = Buffer.create (String.length str) in
+  String.iter
+    (fun c ->
+      match c with
+      | '"' -> Buffer.add_string buf "\\\""
+      | '\\' -> Buffer.add_string buf "\\\\"
+      | '\n' -> Buffer.add_string buf "\\n"
+      | c when Char.code c < 0x20 ->
+          Buffer.add_string buf (Printf.sprintf "\\u%04x" (Char.code c))
+      | c -> Buffer.add_char buf c)
+    str;
+  Buffer.contents buf
+
+let escape_xml (str : string) : string =
+  let buf = Buffer.create (String.length str) in
+  String.iter
+    (fun c ->
+      match c with
+      | '<' -> Buffer.add_string buf "&lt;"
+      | '>' -> Buffer.add_string buf "&gt;"
+      | '&' -> Buffer.add_string buf "&amp;"
+      | '"' -> Buffer.add_string buf "&quot;"
+      | c when Char.code c < 0x20 && c <> '\n' && c <> '\t' -> ()
+      | c -> Buffer.add_char buf c)
+    str;
+  Buffer.contents buf
+
+(* The report is in the JUnit XML format if [report] ends with [.xml], and in
+   JSON otherwise *)
+let write_test_report (report : string) (test_dir : string)
+    (results : test_result list) : unit =
+  let oc = open_out report in
+  let num_failures =
+    List.length (List.filter (fun r -> r.test_error <> None) results)
+  in
+  let total_time = List.fold_left (fun t r -> t +. r.test_time) 0. results in
+  if Filename.check_suffix report ".xml" then begin
+    Printf.fprintf oc "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    Printf.fprintf oc
+      "<testsuite name=\"%s\" tests=\"%d\" failures=\"%d\" time=\"%.3f\">\n"
+      (escape_xml test_dir) (List.length results) num_failures total_time;
+    List.iter
+      (fun r ->
+        Printf.fprintf oc "  <testcase name=\"%s\" time=\"%.3f\""
+          (escape_xml r.test_name) r.test_time;
+        match r.test_error with
+        | None -> Printf.fprintf oc "/>\n"
+        | Some msg ->
+            Printf.fprintf oc ">\n    <failure message=\"%s\"/>\n"
+              (escape_xml msg);
+            Printf.fprintf oc "  </testcase>\n")
+      results;
+    Printf.fprintf oc "</testsuite>\n"
+  end
+  else begin
+    Printf.fprintf oc "{\n  \"tests\": %d,\n  \"failures\": %d,\n"
+      (List.length results) num_failures;
+    Printf.fprintf oc "  \"time\": %.3f,\n  \"results\": [" total_time;
+    List.iteri
+      (fun i r ->
+        Printf.fprintf oc "%s\n    { \"name\": \"%s\", \"passed\": %b, "
+          (if i = 0 then "" else ",")
+          (escape_json r.test_name) (r.test_error = None);
+        Printf.fprintf oc "\"time\": %.3f" r.test_time;
+        (match r.test_error with
+        | None -> ()
+        | Some msg ->
+            Printf.fprintf oc ", \"error\": \"%s\"" (escape_json msg));
+        Printf.fprintf oc " }")
+      results;
+    Printf.fprintf oc "\n  ]\n}\n"
+  end;
+  close_out oc
+
 let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
     (code_coverage_activated : bool) (value_sort : Bir_interpreter.value_sort)
-    (test_error_margin : float) =
+    (test_error_margin : float) (workers : int) (chunksize : int)
+    (report : string option) =
   let arr = Sys.readdir test_dir in
   let arr =
     Array.of_list
@@ -233,9 +316,30 @@ let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
   Bir_interpreter.exit_on_rte := false;
   (* sort by increasing size, hoping that small files = simple tests *)
   Array.sort compare arr;
+  Cli.debug_print "Preparing the program once for all the tests...";
+  let prepared =
+    let tests =
+      List.filter_map
+        (fun name ->
+          (* syntax errors are reported when running the test *)
+          try Some (parse_file (test_dir ^ name))
+          with Errors.StructuredError _ -> None)
+        (Array.to_list arr)
+    in
+    prepare_for_tests p tests optimize value_sort
+  in
   Cli.warning_flag := false;
   Cli.display_time := false;
-  let _, finish = Cli.create_progress_bar "Testing files" in
+  let current_progress, finish = Cli.create_progress_bar "Testing files" in
+  (* The last error printed by [process], for the report *)
+  let last_error = ref None in
+  let error_print kont =
+    Format.kasprintf
+      (fun msg ->
+        last_error := Some msg;
+        Cli.error_print "%s" msg)
+      kont
+  in
   let process (name : string)
       ((successes, failures, code_coverage_acc) : process_acc) : process_acc =
     let report_violated_condition_error
@@ -255,7 +359,7 @@ let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
                       _ ),
                     _ ),
                 _ ) ) ) ->
-          Cli.error_print "Test %s incorrect (error on variable %s)" name
+          error_print "Test %s incorrect (error on variable %s)" name
             (Pos.unmark (Bir.var_to_mir v).Mir.Variable.name);
           let errs_varname =
             try Bir.VariableMap.find v failures with Not_found -> []
@@ -264,15 +368,15 @@ let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
             Bir.VariableMap.add v ((name, l1, l2) :: errs_varname) failures,
             code_coverage_acc )
       | _ ->
-          Cli.error_print "Test %s incorrect (error %s raised)" name
+          error_print "Test %s incorrect (error %s raised)" name
             (Pos.unmark err.Mir.Error.name);
           (successes, failures, code_coverage_acc)
     in
     try
       Cli.debug_flag := false;
       let code_coverage_result =
-        check_test p (test_dir ^ name) optimize code_coverage_activated
-          value_sort test_error_margin
+        check_test_with_program prepared p (test_dir ^ name)
+          code_coverage_activated test_error_margin
       in
       Cli.debug_flag := true;
       let code_coverage_acc =
@@ -385,7 +489,7 @@ let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
     | Bir_interpreter.RationalInterpreter.RuntimeError
         (Bir_interpreter.RationalInterpreter.StructuredError (msg, pos, kont), _)
     | Errors.StructuredError (msg, pos, kont) ->
-        Cli.error_print "Error in test %s: %a" name
+        error_print "Error in test %s: %a" name
           Errors.format_structured_error (msg, pos);
         (match kont with None -> () | Some kont -> kont ());
         (successes, failures, code_coverage_acc)
@@ -394,23 +498,72 @@ let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
     | Bir_interpreter.MPFRInterpreter.RuntimeError (_, _)
     | Bir_interpreter.RegularFloatInterpreter.RuntimeError (_, _)
     | Bir_interpreter.RationalInterpreter.RuntimeError (_, _) ->
-        Cli.error_print "Runtime error in test %s" name;
+        error_print "Runtime error in test %s" name;
+        (successes, failures, code_coverage_acc)
+    (* Any other exception would end the worker process running the test, and
+       the remaining tests of the queue with it: it fails this test only *)
+    | e ->
+        error_print "Error in test %s: %s" name (Printexc.to_string e);
         (successes, failures, code_coverage_acc)
   in
-  let s, f, code_coverage =
-    Parmap.parfold ~chunksize:5 process (Parmap.A arr)
-      ([], Bir.VariableMap.empty, Bir.VariableMap.empty)
-      (fun (old_s, old_f, old_code_coverage) (new_s, new_f, new_code_coverage)
-      ->
-        ( new_s @ old_s,
-          Bir.VariableMap.union (fun _ x1 x2 -> Some (x1 @ x2)) old_f new_f,
-          Bir_instrumentation.merge_code_coverage_acc old_code_coverage
-            new_code_coverage ))
+  (* Each worker accumulates the code coverage of its tests, and only sends it
+     once all the tests are done *)
+  if code_coverage_activated then
+    Bir_instrumentation.code_coverage_register_code_locs
+      (Bir_instrumentation.get_code_locs p);
+  let worker_code_coverage =
+    ref (Bir_instrumentation.empty_code_coverage_acc ())
+  in
+  let run_test (i : int) : test_result =
+    let name = arr.(i) in
+    last_error := None;
+    let start = Unix.gettimeofday () in
+    let successes, failures, code_coverage_acc =
+      process name ([], Bir.VariableMap.empty, !worker_code_coverage)
+    in
+    worker_code_coverage := code_coverage_acc;
+    {
+      test_name = name;
+      test_time = Unix.gettimeofday () -. start;
+      test_error =
+        (if successes <> [] then None
+        else Some (Option.value ~default:"test failed" !last_error));
+      test_failures = failures;
+    }
+  in
+  let results = Array.make (Array.length arr) None in
+  let code_coverages =
+    Work_queue.run ~workers ~chunksize run_test
+      (fun () -> !worker_code_coverage)
+      (Array.length arr)
+      (fun i result ->
+        current_progress result.test_name;
+        results.(i) <- Some result)
+  in
+  let results = Array.to_list (Array.map Option.get results) in
+  let s =
+    List.filter_map
+      (fun r -> if r.test_error = None then Some r.test_name else None)
+      results
+  in
+  let f =
+    List.fold_left
+      (fun f r ->
+        Bir.VariableMap.union (fun _ x1 x2 -> Some (x1 @ x2)) f r.test_failures)
+      Bir.VariableMap.empty results
+  in
+  let code_coverage =
+    List.fold_left Bir_instrumentation.merge_code_coverage_acc
+      (Bir_instrumentation.empty_code_coverage_acc ())
+      code_coverages
   in
   finish "done!";
   Cli.warning_flag := true;
   Cli.display_time := true;
   Cli.result_print "Test results: %d successes" (List.length s);
+  (match report with
+  | Some report -> write_test_report report test_dir results
+  | None -> ());
 
   let f_l =
     List.sort
@@ -433,17 +586,12 @@ let check_all_tests (p : Bir.program) (test_dir : string) (optimize : bool)
     let all_code_locs = Bir_instrumentation.get_code_locs p in
     let all_code_locs_with_coverage =
       Bir_instrumentation.CodeLocationMap.mapi
-        (fun code_loc var ->
-          match Bir.VariableMap.find_opt var code_coverage with
-          | None -> NotCovered
-          | Some used_code_locs -> (
-              match
-                Bir_instrumentation.CodeLocationMap.find_opt code_loc
-                  used_code_locs
-              with
-              | None -> NotCovered
-              | Some def ->
-                  Covered (Bir_instrumentation.VarLiteralSet.cardinal def)))
+        (fun code_loc _ ->
+          match
+            Bir_instrumentation.code_coverage_num_values code_coverage code_loc
+          with
+          | 0 -> NotCovered
+          | n -> Covered n)
         all_code_locs
     in
     let all_code_locs_num =
@@ -35,5 +35,13 @@ val check_all_tests :
   bool ->
   Bir_interpreter.value_sort ->
   float ->
+  (* workers *) int ->
+  (* chunksize *) int ->
+  (* report file *) string option ->
   unit
-(** Similar to [check_test] but tests a whole folder full of test files *)
+(** Similar to [check_test] but tests a whole folder full of test files. The
+    program is prepared once for all the tests: adapted to their inputs and
+    outputs, optimized with [optimize], and translated into closures with
+    {!Bir_interpreter.compile_to_closures}. The tests are run by [workers] processes, that are given
+    [chunksize] tests at a time and send back each result as soon as it is
+    known. *)
@@ -74,7 +74,13 @@ let backend =
     value
     & opt (some string) None
     & info [ "backend"; "b" ] ~docv:"BACKEND"
-        ~doc:"Backend selection: interpreter, Python, C, dgfip_c")
+        ~doc:
+          "Backend selection: interpreter, closure (interpreter running the \
+           program compiled to closures, also usable with --run_test and \
+           --run_all_tests), Python, python_numpy (Python computing many \
+           households at once with numpy), C, c_batch (C computing many \
+           households at once), Java, java_primitive (Java without any \
+           MValue allocation), dgfip_c")
 
 let function_spec =
   Arg.(
@@ -88,6 +94,41 @@ let function_spec =
            from the M code corpus. If no function_spec is specified, all \
            available inputs and outputs are used for the calculation.")
 
+let specialize =
+  Arg.(
+    value
+    & opt_all file []
+    & info [ "specialize" ] ~docv:"PROFILE"
+        ~doc:
+          "Profile for which the C backend generates a specialized variant of \
+           the computation (can be repeated). $(i, PROFILE) is a .m_spec file \
+           whose $(b,const) section fixes the values of some inputs of the \
+           function; its other sections are ignored. The variants are \
+           optimized with these inputs replaced by their values, and the \
+           generated m_extracted_ctx dispatches each call to the first variant \
+           whose fixed inputs match, or to the generic computation.")
+
+let instrument =
+  Arg.(
+    value & flag
+    & info [ "instrument" ]
+        ~doc:
+          "Makes the C backend count the calls of each rule, verification and \
+           mpp function and the processor ticks spent in them, for each \
+           computation context. The generated code then provides \
+           m_ctx_prof_report and m_ctx_prof_folded to dump these statistics.")
+
+let parallel_rules =
+  Arg.(
+    value & flag
+    & info [ "parallel_rules" ]
+        ~doc:
+          "Makes the C backend also generate m_extracted_par, which runs the \
+           rules that do not depend on each other at the same time on the \
+           threads of a pool created by m_pool_new, with the same results as \
+           m_extracted_ctx. The verifications are run alone, once all the \
+           rules before them are done.")
+
 let mpp_file =
   Arg.(
     required
@@ -124,6 +165,33 @@ let run_test =
     & info [ "run_test"; "r" ] ~docv:"TESTS"
         ~doc:"Run specific test passed as argument")
 
+let test_workers =
+  Arg.(
+    value
+    & opt (some int) None
+    & info [ "test_workers" ] ~docv:"WORKERS"
+        ~doc:
+          "Number of processes running the tests with --run_all_tests. Default \
+           is the number of cores")
+
+let test_chunksize =
+  Arg.(
+    value & opt int 1
+    & info [ "test_chunksize" ] ~docv:"CHUNKSIZE"
+        ~doc:
+          "Number of tests given at once to an idle process with \
+           --run_all_tests. Default is 1")
+
+let test_report =
+  Arg.(
+    value
+    & opt (some string) None
+    & info [ "test_report" ] ~docv:"REPORT"
+        ~doc:
+          "File where --run_all_tests writes the result and the wall time of \
+           each test, in the JUnit XML format if $(i, REPORT) ends with .xml \
+           and in JSON otherwise")
+
 let code_coverage =
   Arg.(
     value & flag
@@ -178,13 +246,25 @@ let var_dependencies =
     & info [ "var_dependencies" ]
         ~doc:"Output list of dependencies of the given variable")
 
+let cache_dir =
+  Arg.(
+    value
+    & opt (some string) None
+    & info [ "cache" ] ~docv:"CACHE_DIR"
+        ~doc:
+          "Directory where the result of parsing, typechecking and combining \
+           the M program is stored, and reused by the next invocations on the \
+           same sources, M++ file and options")
+
 let mlang_t f =
   Term.(
     const f $ files $ debug $ var_info_debug $ display_time $ dep_graph_file
     $ no_print_cycles $ backend $ function_spec $ mpp_file $ output
     $ run_all_tests $ run_test $ mpp_function $ optimize $ optimize_unsafe_float
     $ code_coverage $ precision $ test_error_margin $ m_clean_calls
-    $ dgfip_options $ var_dependencies)
+    $ dgfip_options $ var_dependencies $ cache_dir $ test_workers
+    $ test_chunksize $ test_report $ specialize $ instrument
+    $ parallel_rules)
 
 let info =
   let doc =
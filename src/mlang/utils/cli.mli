@@ -40,6 +40,13 @@ val mlang_t :
   bool ->
   string list option ->
   (string * string) option ->
+  string option ->
+  int option ->
+  int ->
+  string option ->
+  string list ->
+  bool ->
+  bool ->
   'a) ->
   'a Cmdliner.Term.t
 (** Mlang binary command-line arguments parsing function *)
@@ -0,0 +1,136 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+type ('a, 'b) message = Result of int * 'a | Finished of 'b
+
+type worker = {
+  pid : int;
+  to_worker : out_channel;
+  from_worker : Unix.file_descr;
+  mutable pending : int;  (** Jobs sent to the worker but not done yet *)
+}
+
+let rec really_read (fd : Unix.file_descr) (buf : bytes) (ofs : int)
+    (len : int) : unit =
+  if len > 0 then begin
+    let n = Unix.read fd buf ofs len in
+    if n = 0 then raise End_of_file;
+    really_read fd buf (ofs + n) (len - n)
+  end
+
+(* Messages are read without buffering, so that [Unix.select] never misses one
+   that would already sit in a channel buffer *)
+let read_message (fd : Unix.file_descr) : ('a, 'b) message =
+  let header = Bytes.create Marshal.header_size in
+  really_read fd header 0 Marshal.header_size;
+  let size = Marshal.total_size header 0 in
+  let buf = Bytes.extend header 0 (size - Marshal.header_size) in
+  really_read fd buf Marshal.header_size (size - Marshal.header_size);
+  Marshal.from_bytes buf 0
+
+let worker_loop (job : int -> 'a) (finish : unit -> 'b) (ic : in_channel)
+    (oc : out_channel) : 'c =
+  let send (msg : ('a, 'b) message) =
+    Marshal.to_channel oc msg [];
+    flush oc
+  in
+  let rec loop () =
+    match (Marshal.from_channel ic : int list) with
+    | [] ->
+        send (Finished (finish ()));
+        exit 0
+    | chunk ->
+        List.iter (fun i -> send (Result (i, job i))) chunk;
+        loop ()
+  in
+  loop ()
+
+let run ~(workers : int) ~(chunksize : int) (job : int -> 'a)
+    (finish : unit -> 'b) (n : int) (on_result : int -> 'a -> unit) : 'b list =
+  let num_workers = max 1 workers in
+  let chunksize = max 1 chunksize in
+  let next_job = ref 0 in
+  flush_all ();
+  let workers =
+    List.fold_left
+      (fun workers _ ->
+        let to_worker_in, to_worker_out = Unix.pipe () in
+        let from_worker_in, from_worker_out = Unix.pipe () in
+        match Unix.fork () with
+        | 0 ->
+            Unix.close to_worker_out;
+            Unix.close from_worker_in;
+            List.iter
+              (fun w ->
+                close_out_noerr w.to_worker;
+                Unix.close w.from_worker)
+              workers;
+            worker_loop job finish
+              (Unix.in_channel_of_descr to_worker_in)
+              (Unix.out_channel_of_descr from_worker_out)
+        | pid ->
+            Unix.close to_worker_in;
+            Unix.close from_worker_out;
+            {
+              pid;
+              to_worker = Unix.out_channel_of_descr to_worker_out;
+              from_worker = from_worker_in;
+              pending = 0;
+            }
+            :: workers)
+      []
+      (List.init num_workers Fun.id)
+  in
+  (* An empty chunk tells the worker to finish *)
+  let send_chunk (w : worker) =
+    let chunk =
+      List.init (min chunksize (n - !next_job)) (fun i -> !next_job + i)
+    in
+    next_job := !next_job + List.length chunk;
+    w.pending <- List.length chunk;
+    Marshal.to_channel w.to_worker chunk [];
+    flush w.to_worker
+  in
+  List.iter send_chunk workers;
+  let rec loop (running : worker list) (finished : 'b list) =
+    if running = [] then finished
+    else
+      let ready, _, _ =
+        Unix.select (List.map (fun w -> w.from_worker) running) [] [] (-1.)
+      in
+      let running, finished =
+        List.fold_left
+          (fun (running, finished) fd ->
+            let w = List.find (fun w -> w.from_worker = fd) running in
+            match read_message w.from_worker with
+            | Result (i, r) ->
+                on_result i r;
+                w.pending <- w.pending - 1;
+                if w.pending = 0 then send_chunk w;
+                (running, finished)
+            | Finished b ->
+                close_out w.to_worker;
+                Unix.close w.from_worker;
+                ignore (Unix.waitpid [] w.pid);
+                (List.filter (fun w' -> w'.pid <> w.pid) running, b :: finished)
+            | exception End_of_file ->
+                Errors.raise_error
+                  (Format.asprintf "worker process %d died unexpectedly" w.pid))
+          (running, finished) ready
+      in
+      loop running finished
+  in
+  loop workers []
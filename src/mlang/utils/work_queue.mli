@@ -0,0 +1,35 @@
+(* Copyright (C) 2019-2021 Inria, contributor: Denis Merigoux
+   <denis.merigoux@inria.fr>
+
+   This program is free software: you can redistribute it and/or modify it under
+   the terms of the GNU General Public License as published by the Free Software
+   Foundation, either version 3 of the License, or (at your option) any later
+   version.
+
+   This program is distributed in the hope that it will be useful, but WITHOUT
+   ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+   FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+   details.
+
+   You should have received a copy of the GNU General Public License along with
+   this program. If not, see <https://www.gnu.org/licenses/>. *)
+
+(** Runs jobs of very different costs in worker processes. Workers are given
+    small chunks of jobs as soon as they are idle, and send back the result of
+    each job as soon as it is done. *)
+
+val run :
+  workers:int ->
+  chunksize:int ->
+  (int -> 'a) ->
+  (unit -> 'b) ->
+  int ->
+  (int -> 'a -> unit) ->
+  'b list
+(** [run ~workers ~chunksize job finish n on_result] runs [job i] for all [i]
+    from [0] to [n - 1] in [workers] forked processes. [on_result i r] is called
+    in the main process as soon as the result [r] of [job i] is received. Once
+    all the jobs are done, each worker sends [finish ()], which lets the jobs
+    accumulate data inside the worker instead of sending it with every result;
+    the list of these values is returned. [job] should catch its own
+    exceptions: one escaping it ends its worker, and [run] then fails. *)